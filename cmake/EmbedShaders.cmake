@@ -0,0 +1,49 @@
+# Generates a C++ source file containing the source code of all the shaders in
+# SHADERS_DIR (OpenGL*/*), so that they can be compiled into the library.
+# Usage: cmake -DSHADERS_DIR=<dir> -DOUTPUT_FILE=<file> -P EmbedShaders.cmake
+
+file(GLOB SHADER_FILES RELATIVE "${SHADERS_DIR}" "${SHADERS_DIR}/OpenGL*/*")
+list(SORT SHADER_FILES)
+
+set(SHADER_TABLE "")
+
+foreach(SHADER_FILE ${SHADER_FILES})
+  file(READ "${SHADERS_DIR}/${SHADER_FILE}" SHADER_SOURCE)
+  set(SHADER_TABLE "${SHADER_TABLE}      {\"${SHADER_FILE}\", R\"small3d(${SHADER_SOURCE})small3d\"},\n")
+endforeach()
+
+file(WRITE "${OUTPUT_FILE}.tmp"
+"// Generated by EmbedShaders.cmake from the files in resources/shaders. Do not edit.
+
+#include \"EmbeddedShaders.hpp\"
+
+namespace small3d {
+
+  namespace {
+
+    class EmbeddedShader {
+    public:
+      const char *name;
+      const char *source;
+    };
+
+    constexpr EmbeddedShader embeddedShaders[] = {
+${SHADER_TABLE}    };
+
+  }
+
+  const char *getEmbeddedShader(const std::string &name) {
+    for (const EmbeddedShader &shader : embeddedShaders) {
+      if (name == shader.name) {
+        return shader.source;
+      }
+    }
+    return nullptr;
+  }
+
+}
+")
+
+# Only touch the output file if it has changed, to avoid needless rebuilds
+configure_file("${OUTPUT_FILE}.tmp" "${OUTPUT_FILE}" COPYONLY)
+file(REMOVE "${OUTPUT_FILE}.tmp")
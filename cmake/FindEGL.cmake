@@ -0,0 +1,22 @@
+find_path(EGL_INCLUDE_DIRS
+  NAMES
+  EGL/egl.h
+  PATHS
+  include
+  /usr/include
+  )
+
+find_library(
+  EGL_LIBRARIES
+  NAMES
+  EGL
+  PATHS
+  lib
+  /usr/lib
+  /usr/lib/x86_64-linux-gnu
+  /usr/lib/i386-linux-gnu
+  )
+
+INCLUDE(FindPackageHandleStandardArgs)
+
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(EGL REQUIRED_VARS EGL_LIBRARIES EGL_INCLUDE_DIRS)
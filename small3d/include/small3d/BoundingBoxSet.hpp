@@ -11,14 +11,130 @@
 #include <memory>
 #include "Logger.hpp"
 #include <vector>
+#include <limits>
+#include <cstdint>
 #include <glm/glm.hpp>
 
-#ifndef SMALL3D_GLFW
+#if !defined(SMALL3D_GLFW) && !defined(SMALL3D_HEADLESS)
 #include <SDL.h>
 #endif
 
 namespace small3d {
 
+  /**
+   * @brief Ways of checking whether two sets of bounding boxes collide (see BoundingBoxSet.collidesWith)
+   */
+
+  enum CollisionMode {
+    collisionvertices, collisionorientedboxes
+  };
+
+  /**
+   * @class RayHit
+   * @brief Where a ray or segment hits a set of bounding boxes (see BoundingBoxSet.castRay)
+   */
+
+  class RayHit {
+  public:
+
+    /**
+     * @brief The index of the box hit first (-1 if no box has been hit)
+     */
+    int boxIndex;
+
+    /**
+     * @brief The distance from the start of the ray to the point where it enters the box
+     * (0 if it starts inside it)
+     */
+    float distance;
+  };
+
+  /**
+   * @class Placement
+   * @brief Where a set of bounding boxes is on the scene. Queries taking a placement use it
+   * instead of the offset and rotation of the set, and change nothing, so they can be made
+   * from many threads at the same time.
+   */
+
+  class Placement {
+  public:
+
+    /**
+     * @brief The offset (position on the scene)
+     */
+    glm::vec3 offset;
+
+    /**
+     * @brief The rotation around the x, y and z axes
+     */
+    glm::vec3 rotation;
+
+    /**
+     * @brief Default constructor (no offset or rotation)
+     */
+    Placement();
+
+    /**
+     * @brief Constructor
+     * @param offset   The offset
+     * @param rotation The rotation
+     */
+    Placement(const glm::vec3 &offset, const glm::vec3 &rotation);
+  };
+
+  class BoundingBoxSet;
+
+  /**
+   * @class CollisionCache
+   * @brief What has been found out the last time two sets of bounding boxes have been checked
+   * for collision, so that checking them again, usually on the next frame, can be skipped or
+   * made cheaply (see BoundingBoxSet.collidesWith). When the sets are apart, an axis along which
+   * they are separated is kept, with the gap between them along it and where they were. Until
+   * they have moved or rotated far enough to close the gap, they are not checked again. After
+   * that, they are checked along the same axis first. When the sets collide in the
+   * collisionorientedboxes mode, the two boxes found to overlap are checked first the next time.
+   * A cache is for one pair of sets, checked in the same order. It is reset if it is used
+   * for another pair, or if the boxes of either set are loaded or adjusted again.
+   */
+
+  class CollisionCache {
+  private:
+    friend class BoundingBoxSet;
+
+    const BoundingBoxSet *boxSet;
+    const BoundingBoxSet *otherBoxSet;
+    unsigned int version, otherVersion;
+    bool separated;
+    glm::vec3 axis;
+    float gap;
+    Placement placement, otherPlacement;
+    int box, otherBox;
+
+  public:
+
+    /**
+     * @brief The number of times the sets have been checked in full, without the help of the cache
+     */
+    unsigned int fullChecks;
+
+    /**
+     * @brief Constructor (nothing is known about the pair)
+     */
+    CollisionCache();
+
+    /**
+     * @brief Forget everything about the pair
+     */
+    void reset();
+
+    /**
+     * @brief Check if the sets have been found apart, separated along an axis, the last time
+     * they have been checked
+     * @return True if they have, false otherwise
+     */
+    bool isSeparated() const;
+  };
+
   /**
    * @class BoundingBoxSet
    * @brief Bounding boxes for a model. Even though the loading logic is similar
@@ -42,6 +158,160 @@ namespace small3d {
   private:
     glm::mat4x4 rotationAdjustment;
 
+    // The extents of each box, with the rotation adjustment applied, one array per
+    // coordinate (the boxes are axis aligned in the space of the set)
+    std::vector<float> boxMinX, boxMaxX, boxMinY, boxMaxY, boxMinZ, boxMaxZ;
+
+    // The extents of all the boxes together
+    glm::vec3 setMinCoords, setMaxCoords;
+
+    // Changed every time the extents of the boxes are calculated (see CollisionCache)
+    unsigned int version;
+
+    /**
+     * @brief A node of the tree of boxes. Its first child follows it in the tree and it is a leaf
+     * if it contains boxes.
+     */
+    class BoxTreeNode {
+    public:
+      glm::vec3 minCoords, maxCoords;
+      int secondChild;
+      int firstBox;
+      int numBoxes;
+    };
+
+    static const int BOX_TREE_LEAF_SIZE = 4;
+    static const int BOX_TREE_MAX_DEPTH = 64;
+
+    // Tree of the extents of the boxes, so that queries do not have to go through all of them
+    std::vector<BoxTreeNode> boxTree;
+
+    // The indexes of the boxes, in the order in which they appear in the leaves of the tree
+    std::vector<int> boxTreeOrder;
+
+    /**
+     * @brief Build the tree of boxes from their extents
+     */
+    void buildBoxTree();
+
+    /**
+     * @brief Add a node for some of the boxes, and its children, to the tree
+     * @param firstBox The position of the node's first box in boxTreeOrder
+     * @param numBoxes The number of boxes in the node
+     * @param depth The depth of the node
+     */
+    void buildBoxTreeNode(int firstBox, int numBoxes, int depth);
+
+    /**
+     * @brief Find the first box hit by a ray, already transformed to the space of the set
+     * @param origin The origin of the ray
+     * @param inverseDirection 1 divided by each coordinate of the (normalised) direction of the ray
+     * @param maxDistance How far along the ray to look
+     * @param hit The box hit first and the distance to it
+     */
+    void castRayInBoxSpace(const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance,
+                           RayHit &hit) const;
+
+    /**
+     * @brief Find the first box hit by each of many rays, already transformed to the space of the set,
+     * four at a time when SSE is available
+     * @param origins The origins of the rays
+     * @param inverseDirections 1 divided by each coordinate of the (normalised) direction of each ray
+     * @param maxDistances How far along each ray to look
+     * @param hits The box hit first by each ray and the distance to it
+     */
+    void castRaysInBoxSpace(const std::vector<glm::vec3> &origins, const std::vector<glm::vec3> &inverseDirections,
+                            const std::vector<float> &maxDistances, std::vector<RayHit> &hits) const;
+
+    /**
+     * @brief Transform a ray from world space to the space of the set
+     * @param placement The placement of the set
+     * @param origin The origin of the ray, transformed in place
+     * @param direction The direction of the ray, replaced by 1 divided by each coordinate of the
+     *                  transformed direction, normalised
+     * @return False if the direction is zero (it is then replaced by (1, 1, 1), so that, with a
+     *         distance of 0 to look along it, the ray only hits the boxes its origin is in),
+     *         true otherwise
+     */
+    bool transformRay(const Placement &placement, glm::vec3 &origin, glm::vec3 &direction) const;
+
+    /**
+     * @brief Calculate the extents of the boxes from their vertices and the rotation adjustment
+     */
+    void calculateExtents();
+
+    /**
+     * @brief Check if a point, already transformed to the space of the set, is inside any of the boxes
+     * @param point The point
+     * @return True if the point is inside a box, false otherwise
+     */
+    bool containsInBoxSpace(const glm::vec3 &point) const;
+
+    // The centre and half the size of each box, before the rotation adjustment is applied
+    std::vector<glm::vec3> boxCentres, boxHalfSizes;
+
+    /**
+     * @brief Get the transformation from the space of the boxes to the world (rotation adjustment,
+     * rotation and offset)
+     * @param placement The placement of the set
+     * @return The transformation matrix
+     */
+    glm::mat4x4 getTransformation(const Placement &placement) const;
+
+    /**
+     * @brief Check if any of the boxes overlaps with any of the boxes of another set, treating them
+     * as oriented boxes (see collidesWith)
+     * @param placement The placement of this set
+     * @param otherBoxSet The other box set
+     * @param otherPlacement The placement of the other set
+     * @return True if two boxes overlap, false otherwise
+     */
+    bool orientedBoxesCollideWith(const Placement &placement, const BoundingBoxSet &otherBoxSet,
+                                  const Placement &otherPlacement, int &box, int &otherBox) const;
+
+    /**
+     * @brief Check if a box overlaps with a box of another set, treating them as oriented boxes
+     * @return True if the boxes overlap, false otherwise
+     */
+    bool boxPairCollides(const Placement &placement, int box, const BoundingBoxSet &otherBoxSet,
+                         const Placement &otherPlacement, int otherBox) const;
+
+    /**
+     * @brief Get how far any point of the boxes can have moved between two placements of the set
+     * @param from The first placement
+     * @param to The second placement
+     * @return A distance which is not exceeded by the movement of any point
+     */
+    float getMaxMovement(const Placement &from, const Placement &to) const;
+
+    /**
+     * @brief Project the box enclosing the set on an axis
+     * @param placement The placement of the set
+     * @param rotationMatrix The rotation of the set, for the placement
+     * @param axis The axis (normalised)
+     * @param minProjection The start of the projection
+     * @param maxProjection The end of the projection
+     */
+    void projectOnAxis(const Placement &placement, const glm::mat4x4 &rotationMatrix, const glm::vec3 &axis,
+                       float &minProjection, float &maxProjection) const;
+
+    /**
+     * @brief Get the gap between the boxes enclosing this set and another one along an axis
+     * @return The gap (0 or less if their projections on the axis overlap)
+     */
+    float getGapAlongAxis(const Placement &placement, const glm::mat4x4 &rotationMatrix,
+                          const BoundingBoxSet &otherBoxSet, const Placement &otherPlacement,
+                          const glm::mat4x4 &otherRotationMatrix, const glm::vec3 &axis) const;
+
+    /**
+     * @brief Look for an axis along which the boxes enclosing this set and another one are apart
+     * @param axis The axis along which the sets are furthest apart
+     * @param gap The gap between the sets along the axis
+     * @return True if such an axis has been found, false otherwise
+     */
+    bool findSeparatingAxis(const Placement &placement, const BoundingBoxSet &otherBoxSet,
+                            const Placement &otherPlacement, glm::vec3 &axis, float &gap) const;
+
   public:
 
     /**
@@ -63,7 +333,7 @@ namespace small3d {
      *                  to be found. If this is not set, it is assumed to be the directory
      *                  containing the application executable when using SDL, or the
      *                  directory from where the execution command is entered when 
-     *                  using GLFW.
+     *                  using GLFW or rendering headless.
      */
 
     BoundingBoxSet(std::string basePath = "");
@@ -85,6 +355,20 @@ namespace small3d {
 
     std::vector<std::vector<unsigned int> > facesVertexIndexes;
 
+    /**
+     * @brief The vertex coordinates of all boxes in a single array (x, y, z for each vertex),
+     * prepared for rendering when the boxes are loaded
+     */
+
+    std::vector<float> vertexData;
+
+    /**
+     * @brief Vertex indexes of the triangles making up the faces of all boxes (two per face),
+     * prepared for rendering when the boxes are loaded
+     */
+
+    std::vector<unsigned int> indexData;
+
     /**
      * @brief Load the bounding boxes from a Wavefront file.
      *
@@ -101,6 +385,12 @@ namespace small3d {
      */
     void setRotationAdjustment(const glm::mat4x4 &ajdustmentMatrix);
 
+    /**
+     * @brief Get the current offset and rotation of the set, as a placement
+     * @return The placement
+     */
+    Placement getPlacement() const;
+
     /**
      * @brief Check if a point collides (or is inside) any of the boxes
      * assuming that they are in a given offset and have a certain rotation.
@@ -112,16 +402,240 @@ namespace small3d {
 
     bool collidesWith(glm::vec3 point) const;
 
+    /**
+     * @brief Check if a point collides with any of the boxes, with the set at a given placement
+     *        instead of its offset and rotation (see Placement)
+     *
+     * @param	placement	The placement of the set
+     * @param	point		The point
+     *
+     * @return	true if there is a collision, false if not.
+     */
+
+    bool collidesWith(const Placement &placement, glm::vec3 point) const;
+
+    /**
+     * @brief Check which of many points collide with (are inside) any of the boxes. This is much
+     *        faster than checking the points one by one, since the transformation to the space
+     *        of the boxes is only worked out once and the points are tested four at a time
+     *        (when SSE is available).
+     *
+     * @param	points		The points
+     * @param	numPoints	The number of points
+     * @param	collisions	Bit (n % 32) of collisions[n / 32] is set if point n collides and cleared
+     *			   	if not. There have to be (numPoints + 31) / 32 values.
+     */
+
+    void collidesWith(const glm::vec3 *points, size_t numPoints, uint32_t *collisions) const;
+
+    /**
+     * @brief Check which of many points collide with any of the boxes, with the set at a given
+     *        placement (see above)
+     */
+
+    void collidesWith(const Placement &placement, const glm::vec3 *points, size_t numPoints,
+                      uint32_t *collisions) const;
+
+    /**
+     * @brief Check which of many points collide with (are inside) any of the boxes (see above)
+     *
+     * @param	points		The points
+     * @param	collisions	The collisions, as a bitmask (resized to fit the points)
+     */
+
+    void collidesWith(const std::vector<glm::vec3> &points, std::vector<uint32_t> &collisions) const;
+
+    /**
+     * @brief Check which of many points collide with any of the boxes, with the set at a given
+     *        placement (see above)
+     */
+
+    void collidesWith(const Placement &placement, const std::vector<glm::vec3> &points,
+                      std::vector<uint32_t> &collisions) const;
+
     /**
      * @brief Check if another set of bounding boxes is located with this set (even partially), 
      * thus colliding with it.
      *
      * @param otherBoxSet The other box set
+     * @param mode        With collisionvertices (the default), check if any of the corners of
+     *                    the other set's boxes is inside a box of this set. This misses boxes
+     *                    that cross each other without either having a corner inside the other,
+     *                    so it is normally done in both directions (see SceneObject.collidesWith).
+     *                    With collisionorientedboxes, check exactly whether any two boxes overlap,
+     *                    treating each as a box oriented by the rotation and rotation adjustment
+     *                    of its set (separating axis test). Boxes that only touch are considered
+     *                    to collide.
+     *
+     * @return	true if there is a collision, false if not.
+     */
+
+    bool collidesWith(const BoundingBoxSet &otherBoxSet, CollisionMode mode = collisionvertices) const;
+
+    /**
+     * @brief Check if another set of bounding boxes collides with this one, with each set at a
+     *        given placement (see above)
+     *
+     * @param placement      The placement of this set
+     * @param otherBoxSet    The other box set
+     * @param otherPlacement The placement of the other set
+     * @param mode           How to check (see above)
+     *
+     * @return	true if there is a collision, false if not.
+     */
+
+    bool collidesWith(const Placement &placement, const BoundingBoxSet &otherBoxSet,
+                      const Placement &otherPlacement, CollisionMode mode = collisionvertices) const;
+
+    /**
+     * @brief Check if another set of bounding boxes collides with this one, using what has been
+     *        found out the last time the two sets have been checked (see CollisionCache). The
+     *        result is the same as without the cache. Sets which remain apart from one check to
+     *        the next are usually not checked again at all.
+     *
+     * @param placement      The placement of this set
+     * @param otherBoxSet    The other box set
+     * @param otherPlacement The placement of the other set
+     * @param mode           How to check (see above)
+     * @param cache          The cache for the pair, updated by the check
      *
      * @return	true if there is a collision, false if not.
      */
 
-    bool collidesWith(BoundingBoxSet &otherBoxSet) const;
+    bool collidesWith(const Placement &placement, const BoundingBoxSet &otherBoxSet,
+                      const Placement &otherPlacement, CollisionMode mode, CollisionCache &cache) const;
+
+    /**
+     * @brief Check if the set collides with another set while moving in a straight line from a
+     *        previous offset to its current one (for example, during the last frame), without
+     *        rotating, and find when it first does. Unlike checking the current offset only, this
+     *        does not miss fast objects passing through thin ones. The boxes are treated as
+     *        oriented boxes (see collisionorientedboxes) and the other set is assumed not to move.
+     *
+     * @param previousOffset The offset from which the set has moved
+     * @param otherBoxSet    The other box set
+     * @param timeOfImpact   When the sets first collide, from 0 (at the previous offset) to 1
+     *                       (at the current offset). It is set to 1 if they do not collide.
+     *
+     * @return	true if there is a collision, false if not.
+     */
+
+    bool sweptCollidesWith(const glm::vec3 &previousOffset, const BoundingBoxSet &otherBoxSet,
+                           float &timeOfImpact) const;
+
+    /**
+     * @brief Check if the set collides with another set while moving, with each set at a given
+     *        placement (see above). The set moves from the previous offset to that of its placement.
+     */
+
+    bool sweptCollidesWith(const Placement &placement, const glm::vec3 &previousOffset,
+                           const BoundingBoxSet &otherBoxSet, const Placement &otherPlacement,
+                           float &timeOfImpact) const;
+
+    /**
+     * @brief Get an axis aligned box in world space containing all the boxes of the set, at
+     * its current offset and rotation
+     *
+     * @param minCoords The minimum coordinates of the box
+     * @param maxCoords The maximum coordinates of the box
+     */
+
+    void getWorldExtents(glm::vec3 &minCoords, glm::vec3 &maxCoords) const;
+
+    /**
+     * @brief Get an axis aligned box in world space containing all the boxes of the set, at
+     * a given placement
+     *
+     * @param placement The placement of the set
+     * @param minCoords The minimum coordinates of the box
+     * @param maxCoords The maximum coordinates of the box
+     */
+
+    void getWorldExtents(const Placement &placement, glm::vec3 &minCoords, glm::vec3 &maxCoords) const;
+
+    /**
+     * @brief Find the first box hit by a ray, with the set at its current offset and rotation.
+     *        A ray starting inside a box hits it at distance 0.
+     *
+     * @param origin      The origin of the ray
+     * @param direction   The direction of the ray (it does not need to be normalised)
+     * @param hit         The box hit first and the distance to it
+     * @param maxDistance How far along the ray to look
+     *
+     * @return True if a box has been hit, false if not.
+     */
+
+    bool castRay(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit,
+                 float maxDistance = std::numeric_limits<float>::max()) const;
+
+    /**
+     * @brief Find the first box hit by a ray, with the set at a given placement (see above)
+     */
+
+    bool castRay(const Placement &placement, const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit,
+                 float maxDistance = std::numeric_limits<float>::max()) const;
+
+    /**
+     * @brief Find the first box hit by a line segment (for example, to check whether the line
+     * of sight between two points is blocked)
+     *
+     * @param start The start of the segment
+     * @param end   The end of the segment
+     * @param hit   The box hit first and its distance from the start of the segment
+     *
+     * @return True if a box has been hit, false if not.
+     */
+
+    bool intersectsSegment(const glm::vec3 &start, const glm::vec3 &end, RayHit &hit) const;
+
+    /**
+     * @brief Find the first box hit by a line segment, with the set at a given placement (see above)
+     */
+
+    bool intersectsSegment(const Placement &placement, const glm::vec3 &start, const glm::vec3 &end,
+                           RayHit &hit) const;
+
+    /**
+     * @brief Cast many rays at once. This is faster than casting them one by one, since they
+     * are tested against the boxes four at a time (when SSE is available).
+     *
+     * @param origins     The origins of the rays
+     * @param directions  The directions of the rays
+     * @param hits        The box hit first by each ray and the distance to it (boxIndex is
+     *                    -1 for the rays that have not hit a box)
+     * @param maxDistance How far along the rays to look
+     */
+
+    void castRays(const std::vector<glm::vec3> &origins, const std::vector<glm::vec3> &directions,
+                  std::vector<RayHit> &hits, float maxDistance = std::numeric_limits<float>::max()) const;
+
+    /**
+     * @brief Cast many rays at once, with the set at a given placement (see above)
+     */
+
+    void castRays(const Placement &placement, const std::vector<glm::vec3> &origins,
+                  const std::vector<glm::vec3> &directions, std::vector<RayHit> &hits,
+                  float maxDistance = std::numeric_limits<float>::max()) const;
+
+    /**
+     * @brief Find the first box hit by each of many line segments at once (see castRays)
+     *
+     * @param starts The starts of the segments
+     * @param ends   The ends of the segments
+     * @param hits   The box hit first by each segment and its distance from the start of the
+     *               segment (boxIndex is -1 for the segments that have not hit a box)
+     */
+
+    void intersectSegments(const std::vector<glm::vec3> &starts, const std::vector<glm::vec3> &ends,
+                           std::vector<RayHit> &hits) const;
+
+    /**
+     * @brief Find the first box hit by each of many line segments at once, with the set at a
+     *        given placement (see above)
+     */
+
+    void intersectSegments(const Placement &placement, const std::vector<glm::vec3> &starts,
+                           const std::vector<glm::vec3> &ends, std::vector<RayHit> &hits) const;
 
   };
 }
@@ -0,0 +1,211 @@
+/*
+ *  CollisionWorld.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <glm/glm.hpp>
+#include "SceneObject.hpp"
+
+namespace small3d {
+
+  /**
+   * @class CollisionPair
+   * @brief Two objects whose bounding boxes may collide (see CollisionWorld)
+   */
+  class CollisionPair {
+  public:
+
+    /**
+     * @brief The first object
+     */
+    SceneObject *first;
+
+    /**
+     * @brief The second object
+     */
+    SceneObject *second;
+
+    /**
+     * @brief Whether the objects' bounding boxes have been found to collide
+     */
+    bool colliding;
+
+    /**
+     * @brief The cache used to check the pair (see SceneObject.collidesWith), or nullptr
+     * to check it without one
+     */
+    CollisionCache *cache;
+
+    /**
+     * @brief Constructor
+     */
+    CollisionPair();
+  };
+
+  /**
+   * @class CollisionWorld
+   * @brief Detects collisions between many objects at once. The world space extents of each
+   * object's bounding box set are sorted along one axis, and only objects whose extents overlap
+   * on all three axes (sweep and prune) are checked with SceneObject.collidesWith. The order
+   * is kept from one check to the next, so when objects move a little between frames, sorting
+   * again takes close to linear time. The pairs are checked by a pool of worker threads,
+   * together with the calling thread, since checking them does not change the objects.
+   * A CollisionCache is kept for each pair for as long as the extents of its objects keep
+   * overlapping, so that objects which are near each other but apart are rarely checked in full.
+   */
+  class CollisionWorld {
+  private:
+
+    class Entry {
+    public:
+      SceneObject *object;
+      glm::vec3 minCoords;
+      glm::vec3 maxCoords;
+    };
+
+    class Endpoint {
+    public:
+      float value;
+      unsigned int entry;
+      bool isMax;
+    };
+
+    CollisionMode mode;
+    int axis;
+    bool sorted;
+    std::vector<Entry> entries;
+    std::vector<Endpoint> endpoints;
+    std::vector<unsigned int> activeEntries;
+    std::vector<CollisionPair> pairs;
+
+    class PairCache {
+    public:
+      CollisionCache cache;
+      unsigned int lastUsed;
+    };
+
+    // The caches of the pairs found, by their objects (first and second, as in the pairs)
+    std::map<std::pair<const SceneObject*, const SceneObject*>, PairCache> pairCaches;
+    unsigned int numDetections;
+
+    // Number of pairs each thread takes from a batch at a time
+    static const size_t PAIRS_PER_TASK = 16;
+
+    unsigned int numThreads;
+    std::vector<std::thread> workers;
+    std::mutex workMutex;
+    std::condition_variable workCondition;
+    std::condition_variable doneCondition;
+    bool stopping;
+
+    // The batch of pairs being checked. Each batch has a new number, so that the workers
+    // know when there is one to work on.
+    CollisionPair *batch;
+    size_t batchSize;
+    std::atomic<size_t> nextPair;
+    unsigned int batchNumber;
+    unsigned int busyWorkers;
+    std::exception_ptr batchError;
+
+    void updateExtents();
+    void sortEndpoints();
+
+    /**
+     * @brief Check pairs of the current batch until none are left (runs on the calling thread
+     * and on each worker)
+     */
+    void checkBatch();
+
+    /**
+     * @brief Wait for batches and help check them until the workers are stopped (runs on the
+     * worker threads)
+     * @param lastBatchNumber The number of the last batch before the worker was started
+     */
+    void work(unsigned int lastBatchNumber);
+
+    void startWorkers();
+    void stopWorkers();
+
+  public:
+
+    /**
+     * @brief Constructor
+     * @param mode       How pairs of objects whose extents overlap are checked (see SceneObject.collidesWith)
+     * @param numThreads The number of threads checking pairs, including the calling thread (see setNumThreads)
+     */
+    CollisionWorld(CollisionMode mode = collisionorientedboxes, unsigned int numThreads = 0);
+
+    /**
+     * @brief Destructor (stops the worker threads)
+     */
+    ~CollisionWorld();
+
+    CollisionWorld(const CollisionWorld &) = delete;
+    CollisionWorld& operator=(const CollisionWorld &) = delete;
+
+    /**
+     * @brief Set the number of threads checking pairs, including the calling thread. The worker
+     * threads are started the first time there are enough pairs to share between them.
+     * @param numThreads The number of threads (0 for one per core, 1 to check all pairs on the
+     *                   calling thread)
+     */
+    void setNumThreads(unsigned int numThreads);
+
+    /**
+     * @brief Get the number of threads checking pairs, including the calling thread
+     * @return The number of threads
+     */
+    unsigned int getNumThreads() const;
+
+    /**
+     * @brief Add an object. The object has to have bounding boxes and has to exist for as
+     * long as it is in the world (or until it is removed).
+     * @param object The object
+     */
+    void add(SceneObject &object);
+
+    /**
+     * @brief Remove an object
+     * @param object The object
+     */
+    void remove(SceneObject &object);
+
+    /**
+     * @brief Get the number of objects in the world
+     * @return The number of objects
+     */
+    size_t getNumObjects() const;
+
+    /**
+     * @brief Find the objects that collide, at their current offsets and rotations
+     * @return All the pairs of objects whose extents overlap (the candidates), with
+     *         colliding set for those whose bounding boxes have been found to collide.
+     *         The pairs remain valid until the next call.
+     */
+    const std::vector<CollisionPair>& detectCollisions();
+
+    /**
+     * @brief Check whether the objects of many pairs collide, sharing the pairs between the
+     * threads (see setNumThreads), in the mode of the world. The objects do not have to be in
+     * the world, but they have to have bounding boxes and must not be changed until this returns.
+     * If a check throws an exception, the remaining pairs are skipped and it is thrown again
+     * on the calling thread. Pairs with a cache are checked with it, so no two pairs can share
+     * the same cache.
+     * @param pairs The pairs, with colliding set for those whose bounding boxes collide
+     */
+    void checkPairs(std::vector<CollisionPair> &pairs);
+
+  };
+
+}
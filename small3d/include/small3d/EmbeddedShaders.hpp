@@ -0,0 +1,24 @@
+/*
+ *  EmbeddedShaders.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <string>
+
+namespace small3d {
+
+  /**
+   * @brief Get the source code of one of the shaders provided by the engine, as compiled into
+   * the library when it is built (only available when SMALL3D_EMBEDDED_SHADERS is defined, which
+   * the cmake build does, generating the definition of this function from the files in
+   * resources/shaders)
+   * @param name The path of the shader, relative to the shaders directory (for example
+   *             "OpenGL33/textShader.vert")
+   * @return The source code of the shader, or nullptr if there is no such shader
+   */
+  const char *getEmbeddedShader(const std::string &name);
+
+}
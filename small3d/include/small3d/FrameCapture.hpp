@@ -0,0 +1,139 @@
+/*
+ *  FrameCapture.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include "GLStateCache.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+
+namespace small3d {
+
+  /**
+   * @brief Formats in which captured frames can be saved
+   */
+
+  enum FrameCaptureFormat {
+    framecapturepng, framecapturey4m
+  };
+
+  /**
+   * @class FrameCapture
+   * @brief Records rendered frames to disk without stalling rendering. Each frame is copied
+   * to one of a ring of pixel buffer objects and only read back into memory two frames later,
+   * by which time the copy has (normally) completed on the GPU. The frames that have been read
+   * back are then encoded and written to disk by a worker thread.
+   */
+
+  class FrameCapture {
+  private:
+
+    class CapturedFrame {
+    public:
+      unsigned long number;
+      std::vector<unsigned char> pixels;
+    };
+
+    static const int RING_SIZE = 3;
+
+    GLStateCache &stateCache;
+    std::string path;
+    FrameCaptureFormat format;
+    int width, height;
+    bool useFences;
+
+    GLuint pixelBufferObjectIds[RING_SIZE];
+    GLsync fences[RING_SIZE];
+    bool pending[RING_SIZE];
+    unsigned long pendingFrameNumbers[RING_SIZE];
+    unsigned long frameNumber;
+
+    FILE *y4mFile;
+    std::vector<unsigned char> y4mPlanes;
+
+    std::thread worker;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<CapturedFrame> queue;
+    std::vector<std::vector<unsigned char>> sparePixels;
+    bool stopping;
+    std::string workerError;
+
+    /**
+     * @brief Wait for the copy of a frame to a pixel buffer object to complete, then read
+     * the frame into memory and queue it for encoding.
+     * @param slot The position of the pixel buffer object in the ring
+     */
+    void readBack(int slot);
+
+    /**
+     * @brief Encode and write queued frames until the capture is finished (runs on the worker thread)
+     */
+    void work();
+
+    void writePng(const CapturedFrame &frame);
+    void writeY4m(const CapturedFrame &frame);
+
+  public:
+
+    /**
+     * @brief Maximum number of frames waiting to be encoded. When the worker thread falls
+     * this far behind, capturing waits for it.
+     */
+    static const unsigned long MAX_QUEUED_FRAMES = 8;
+
+    /**
+     * @brief Constructor
+     * @param stateCache The OpenGL state cache of the renderer whose frames are captured
+     * @param path For PNG, the beginning of the path of each frame's file, to which the frame
+     *             number and the .png extension are appended (for example "capture/frame" results
+     *             in capture/frame000000.png, capture/frame000001.png, etc). For Y4M, the path of
+     *             the video file.
+     * @param format The format in which frames are saved. Y4M video is uncompressed (YUV 4:2:0),
+     *               so it is fast to write but takes up a lot of space.
+     * @param width The width of the frames, in pixels
+     * @param height The height of the frames, in pixels
+     * @param frameRate The frame rate recorded in Y4M video (frames per second)
+     * @param useFences Whether fence sync objects are available (OpenGL 3.2) to check when frames
+     *                  can be read back. Otherwise, reading back relies on the frames being read two
+     *                  frames after they have been captured.
+     */
+    FrameCapture(GLStateCache &stateCache, const std::string &path, FrameCaptureFormat format,
+                 int width, int height, int frameRate, bool useFences);
+
+    /**
+     * @brief Destructor (finish has to be called before this while the OpenGL context exists)
+     */
+    ~FrameCapture();
+
+    /**
+     * @brief Capture the frame that is being rendered (from the current read buffer). This
+     * should be called once per frame, after everything has been rendered and before the
+     * buffers are swapped.
+     */
+    void capture();
+
+    /**
+     * @brief Read back the frames that are still on the GPU, wait for all frames to be written
+     * and delete the pixel buffer objects. An exception is thrown if a frame could not be written.
+     */
+    void finish();
+
+    /**
+     * @brief Get the number of frames captured so far
+     * @return The number of frames
+     */
+    unsigned long getFrameCount() const;
+
+  };
+
+}
@@ -0,0 +1,242 @@
+/*
+ *  GLStateCache.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <unordered_map>
+
+namespace small3d {
+
+  /**
+   * @class GLStateStatistics
+   * @brief Number of OpenGL state changes made or skipped by a GLStateCache
+   */
+  class GLStateStatistics {
+  public:
+
+    /**
+     * @brief State changes passed on to OpenGL
+     */
+    unsigned long issued;
+
+    /**
+     * @brief Skipped glUseProgram calls
+     */
+    unsigned long skippedPrograms;
+
+    /**
+     * @brief Skipped glBindVertexArray calls
+     */
+    unsigned long skippedVertexArrays;
+
+    /**
+     * @brief Skipped glBindBuffer calls
+     */
+    unsigned long skippedBuffers;
+
+    /**
+     * @brief Skipped glActiveTexture and glBindTexture calls
+     */
+    unsigned long skippedTextures;
+
+    /**
+     * @brief Skipped glEnableVertexAttribArray and glDisableVertexAttribArray calls
+     */
+    unsigned long skippedVertexAttributes;
+
+    /**
+     * @brief Skipped glEnable, glDisable, glBlendFunc, glDepthFunc, glDepthMask, glCullFace
+     * and glFrontFace calls
+     */
+    unsigned long skippedCapabilities;
+
+    /**
+     * @brief Skipped glClearColor calls
+     */
+    unsigned long skippedClearColours;
+
+    /**
+     * @brief Get the total number of state changes skipped
+     * @return The number of skipped calls
+     */
+    unsigned long getSkipped() const;
+  };
+
+  /**
+   * @class GLStateCache
+   * @brief Keeps a copy of the OpenGL state that the renderer changes (the program in use, the
+   * bound vertex array, buffers and textures, the enabled vertex attributes and the blending,
+   * depth and face culling settings), so that calls which would not change anything are not
+   * made. The enabled vertex attributes and the element array buffer are kept per vertex array
+   * object, since that is where OpenGL stores them. Until the cache knows a value (at first, and
+   * after invalidate is called) the corresponding call is always made.
+   */
+  class GLStateCache {
+  private:
+
+    static const GLuint UNKNOWN = 0xffffffff;
+    static const int MAX_TEXTURE_UNITS = 16;
+    static const int NUM_BUFFER_TARGETS = 7;
+
+    class VertexArrayState {
+    public:
+      GLuint elementArrayBuffer;
+      unsigned int enabledAttributes;
+      unsigned int knownAttributes;
+      VertexArrayState();
+    };
+
+    bool vertexArraysSupported;
+    GLuint program;
+    GLuint vertexArray;
+    std::unordered_map<GLuint, VertexArrayState> vertexArrays;
+    GLuint buffers[NUM_BUFFER_TARGETS];
+    GLenum activeTextureUnit;
+    GLuint textures[MAX_TEXTURE_UNITS];
+    int blendEnabled, depthTestEnabled, cullFaceEnabled;
+    GLenum blendSource, blendDestination;
+    GLenum depthFunction;
+    int depthWrites;
+    GLenum cullFaceMode, frontFaceMode;
+    bool clearColourKnown;
+    GLfloat clearColour[4];
+
+    GLStateStatistics statistics;
+
+    /**
+     * @brief Get the position of a buffer target in the buffers array
+     * @param target The target
+     * @return The position, or -1 if bindings to the target are not cached
+     */
+    int getBufferTarget(GLenum target) const;
+
+    int* getCapability(GLenum capability);
+
+    /**
+     * @brief Get the state of the bound vertex array object
+     * @return The state, or nullptr if it is not known which vertex array object is bound
+     */
+    VertexArrayState* getVertexArrayState();
+
+    bool change(bool changed, unsigned long &skipped);
+
+  public:
+
+    /**
+     * @brief Constructor (no OpenGL calls are made and no state is known)
+     */
+    GLStateCache();
+
+    /**
+     * @brief Forget the state, so that the next call setting each value is made. This has to be
+     * called when OpenGL state is changed without going through the cache (for example by the
+     * application, between rendering calls).
+     */
+    void invalidate();
+
+    /**
+     * @brief Set whether vertex array objects are available. Without them (OpenGL 2.1), the
+     * vertex attributes and the element array buffer are kept as global state.
+     * @param vertexArraysSupported True if vertex array objects are available (default), false otherwise
+     */
+    void setVertexArraysSupported(bool vertexArraysSupported);
+
+    /**
+     * @brief Get the number of state changes made and skipped
+     * @return The statistics
+     */
+    const GLStateStatistics& getStatistics() const;
+
+    /**
+     * @brief Set the number of state changes made and skipped to 0
+     */
+    void resetStatistics();
+
+    void useProgram(GLuint program);
+
+    void bindVertexArray(GLuint vertexArray);
+
+    /**
+     * @brief Bind a buffer. Bindings to GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+     * GL_SHADER_STORAGE_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER and
+     * GL_PIXEL_PACK_BUFFER are cached. Other targets are always bound.
+     * @param target The target
+     * @param buffer The buffer
+     */
+    void bindBuffer(GLenum target, GLuint buffer);
+
+    /**
+     * @brief Bind a buffer to an indexed binding point (this is never skipped, but it also binds
+     * the buffer to the target, which the cache has to know)
+     * @param target The target
+     * @param index The binding point
+     * @param buffer The buffer
+     */
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+    void activeTexture(GLenum textureUnit);
+
+    /**
+     * @brief Bind a texture to the active texture unit. Only GL_TEXTURE_2D bindings are cached.
+     * @param target The target
+     * @param texture The texture
+     */
+    void bindTexture(GLenum target, GLuint texture);
+
+    void enableVertexAttribArray(GLuint index);
+
+    void disableVertexAttribArray(GLuint index);
+
+    /**
+     * @brief Enable a capability. GL_BLEND, GL_DEPTH_TEST and GL_CULL_FACE are cached. Other
+     * capabilities are always enabled.
+     * @param capability The capability
+     */
+    void enable(GLenum capability);
+
+    /**
+     * @brief Disable a capability (see enable)
+     * @param capability The capability
+     */
+    void disable(GLenum capability);
+
+    void blendFunc(GLenum source, GLenum destination);
+
+    void depthFunc(GLenum function);
+
+    void depthMask(GLboolean flag);
+
+    void cullFace(GLenum mode);
+
+    void frontFace(GLenum mode);
+
+    void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+
+    /**
+     * @brief Delete buffers, forgetting any bindings to them
+     * @param count The number of buffers
+     * @param bufferIds The buffers
+     */
+    void deleteBuffers(GLsizei count, const GLuint *bufferIds);
+
+    /**
+     * @brief Delete textures, forgetting any bindings to them
+     * @param count The number of textures
+     * @param textureIds The textures
+     */
+    void deleteTextures(GLsizei count, const GLuint *textureIds);
+
+    /**
+     * @brief Delete vertex array objects, forgetting their state
+     * @param count The number of vertex array objects
+     * @param vertexArrayIds The vertex array objects
+     */
+    void deleteVertexArrays(GLsizei count, const GLuint *vertexArrayIds);
+
+  };
+
+}
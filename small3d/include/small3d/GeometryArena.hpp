@@ -0,0 +1,191 @@
+/*
+ *  GeometryArena.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include "Model.hpp"
+#include "Logger.hpp"
+#include "GLStateCache.hpp"
+
+namespace small3d {
+
+  /**
+   * @class GeometryArenaAllocation
+   * @brief The position of a model's geometry in a GeometryArena
+   */
+  class GeometryArenaAllocation {
+  public:
+
+    /**
+     * @brief Position of the model's first vertex in the arena's vertex buffer (in vertices)
+     */
+    unsigned long firstVertex;
+
+    /**
+     * @brief Number of vertices of the model
+     */
+    unsigned long numVertices;
+
+    /**
+     * @brief Position of the model's first vertex index in the arena's index buffer (in indexes)
+     */
+    unsigned long firstIndex;
+
+    /**
+     * @brief Number of vertex indexes of the model
+     */
+    unsigned long numIndices;
+  };
+
+  /**
+   * @class GeometryArena
+   * @brief Large vertex and index buffers, shared by many models. Each model added to the arena
+   * gets a part of each buffer and is drawn from there with a base vertex draw call
+   * (glDrawElementsBaseVertex), so that all models in the arena use the same buffers and
+   * vertex array object. The vertices are stored interleaved (see Model.interleave) with the
+   * minimum stride. An arena requires OpenGL 3.3.
+   */
+  class GeometryArena {
+  private:
+
+    /**
+     * @brief Keeps track of the free space in a buffer, as a list of free blocks, merging
+     * neighbouring blocks when space is freed.
+     */
+    class FreeList {
+    private:
+      // Free blocks (position -> size)
+      std::map<unsigned long, unsigned long> blocks;
+      unsigned long capacity;
+
+    public:
+      FreeList(unsigned long capacity);
+      bool allocate(unsigned long size, unsigned long &position);
+      void free(unsigned long position, unsigned long size);
+      void grow(unsigned long newCapacity);
+      void reset(unsigned long used);
+      unsigned long getCapacity() const;
+      unsigned long getFreeSpace() const;
+      unsigned long getEnd() const;
+    };
+
+    GLStateCache &stateCache;
+
+    FreeList vertexSpace, indexSpace;
+
+    std::unordered_map<unsigned int, GeometryArenaAllocation> allocations;
+    unsigned int nextHandle;
+
+    GLuint vaoId;
+    GLuint vertexBufferObjectId;
+    GLuint indexBufferObjectId;
+
+    bool fragmented;
+
+    /**
+     * @brief A part of a buffer to be copied to another position
+     */
+    class BufferMove {
+    public:
+      unsigned long from, to, size;
+    };
+
+    void createBuffers();
+
+    /**
+     * @brief Replace a buffer with a new one of a different size, copying parts of it over
+     * @param bufferId The buffer (set to the new one on return)
+     * @param newSize The size of the new buffer, in bytes
+     * @param moves The parts to copy, in bytes
+     */
+    void reallocate(GLuint &bufferId, unsigned long newSize, const std::vector<BufferMove> &moves);
+
+    /**
+     * @brief Set up the vertex array object for the current buffers
+     */
+    void setUpVertexArray();
+
+    void ensureSpace(FreeList &space, GLuint &bufferId, unsigned long elementSize,
+                     unsigned long size, unsigned long &position);
+
+  public:
+
+    /**
+     * @brief Size of each vertex in the arena, in bytes
+     */
+    static const int VERTEX_STRIDE = Model::INTERLEAVED_MIN_STRIDE;
+
+    /**
+     * @brief Constructor (the buffers are created when the first model is added)
+     * @param stateCache The OpenGL state cache of the renderer using the arena
+     * @param vertexCapacity Initial capacity of the vertex buffer, in vertices
+     * @param indexCapacity Initial capacity of the index buffer, in vertex indexes
+     */
+    GeometryArena(GLStateCache &stateCache, unsigned long vertexCapacity = 65536, unsigned long indexCapacity = 196608);
+
+    /**
+     * @brief Destructor (the buffers have to be deleted with deleteBuffers while the OpenGL context exists)
+     */
+    ~GeometryArena() = default;
+
+    /**
+     * @brief Copy a model's geometry to the arena. The arena's buffers grow if there is not enough space.
+     * @param model The model
+     * @return A handle to the model's geometry in the arena
+     */
+    unsigned int add(const Model &model);
+
+    /**
+     * @brief Remove a model's geometry from the arena. When more than a quarter of the space before
+     * the end of the last allocation is free as a result, the arena is defragmented the next time
+     * it is bound or a model is added to it.
+     * @param handle The handle of the model's geometry
+     */
+    void remove(unsigned int handle);
+
+    /**
+     * @brief Get the position of a model's geometry in the arena. This may change when
+     * the arena is defragmented, so it should not be stored.
+     * @param handle The handle of the model's geometry
+     * @return The position of the geometry
+     */
+    const GeometryArenaAllocation& getAllocation(unsigned int handle) const;
+
+    /**
+     * @brief Move all geometry to the beginning of the buffers, so that all free space is at their ends.
+     */
+    void defragment();
+
+    /**
+     * @brief Bind the arena's vertex array object, for drawing (first defragmenting the arena, if
+     * necessary, which can change the positions of the models' geometry)
+     */
+    void bind();
+
+    /**
+     * @brief Delete the arena's buffers from the GPU, forgetting all models in it.
+     */
+    void deleteBuffers();
+
+    /**
+     * @brief Get the number of vertices that can be added before the vertex buffer has to grow
+     * @return The number of free vertices
+     */
+    unsigned long getFreeVertices() const;
+
+    /**
+     * @brief Get the number of vertex indexes that can be added before the index buffer has to grow
+     * @return The number of free vertex indexes
+     */
+    unsigned long getFreeIndices() const;
+
+  };
+
+}
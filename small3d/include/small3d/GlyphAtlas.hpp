@@ -0,0 +1,182 @@
+/*
+ *  GlyphAtlas.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <unordered_map>
+#include <functional>
+#include <vector>
+#include "Logger.hpp"
+#include "GLStateCache.hpp"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace small3d {
+
+  /**
+   * @class AtlasGlyph
+   * @brief A glyph that has been rendered into a GlyphAtlas. All values are in pixels.
+   */
+  class AtlasGlyph {
+  public:
+
+    /**
+     * @brief Position of the glyph's bitmap in the atlas (top left corner)
+     */
+    unsigned long x, y;
+
+    /**
+     * @brief Dimensions of the glyph's bitmap
+     */
+    unsigned long width, rows;
+
+    /**
+     * @brief Horizontal distance from the pen position to the left of the bitmap
+     */
+    int left;
+
+    /**
+     * @brief Vertical distance from the baseline to the top of the bitmap
+     */
+    int top;
+
+    /**
+     * @brief Horizontal distance to move the pen by, after the glyph
+     */
+    long advance;
+
+    /**
+     * @brief Empty space around the glyph included in its bitmap (used by signed distance
+     * field glyphs, whose fields extend beyond the outline). The width, rows, left and top
+     * values include it.
+     */
+    unsigned long padding;
+  };
+
+  /**
+   * @class GlyphAtlas
+   * @brief Cache of rendered font glyphs, packed into a single-channel texture.
+   * Each glyph is rasterised once per (face, size, character) and then reused by
+   * every string that contains it, so that text can be rendered with a single texture
+   * and a single draw call.
+   */
+  class GlyphAtlas {
+  private:
+
+    class GlyphKey {
+    public:
+      FT_Face face;
+      int fontSize;
+      unsigned long character;
+      bool signedDistanceField;
+
+      bool operator==(const GlyphKey &other) const {
+        return face == other.face && fontSize == other.fontSize && character == other.character &&
+          signedDistanceField == other.signedDistanceField;
+      }
+    };
+
+    class GlyphKeyHash {
+    public:
+      size_t operator()(const GlyphKey &key) const {
+        return std::hash<void*>()(key.face) ^ (std::hash<unsigned long>()(key.character) << 1) ^
+          (std::hash<int>()(key.fontSize) << 17) ^ (key.signedDistanceField ? 0x9e3779b9 : 0);
+      }
+    };
+
+    GLStateCache &stateCache;
+
+    unsigned long width, height, maxHeight;
+    unsigned long shelfX, shelfY, shelfHeight;
+    unsigned long dirtyTop, dirtyBottom;
+    unsigned long generation;
+
+    std::vector<unsigned char> pixels;
+    std::unordered_map<GlyphKey, AtlasGlyph, GlyphKeyHash> glyphs;
+
+    GLuint textureId;
+    unsigned long textureHeight;
+
+    /**
+     * @brief Find space for a glyph's bitmap, growing (or, as a last resort, resetting) the atlas if necessary.
+     */
+    void allocate(AtlasGlyph &glyph);
+
+    /**
+     * @brief Copy a glyph's bitmap to its position in the atlas
+     */
+    void store(const AtlasGlyph &glyph, const unsigned char *bitmap, unsigned long pitch);
+
+  public:
+
+    /**
+     * @brief Distance from a glyph's outline, in pixels, covered by its signed distance field
+     */
+    static const unsigned long SIGNED_DISTANCE_FIELD_SPREAD = 6;
+
+    /**
+     * @brief Constructor
+     * @param stateCache The OpenGL state cache of the renderer using the atlas
+     * @param width The width of the atlas, in pixels
+     * @param height The initial height of the atlas, in pixels. The atlas doubles its height when it
+     *               runs out of space, until it reaches maxHeight.
+     * @param maxHeight The maximum height of the atlas, in pixels. When this is reached, the atlas
+     *                  is reset and glyphs are rasterised again as they are requested.
+     */
+    GlyphAtlas(GLStateCache &stateCache, unsigned long width = 1024, unsigned long height = 256, unsigned long maxHeight = 4096);
+
+    /**
+     * @brief Destructor (the texture has to be deleted with deleteTexture while the OpenGL context exists)
+     */
+    ~GlyphAtlas() = default;
+
+    /**
+     * @brief Get a glyph, rasterising it and adding it to the atlas if it is not already there.
+     * @param face The font face (its character size must already have been set)
+     * @param fontSize The size the face has been set to
+     * @param character The character code
+     * @param signedDistanceField If true, store the glyph's signed distance field instead of
+     *                            its bitmap. The field's values are 0.5 on the outline, increasing
+     *                            towards the inside of the glyph, so it can be rendered sharply at
+     *                            any size.
+     * @return The glyph
+     */
+    AtlasGlyph getGlyph(FT_Face face, int fontSize, unsigned long character, bool signedDistanceField = false);
+
+    /**
+     * @brief Bind the atlas texture, first uploading any glyphs that have been added since the last time.
+     * @param isOpenGL33Supported Whether OpenGL 3.3 is being used (otherwise OpenGL 2.1 formats are used)
+     */
+    void bind(bool isOpenGL33Supported);
+
+    /**
+     * @brief Delete the atlas texture from the GPU and forget all glyphs.
+     */
+    void deleteTexture();
+
+    /**
+     * @brief Get the width of the atlas
+     * @return The width, in pixels
+     */
+    unsigned long getWidth() const;
+
+    /**
+     * @brief Get the height of the atlas
+     * @return The height, in pixels
+     */
+    unsigned long getHeight() const;
+
+    /**
+     * @brief Get the generation of the atlas. This changes every time the atlas gets reset,
+     * meaning that glyph positions retrieved before the change are no longer valid.
+     * @return The generation
+     */
+    unsigned long getGeneration() const;
+
+  };
+
+}
@@ -14,7 +14,7 @@
 #include "Logger.hpp"
 #include <png.h>
 
-#ifndef SMALL3D_GLFW
+#if !defined(SMALL3D_GLFW) && !defined(SMALL3D_HEADLESS)
 #include <SDL.h>
 #endif
 
@@ -46,7 +46,7 @@ namespace small3d {
      *                       to be found. If this is not set, it is assumed to be the directory
      *                       containing the application executable when using SDL, or the
      *                       directory from where the execution command is entered when 
-     *                       using GLFW.
+     *                       using GLFW or rendering headless.
      */
     Image(std::string fileLocation = "", std::string basePath = "");
 
@@ -0,0 +1,193 @@
+/*
+ *  MeshBVH.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Model.hpp"
+
+namespace small3d {
+
+  /**
+   * @class MeshRayHit
+   * @brief Where a ray hits the triangles of a model (see MeshBVH.castRay)
+   */
+  class MeshRayHit {
+  public:
+
+    /**
+     * @brief The index of the triangle hit (its position in the model's index data, divided by 3),
+     * or -1 if no triangle has been hit
+     */
+    int triangleIndex;
+
+    /**
+     * @brief The distance from the origin of the ray to the point where it hits the triangle
+     */
+    float distance;
+
+    /**
+     * @brief The normal of the triangle hit, in world space (following the winding of its vertices)
+     */
+    glm::vec3 normal;
+  };
+
+  /**
+   * @class MeshBVH
+   * @brief A bounding volume hierarchy over the triangles of a model, for collision queries
+   * against the actual geometry of objects, such as terrain and ramps, for which bounding boxes
+   * are too coarse. It is built by splitting the triangles where the surface area heuristic,
+   * evaluated on a number of bins along each axis, estimates the cost of queries to be lowest.
+   * Since this takes a while for large models, the hierarchy can be saved to a file and loaded
+   * from it on later runs.
+   *
+   * The queries can be made in the space of the model or, by passing its transformation, in
+   * world space. The transformation can only rotate and move the model (not scale it).
+   */
+  class MeshBVH {
+  private:
+
+    /**
+     * @brief A node of the hierarchy. Its first child follows it and it is a leaf if it
+     * contains triangles.
+     */
+    class Node {
+    public:
+      glm::vec3 minCoords, maxCoords;
+      int secondChild;
+      int firstTriangle;
+      int numTriangles;
+    };
+
+    static const int LEAF_SIZE = 4;
+    static const int MAX_DEPTH = 64;
+    static const int NUM_BINS = 16;
+    static const uint32_t FILE_VERSION = 1;
+
+    std::vector<Node> nodes;
+
+    // The vertices of the triangles (three per triangle), in the order in which the triangles
+    // appear in the leaves
+    std::vector<glm::vec3> triangleVertices;
+
+    // The index of each triangle in the model, in the same order
+    std::vector<int> triangleIndices;
+
+    // Hash of the geometry the hierarchy has been built from, so that saved hierarchies
+    // that no longer match their model are not loaded
+    uint64_t modelHash;
+
+    static uint64_t hashModel(const Model &model);
+
+    /**
+     * @brief Add a node for some of the triangles, and its children, to the hierarchy
+     * @param firstTriangle The position of the node's first triangle in the order of the leaves
+     * @param numTriangles The number of triangles in the node
+     * @param depth The depth of the node
+     * @param minCoords The minimum coordinates of each triangle
+     * @param maxCoords The maximum coordinates of each triangle
+     * @param order The triangles, in the order of the leaves
+     */
+    void buildNode(int firstTriangle, int numTriangles, int depth, const std::vector<glm::vec3> &minCoords,
+                   const std::vector<glm::vec3> &maxCoords, std::vector<int> &order);
+
+  public:
+
+    /**
+     * @brief Constructor, for a hierarchy to be built or loaded later
+     */
+    MeshBVH();
+
+    /**
+     * @brief Constructor, building the hierarchy for a model, or loading it if it has been
+     *        saved before for the same geometry
+     * @param model     The model
+     * @param cacheFile The file the hierarchy is loaded from, if it exists and has been built
+     *                  from the same geometry. Otherwise, the hierarchy is built and saved to it.
+     *                  If this is not set, the hierarchy is always built and not saved.
+     */
+    MeshBVH(const Model &model, const std::string &cacheFile = "");
+
+    /**
+     * @brief Destructor
+     */
+    ~MeshBVH() = default;
+
+    /**
+     * @brief Build the hierarchy for a model
+     * @param model The model
+     */
+    void build(const Model &model);
+
+    /**
+     * @brief Save the hierarchy to a file
+     * @param path The path of the file
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * @brief Load the hierarchy from a file
+     * @param path  The path of the file
+     * @param model The model the hierarchy is for
+     * @return True if the hierarchy has been loaded, false if the file does not exist, cannot be
+     *         read, or has been saved for different geometry (the hierarchy is then left as it was)
+     */
+    bool load(const std::string &path, const Model &model);
+
+    /**
+     * @brief Get the number of triangles in the hierarchy
+     * @return The number of triangles
+     */
+    int getNumTriangles() const;
+
+    /**
+     * @brief Get the number of nodes in the hierarchy
+     * @return The number of nodes
+     */
+    int getNumNodes() const;
+
+    /**
+     * @brief Find the first triangle hit by a ray. Triangles are hit from either side.
+     * @param origin         The origin of the ray
+     * @param direction      The direction of the ray (it does not need to be normalised)
+     * @param hit            The triangle hit first, the distance to it and its normal
+     * @param maxDistance    How far along the ray to look
+     * @param transformation The transformation of the model (identity if the ray is in
+     *                       the space of the model)
+     * @return True if a triangle has been hit, false if not.
+     */
+    bool castRay(const glm::vec3 &origin, const glm::vec3 &direction, MeshRayHit &hit,
+                 float maxDistance = std::numeric_limits<float>::max(),
+                 const glm::mat4x4 &transformation = glm::mat4x4(1.0f)) const;
+
+    /**
+     * @brief Check if any of the triangles is inside or touches a sphere
+     * @param centre         The centre of the sphere
+     * @param radius         The radius of the sphere
+     * @param transformation The transformation of the model (see castRay)
+     * @return True if a triangle intersects the sphere, false if not.
+     */
+    bool intersectsSphere(const glm::vec3 &centre, float radius,
+                          const glm::mat4x4 &transformation = glm::mat4x4(1.0f)) const;
+
+    /**
+     * @brief Check if any of the triangles is inside or touches a box, which is aligned with
+     *        the axes of the world (of the model, if the transformation is not set)
+     * @param minCoords      The minimum coordinates of the box
+     * @param maxCoords      The maximum coordinates of the box
+     * @param transformation The transformation of the model (see castRay)
+     * @return True if a triangle intersects the box, false if not.
+     */
+    bool intersectsBox(const glm::vec3 &minCoords, const glm::vec3 &maxCoords,
+                       const glm::mat4x4 &transformation = glm::mat4x4(1.0f)) const;
+
+  };
+
+}
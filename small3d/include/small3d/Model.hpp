@@ -76,12 +76,61 @@ namespace small3d {
 
     int textureCoordsDataSize;
 
+    /**
+     * @brief The vertex positions, normals and texture coordinates, interleaved (see interleave).
+     * For each vertex, the x, y, z, w position values are at the beginning of its stride, followed by
+     * the x, y, z values of its normal (at INTERLEAVED_NORMAL_OFFSET bytes) and the u, v texture
+     * coordinates (at INTERLEAVED_UV_OFFSET bytes).
+     */
+
+    std::vector<float> interleavedData;
+
+    /**
+     * @brief Size of the interleaved data, in bytes.
+     */
+
+    int interleavedDataSize;
+
+    /**
+     * @brief Distance between the beginning of each vertex and the next in the interleaved data,
+     * in bytes (0 if the data has not been interleaved).
+     */
+
+    int interleavedStride;
+
+    /**
+     * @brief Offset of the normal in each vertex of the interleaved data, in bytes
+     */
+
+    static const int INTERLEAVED_NORMAL_OFFSET = 4 * sizeof(float);
+
+    /**
+     * @brief Offset of the texture coordinates in each vertex of the interleaved data, in bytes
+     */
+
+    static const int INTERLEAVED_UV_OFFSET = 7 * sizeof(float);
+
+    /**
+     * @brief Minimum stride of the interleaved data, in bytes
+     */
+
+    static const int INTERLEAVED_MIN_STRIDE = 9 * sizeof(float);
+
     /**
      * @brief Default constructor
      */
 
     Model();
 
+    /**
+     * @brief Build the interleaved data from the vertex, normals and texture coordinates data,
+     * so that the model can be rendered from a single buffer.
+     * @param stride The distance between the beginning of each vertex and the next, in bytes. It
+     *               has to be a multiple of 4, at least INTERLEAVED_MIN_STRIDE. Any space beyond
+     *               the vertex attributes is filled with zeros (useful for alignment).
+     */
+    void interleave(int stride = INTERLEAVED_MIN_STRIDE);
+
 
     /**
      * Destructor
@@ -0,0 +1,270 @@
+/*
+ *  Profiler.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+
+namespace small3d {
+
+  /**
+   * @class ProfilerSection
+   * @brief The time spent in a section of a frame (see Profiler)
+   */
+  class ProfilerSection {
+  public:
+
+    /**
+     * @brief The path of the section, consisting of the names of the sections it is nested in
+     * and its own name, separated by slashes (for example "shadows/scene")
+     */
+    std::string path;
+
+    /**
+     * @brief How deeply the section is nested (0 for a section that is not nested)
+     */
+    int depth;
+
+    /**
+     * @brief How many times the section was entered during the frame
+     */
+    unsigned long calls;
+
+    /**
+     * @brief Total time spent in the section on the CPU, in milliseconds
+     */
+    double cpuMilliseconds;
+
+    /**
+     * @brief Total time spent in the section on the GPU, in milliseconds (0 if GPU timing
+     * is not available)
+     */
+    double gpuMilliseconds;
+  };
+
+  /**
+   * @class ProfilerFrame
+   * @brief The time spent rendering a frame and in each of its sections (see Profiler)
+   */
+  class ProfilerFrame {
+  public:
+
+    /**
+     * @brief The number of the frame, counting from when profiling was enabled
+     */
+    unsigned long number;
+
+    /**
+     * @brief Time between the start and the end of the frame on the CPU, in milliseconds
+     */
+    double cpuMilliseconds;
+
+    /**
+     * @brief Time between the start and the end of the frame on the GPU's clock, in
+     * milliseconds, including any time the GPU was idle
+     */
+    double gpuMilliseconds;
+
+    /**
+     * @brief Whether the frame has been timed on the GPU as well
+     */
+    bool gpuTimed;
+
+    /**
+     * @brief The sections of the frame, in the order in which they were first entered
+     */
+    std::vector<ProfilerSection> sections;
+  };
+
+  /**
+   * @class Profiler
+   * @brief Measures how long the sections of each frame take, on the CPU and on the GPU.
+   * A section is timed on the GPU with a timestamp query at its beginning and one at its end.
+   * Sections can be nested (which is why timestamps are used rather than time elapsed queries,
+   * which cannot). So as not to stall rendering, the results of the queries are only read
+   * back FRAME_LATENCY frames later. GPU timing requires OpenGL 3.3 or GL_ARB_timer_query.
+   */
+  class Profiler {
+  private:
+
+    class Section {
+    public:
+      std::string name;
+      std::string path;
+      int parent;
+      int depth;
+      std::vector<unsigned int> children;
+    };
+
+    class OpenSection {
+    public:
+      size_t timing;
+      std::chrono::steady_clock::time_point cpuStart;
+    };
+
+    class Timing {
+    public:
+      unsigned int section;
+      unsigned int beginQuery;
+      unsigned int endQuery;
+      double cpuMilliseconds;
+    };
+
+    /**
+     * @brief A frame whose queries have not been read back yet. The first two queries mark
+     * the start and the end of the frame.
+     */
+    class PendingFrame {
+    public:
+      unsigned long number;
+      bool pending;
+      std::vector<GLuint> queries;
+      unsigned int usedQueries;
+      std::vector<Timing> timings;
+      double cpuMilliseconds;
+    };
+
+    bool enabled;
+    bool gpuTiming;
+    unsigned long frameNumber;
+    unsigned long historySize;
+
+    std::vector<Section> sections;
+    std::vector<OpenSection> openSections;
+    std::vector<PendingFrame> pendingFrames;
+    unsigned int currentFrame;
+    std::chrono::steady_clock::time_point frameStart;
+
+    std::deque<ProfilerFrame> history;
+    std::vector<int> sectionPositions;
+    std::vector<GLuint64> timestamps;
+
+    unsigned int getSection(int parent, const std::string &name);
+    unsigned int recordTimestamp();
+    void startFrame();
+    void readBack(PendingFrame &frame);
+
+  public:
+
+    /**
+     * @brief Number of frames after which the GPU times of a frame are read back
+     */
+    static const unsigned int FRAME_LATENCY = 3;
+
+    /**
+     * @brief Constructor (profiling is disabled until setEnabled is called)
+     */
+    Profiler();
+
+    /**
+     * @brief Destructor (the queries have to be deleted with deleteQueries while the OpenGL context exists)
+     */
+    ~Profiler() = default;
+
+    /**
+     * @brief Enable or disable profiling. Enabling it starts a new frame and clears the
+     * frames recorded so far.
+     * @param enabled True to enable profiling, false to disable it
+     * @param gpuTiming Whether to time sections on the GPU as well (requires timer queries)
+     */
+    void setEnabled(bool enabled, bool gpuTiming);
+
+    /**
+     * @brief Is profiling enabled?
+     * @return True if profiling is enabled, false otherwise
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Set how many frames are kept (see getFrames)
+     * @param historySize The number of frames (120 by default)
+     */
+    void setHistorySize(unsigned long historySize);
+
+    /**
+     * @brief Enter a section. Sections can be nested, and a section entered many times
+     * in a frame is reported once, with its times added up.
+     * @param name The name of the section (it should not contain slashes)
+     * @return True if the section has been entered, false if profiling is disabled
+     */
+    bool begin(const std::string &name);
+
+    /**
+     * @brief Leave the section entered last
+     */
+    void end();
+
+    /**
+     * @brief End the frame and start the next one. If a section has not been left, it is closed
+     * and an exception is thrown once the frame has ended.
+     */
+    void endFrame();
+
+    /**
+     * @brief Get the frames whose times have been read back, oldest first
+     * @return The frames
+     */
+    const std::deque<ProfilerFrame>& getFrames() const;
+
+    /**
+     * @brief Get the average times of the frames that have been read back
+     * @return A frame with the average frame time and the average time of each section per frame
+     *         (number is set to the number of frames averaged)
+     */
+    ProfilerFrame getAverage() const;
+
+    /**
+     * @brief Write the frames that have been read back to a CSV file, with a line for the
+     * frame as a whole (section "frame") and one for each of its sections
+     * @param path The path of the file
+     */
+    void exportCsv(const std::string &path) const;
+
+    /**
+     * @brief Write the frames that have been read back to a JSON file, as an array of frames
+     * @param path The path of the file
+     */
+    void exportJson(const std::string &path) const;
+
+    /**
+     * @brief Delete the queries from the GPU, disabling profiling.
+     */
+    void deleteQueries();
+
+  };
+
+  /**
+   * @class ProfilerScope
+   * @brief Enters a profiler section when constructed and leaves it when destroyed
+   */
+  class ProfilerScope {
+  private:
+    Profiler &profiler;
+    bool entered;
+
+  public:
+
+    /**
+     * @brief Constructor
+     * @param profiler The profiler
+     * @param name The name of the section
+     */
+    ProfilerScope(Profiler &profiler, const std::string &name);
+
+    /**
+     * @brief Destructor
+     */
+    ~ProfilerScope();
+
+    ProfilerScope(const ProfilerScope&) = delete;
+    ProfilerScope& operator=(const ProfilerScope&) = delete;
+  };
+
+}
@@ -14,6 +14,8 @@
 
 #ifdef SMALL3D_GLFW
 #include <GLFW/glfw3.h>
+#elif defined(SMALL3D_HEADLESS)
+#include <EGL/egl.h>
 #else
 #include <SDL_opengl.h>
 #include <SDL.h>
@@ -21,8 +23,17 @@
 
 #include "SceneObject.hpp"
 #include "Logger.hpp"
+#include "GLStateCache.hpp"
+#include "GlyphAtlas.hpp"
+#include "GeometryArena.hpp"
+#include "FrameCapture.hpp"
+#include "Profiler.hpp"
+#include "RetainedText.hpp"
 #include <unordered_map>
 #include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <glm/glm.hpp>
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -30,6 +41,40 @@
 namespace small3d
 {
 
+  /**
+   * @brief Ways of checking for OpenGL errors (see Renderer.setOpenGLErrorChecking)
+   */
+
+  enum OpenGLErrorChecking {
+    noerrorchecking, errorcheckingperframe, errorcheckingpercall, errorcheckingcallback
+  };
+
+  /**
+   * @class OpenGLDebugMessages
+   * @brief Messages reported by OpenGL through GL_KHR_debug (see Renderer.setOpenGLErrorChecking).
+   * The driver may report them from any of its threads, so they are queued and only logged
+   * later, on the rendering thread.
+   */
+  class OpenGLDebugMessages {
+  private:
+    std::mutex mutex;
+    std::vector<std::pair<bool, std::string> > messages;
+
+  public:
+
+    /**
+     * @brief Queue a message (can be called from any thread)
+     * @param error True if the message reports an error, false if it is only a warning or information
+     * @param message The message
+     */
+    void add(bool error, const std::string &message);
+
+    /**
+     * @brief Log the queued messages, removing them from the queue
+     */
+    void log();
+  };
+
   /**
    * @class Renderer
    * @brief Renderer class, which can render using either OpenGL v3.3 or v2.1
@@ -41,9 +86,23 @@ namespace small3d
   private:
 
     std::string basePath;
+
+    /**
+     * @brief All OpenGL state changes of the renderer go through this, so that the ones
+     * that would not change anything are skipped
+     */
+    GLStateCache stateCache;
     
 #ifdef SMALL3D_GLFW
     GLFWwindow* window;
+#elif defined(SMALL3D_HEADLESS)
+    EGLDisplay eglDisplay;
+    EGLContext eglContext;
+    EGLSurface eglSurface;
+
+    GLuint headlessFramebufferId;
+    GLuint headlessColourRenderbufferId;
+    GLuint headlessDepthRenderbufferId;
 #else
     SDL_Window* window;
 #endif
@@ -52,8 +111,49 @@ namespace small3d
 
     GLuint orthographicProgram;
 
+    GLuint textProgram;
+
+    GLuint signedDistanceFieldTextProgram;
+
+    bool signedDistanceFieldText;
+
     bool isOpenGL33Supported;
 
+    bool isOpenGL43Supported;
+
+    GLuint multiDrawProgram;
+
+    /**
+     * @brief Shader storage buffer holding the transformation and colour of each object
+     * rendered with multi-draw indirect
+     */
+    GLuint multiDrawObjectBufferObjectId;
+
+    GLuint multiDrawIndirectBufferObjectId;
+
+    /**
+     * @brief Buffer holding the numbers 0, 1, 2..., used as a per instance vertex attribute, so
+     * that the shader can find each object's data from the base instance of its draw command
+     */
+    GLuint multiDrawObjectIndexBufferObjectId;
+
+    unsigned long multiDrawObjectIndexCapacity;
+
+    /**
+     * @brief Uniform buffer holding the camera and lighting (the std140 FrameData block of the
+     * OpenGL 3.3 and 4.3 shaders), shared by the perspective programs
+     */
+    GLuint frameDataBufferObjectId;
+
+    /**
+     * @brief The camera and lighting currently in the frame data buffer
+     */
+    glm::vec3 frameDataCameraPosition, frameDataCameraRotation, frameDataLightDirection;
+
+    float frameDataLightIntensity;
+
+    bool frameDataUpToDate;
+
     bool noShaders;
 
     float frustumScale;
@@ -70,6 +170,62 @@ namespace small3d
     
     std::unordered_map<std::string, FT_Face> fontFaces;
 
+    GlyphAtlas glyphAtlas;
+
+    GLuint textVaoId;
+
+    GLuint textVertexBufferObjectId;
+
+    GLuint textIndexBufferObjectId;
+
+    unsigned long textIndexBufferCapacity;
+
+    std::unordered_map<unsigned int, RetainedText> retainedTexts;
+
+    /**
+     * @brief Handles of the retained texts that have geometry on the GPU, most recently used first
+     */
+    std::list<unsigned int> retainedTextUsage;
+
+    unsigned long retainedTextMemory;
+
+    unsigned long retainedTextMemoryLimit;
+
+    unsigned int nextTextHandle;
+
+    /**
+     * @brief Bounding box vertices (in world space) to be drawn at the end of the frame
+     */
+    std::vector<float> boundingBoxVertices;
+
+    /**
+     * @brief Bounding box vertex indexes to be drawn at the end of the frame
+     */
+    std::vector<unsigned int> boundingBoxIndexes;
+
+    GLuint boundingBoxVaoId;
+
+    GLuint boundingBoxVertexBufferObjectId;
+
+    GLuint boundingBoxIndexBufferObjectId;
+
+    unsigned long boundingBoxVertexBufferSize;
+
+    unsigned long boundingBoxIndexBufferSize;
+
+    GeometryArena geometryArena;
+
+    std::unique_ptr<FrameCapture> frameCapture;
+
+    Profiler profiler;
+
+    bool profilerOverlay;
+
+    /**
+     * @brief Write the times of the last frame read back by the profiler on the screen
+     */
+    void renderProfilerOverlay();
+
     /**
      * @brief Load a shader's source code from a file into a string
      * @param fileLocation The file's location, relative to the game path
@@ -77,13 +233,55 @@ namespace small3d
      */
     std::string loadShaderFromFile(const std::string &fileLocation);
 
+    std::string shadersPath;
+
+    /**
+     * @brief Get a shader's source code, from the shaders path if it is set and the shader is
+     * found there, otherwise from the shaders embedded in the library
+     * @param shaderPath The path of the shader, relative to the shaders path (for example
+     *                   "OpenGL33/textShader.vert")
+     * @return String containing the shader's source code (empty if it has not been found)
+     */
+    std::string loadShader(const std::string &shaderPath);
+
     /**
      * @brief Compile a shader's source code
      * @param shaderSource String containing the shader's source code
      * @param shaderType Type of shader (GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER - the latter for OpenGL 3.3)
+     * @param shaderName Name of the shader, used in log messages (normally the path of its source file)
      * @return OpenGL shader reference
      */
-    GLuint compileShader(const std::string &shaderSource, const GLenum shaderType);
+    GLuint compileShader(const std::string &shaderSource, const GLenum shaderType, const std::string &shaderName);
+
+    std::string programCachePath;
+
+    bool useProgramCache;
+
+    /**
+     * @brief Get the path of the file in which a program is cached. Its name is a hash of the
+     * program's shader sources and of the OpenGL vendor, renderer and version, so a program that
+     * has been cached is never used after any of these change.
+     * @param vertexShaderSource The source code of the program's vertex shader
+     * @param fragmentShaderSource The source code of the program's fragment shader
+     * @return The path of the file
+     */
+    std::string getProgramCacheFile(const std::string &vertexShaderSource,
+                                    const std::string &fragmentShaderSource) const;
+
+    /**
+     * @brief Create a program from its binary, as stored in the program cache
+     * @param cacheFile The file containing the binary
+     * @return OpenGL program reference, or 0 if the file does not exist or the binary is not
+     *         accepted by the driver
+     */
+    GLuint loadProgramBinary(const std::string &cacheFile);
+
+    /**
+     * @brief Store the binary of a linked program in the program cache
+     * @param program OpenGL program reference
+     * @param cacheFile The file to store the binary in
+     */
+    void saveProgramBinary(GLuint program, const std::string &cacheFile);
 
     /**
      * @brief Retrieve the information of what went wrong when linking a shader program
@@ -95,6 +293,15 @@ namespace small3d
      */
     std::string getShaderInfoLog(const GLuint shader) const;
 
+    /**
+     * @brief Compile a vertex and a fragment shader and link them into a program (or load the
+     * linked program from the program cache, if it has been cached)
+     * @param vertexShaderPath Path to the vertex shader's source code, relative to the shaders path
+     * @param fragmentShaderPath Path to the fragment shader's source code, relative to the shaders path
+     * @return OpenGL program reference
+     */
+    GLuint createProgram(const std::string &vertexShaderPath, const std::string &fragmentShaderPath);
+
     /**
     * @brief Initialise renderer (OpenGL, GLEW, etc)
     */
@@ -104,10 +311,19 @@ namespace small3d
               std::string shadersPath);
 
     /**
-     * @brief Initialise the application window
+     * @brief Initialise the application window (or, when rendering headless, the EGL display and context)
      */
     void initWindow(int &width, int &height, const std::string &windowTitle = "");
 
+#ifdef SMALL3D_HEADLESS
+    /**
+     * @brief Create the framebuffer object that is rendered to instead of a window when rendering headless
+     * @param width The width of the framebuffer, in pixels
+     * @param height The height of the framebuffer, in pixels
+     */
+    void createHeadlessFramebuffer(int width, int height);
+#endif
+
     /**
      * @brief Detect if OpenGL 3.3 is supported. If not, fall back to OpenGL 2.1.
      * If neither of the two is supported, an exception is raised.
@@ -116,6 +332,21 @@ namespace small3d
 
     void checkForOpenGLErrors(std::string when, bool abort);
 
+    OpenGLErrorChecking errorChecking;
+
+    /**
+     * @brief Messages reported by the driver when errors are checked for with errorcheckingcallback,
+     * logged once per frame, in swapBuffers
+     */
+    OpenGLDebugMessages debugMessages;
+
+    /**
+     * @brief Check for OpenGL errors after a rendering operation, if errors are to be checked
+     * after each call (see setOpenGLErrorChecking). An exception is thrown if there are any.
+     * @param when Description of the operation
+     */
+    void checkForRenderingErrors(const std::string &when);
+
     /**
      * @brief Textures used in the scene, each corresponding to the name of one of
      * the rendered models
@@ -133,9 +364,27 @@ namespace small3d
 
     /**
      * @brief Position the camera (Calculates offset and rotation matrices and sends them to OpenGL).
+     * @param program The program whose uniforms will be set
+     */
+
+    void positionCamera(GLuint program);
+
+    /**
+     * @brief Set the camera and lighting for a perspective program. With OpenGL 3.3, these are
+     * kept in a uniform buffer shared by all perspective programs, which is only updated when
+     * the camera or the lighting have changed (normally once per frame at most). With OpenGL 2.1,
+     * the program's uniforms are set.
+     * @param program The program
      */
+    void setFrameUniforms(GLuint program);
 
-    void positionCamera();
+    /**
+     * @brief Create the uniform buffer holding the camera and lighting and bind a program's
+     * FrameData block to it
+     * @param program The program
+     * @param perspectiveMatrix The perspective matrix (column-major)
+     */
+    void bindFrameData(GLuint program, const float *perspectiveMatrix);
 
     /**
      * @brief Get the handle of a texture which has already been generated (see generateTexture)
@@ -145,17 +394,101 @@ namespace small3d
     GLuint getTextureHandle(std::string name);
 
     /**
-     * Render the bounding box set of an object. Useful for debugging collisions.
+     * Queue the bounding box set of an object for rendering (see renderBoundingBoxes).
+     * Useful for debugging collisions.
      * @param boundingBoxSet The bounding box set
+     * @param offset The offset of the object
+     * @param rotation The rotation of the object
+     * @param rotationAdjustment The rotation adjustment of the object
      */
     void render(const BoundingBoxSet &boundingBoxSet, const glm::vec3 &offset,
                 const glm::vec3 &rotation, const glm::mat4x4 &rotationAdjustment);
 
+    /**
+     * @brief Render all bounding boxes that have been queued since the last time, with a
+     * single draw call.
+     */
+    void renderBoundingBoxes();
+
+    /**
+     * @brief Get a font face, loading it if this has not been done before
+     * @param fontSize The size of the font
+     * @param fontPath Path to the TrueType font (.ttf)
+     * @return The font face, set to the given size
+     */
+    FT_Face getFontFace(int fontSize, const std::string &fontPath);
+
+    /**
+     * @brief Lay out some text as one quad per glyph, taking the glyphs from the glyph atlas.
+     * Each vertex consists of its position in the text rectangle (x and y, from 0 to 1) and
+     * its texture coordinates in the atlas (u and v, in pixels).
+     * @param text The text
+     * @param fontSize The size of the font
+     * @param fontPath Path to the TrueType font (.ttf)
+     * @param signedDistanceField If true, use signed distance field glyphs, all rasterised at
+     *                            the same size (fontSize is ignored)
+     * @param vertices The vector the vertices will be written to (4 per glyph)
+     * @return The number of glyph quads
+     */
+    unsigned long layoutText(const std::string &text, int fontSize, const std::string &fontPath,
+                             bool signedDistanceField, std::vector<float> &vertices);
+
+    /**
+     * @brief Make sure that the text index buffer contains indexes for at least the given
+     * number of glyph quads and bind it.
+     * @param numGlyphs The number of glyph quads
+     */
+    void bindTextIndexBuffer(unsigned long numGlyphs);
+
+    /**
+     * @brief Set up the text vertex attributes, for the currently bound vertex buffer
+     */
+    void setTextVertexAttributes();
+
+    /**
+     * @brief Draw glyph quads that have been set up in the currently bound vertex buffer
+     * @param program The text rendering program in use
+     * @param numGlyphs The number of glyph quads
+     * @param colour The colour of the text
+     * @param bottomLeft The coordinates of the bottom left corner of the text rectangle (x, y)
+     * @param topRight The coordinates of the top right corner of the text rectangle (x, y)
+     */
+    void drawText(GLuint program, unsigned long numGlyphs, const glm::vec3 &colour,
+                  const glm::vec2 &bottomLeft, const glm::vec2 &topRight);
+
+    /**
+     * @brief Get a retained text
+     * @param handle The handle of the text
+     * @return The retained text
+     */
+    RetainedText& getRetainedText(unsigned int handle);
+
+    /**
+     * @brief (Re)build the GPU geometry of a retained text
+     * @param handle The handle of the text
+     * @param retainedText The retained text
+     */
+    void buildRetainedText(unsigned int handle, RetainedText &retainedText);
+
+    /**
+     * @brief Delete the GPU geometry of a retained text. The text itself is kept, and its geometry
+     * will be rebuilt the next time it is rendered.
+     * @param retainedText The retained text
+     */
+    void releaseRetainedText(RetainedText &retainedText);
+
+    /**
+     * @brief Release the geometry of the least recently used retained texts until their memory
+     * fits within the limit (see setRetainedTextMemoryLimit)
+     * @param keepHandle Handle of a text that is not to be released
+     */
+    void enforceRetainedTextMemoryLimit(unsigned int keepHandle);
+
   public:
 
 #ifdef SMALL3D_GLFW
     GLFWwindow* getWindow();
-#else
+#elif !defined(SMALL3D_HEADLESS)
     SDL_Window* getWindow();
 #endif
 
@@ -187,30 +520,45 @@ namespace small3d
      * @brief Constructor
      * @param windowTitle The title of the game's window
      * @param width The width of the window. If width and height are not set, or set to 0, the game will run in full screen mode.
+     *              When rendering headless (SMALL3D_HEADLESS, for machines without a display), no window is
+     *              created. Frames are rendered to an offscreen framebuffer of this size instead, which
+     *              can be read with readFrame, and width and height must be set.
      * @param height The height of the window
      * @param frustumScale	How much the frustum scales the items rendered
      * @param zNear		Projection plane z coordinate (use positive value)
      * @param zFar		Far end of frustum z coordinate (use positive value)
      * @param zOffsetFromCamera	The position of the projection plane with regard to the camera.
      * @param shadersPath	The path where the shaders will be stored, relative
-     * 				to the application's executing directory. It
-     * 				defaults to the path provided by the engine, but
-     * 				it can be changed, so as to accommodate for executables
-     * 				which are going to be using it. Even though the path to
+     * 				to the application's executing directory. By default,
+     * 				this is not set and the shaders provided by the engine,
+     * 				which are compiled into the library, are used. If it is
+     * 				set, shaders found there are used instead (the others are
+     * 				still taken from the library), so that they can be changed
+     * 				without rebuilding. Even though the path to
      * 				the folder can be changed, the folder structure within
-     * 				it and the names of the shaders must remain as provided.
+     * 				it and the names of the shaders must remain as provided
+     * 				(e.g. "resources/shaders/", containing OpenGL33/textShader.vert).
      * 				The shader code can be changed, provided that their inputs
-     * 				and outputs are maintained the same.
+     * 				and outputs are maintained the same. If the library has been
+     * 				built without embedded shaders (SMALL3D_EMBEDDED_SHADERS), this
+     * 				defaults to "resources/shaders/".
      * @param basePath          The path under which all accessed files and directories are
      *                          to be found. If this is not set, it is assumed to be the directory
      *                          containing the application executable when using SDL, or the
      *                          directory from where the execution command is entered when 
-     *                          using GLFW.
+     *                          using GLFW or rendering headless.
+     * @param programCachePath  A directory (relative to the base path, ending with a slash) in which
+     *                          linked shader programs are to be cached, so that they do not have to
+     *                          be compiled every time the application starts. The directory has to
+     *                          exist. Cached programs are replaced automatically when the shaders or
+     *                          the graphics driver change. If this is not set, programs are not cached.
+     *                          Caching requires OpenGL 4.1 or GL_ARB_get_program_binary.
      */
     Renderer(std::string windowTitle = "", int width = 0, int height = 0,
              float frustumScale = 1.0f, float zNear = 1.0f,
              float zFar = 24.0f, float zOffsetFromCamera = -1.0f,
-             std::string shadersPath = "resources/shaders/", std::string basePath = "");
+             std::string shadersPath = "", std::string basePath = "",
+             std::string programCachePath = "");
 
     /**
      * @brief Destructor
@@ -266,13 +614,27 @@ namespace small3d
     /**
      * @brief Render a scene object
      * @param sceneObject The scene object
-     * @param showBoundingBoxes If true, also render the bounding boxes, otherwise don't (default)
+     * @param showBoundingBoxes If true, also render the bounding boxes, otherwise don't (default).
+     *                          The bounding boxes of all objects are drawn together, with a single
+     *                          draw call, when the buffers are swapped.
      */
     void render(SceneObject &sceneObject, bool showBoundingBoxes = false);
 
     /**
-     * @brief Render some text on the screen. A texture will be generated, containing the given
-     * text and it will be rendered at a depth z of 0.5 in an orthographic coordinate space.
+     * @brief Render many scene objects. With OpenGL 4.3 or later, the objects that are in the geometry
+     * arena (see addToGeometryArena) are rendered together, with one multi-draw indirect call per
+     * texture, their positions and colours being read by the shaders from a shared buffer. All other
+     * objects, or all objects if OpenGL 4.3 is not available, are rendered one by one, as with
+     * render(SceneObject&).
+     * @param sceneObjects The scene objects
+     * @param showBoundingBoxes If true, also render the bounding boxes, otherwise don't (default).
+     */
+    void render(const std::vector<SceneObject*> &sceneObjects, bool showBoundingBoxes = false);
+
+    /**
+     * @brief Render some text on the screen. The glyphs are taken from a texture atlas, where they are
+     * rasterised the first time they are used, and the text is drawn with a single draw call, at a
+     * depth z of 0.5 in an orthographic coordinate space.
      * @param text The text to be rendered
      * @param colour The colour in which the text will be rendered (r, g, b)
      * @param bottomLeft The coordinates of the bottom left corner of the text rectangle (x, y)
@@ -284,7 +646,163 @@ namespace small3d
                 std::string fontPath = "resources/fonts/CrusoeText/CrusoeText-Regular.ttf");
 
     /**
-     * @brief Clear a scene object from the GPU buffers (the object itself remains intact)
+     * @brief Create some text that is to be rendered repeatedly (for example labels, scores or
+     * menu entries). The text is laid out and its geometry is uploaded to the GPU once, and it is
+     * only rebuilt if the text, size or font are changed (see updateText).
+     * @param text The text
+     * @param colour The colour in which the text will be rendered (r, g, b)
+     * @param fontSize The size of the font which will be used
+     * @param fontPath Path to the TrueType font (.ttf) which will be used
+     * @return A handle to the text, to be used with renderText, updateText and deleteText
+     */
+    unsigned int createText(std::string text, glm::vec3 colour, int fontSize = 48,
+                            std::string fontPath = "resources/fonts/CrusoeText/CrusoeText-Regular.ttf");
+
+    /**
+     * @brief Change some text created with createText. Nothing gets rebuilt if the text, size and
+     * font remain the same, and changing the colour alone never causes a rebuild.
+     * @param handle The handle of the text
+     * @param text The text
+     * @param colour The colour in which the text will be rendered (r, g, b)
+     * @param fontSize The size of the font which will be used
+     * @param fontPath Path to the TrueType font (.ttf) which will be used
+     */
+    void updateText(unsigned int handle, std::string text, glm::vec3 colour, int fontSize = 48,
+                    std::string fontPath = "resources/fonts/CrusoeText/CrusoeText-Regular.ttf");
+
+    /**
+     * @brief Render some text created with createText, at a depth z of 0.5 in an orthographic
+     * coordinate space.
+     * @param handle The handle of the text
+     * @param bottomLeft The coordinates of the bottom left corner of the text rectangle (x, y)
+     * @param topRight The coordinates of the top right corner of the text rectangle (x, y)
+     */
+    void renderText(unsigned int handle, glm::vec2 bottomLeft, glm::vec2 topRight);
+
+    /**
+     * @brief Delete some text created with createText
+     * @param handle The handle of the text
+     */
+    void deleteText(unsigned int handle);
+
+    /**
+     * @brief Render text from signed distance fields rather than from bitmaps. The glyphs are
+     * then rasterised once, at a single size, and remain sharp at whatever size the text is
+     * rendered, so the fontSize parameters of write, createText and updateText are ignored
+     * and changing the size of the text rectangle costs nothing.
+     * @param signedDistanceFieldText True to use signed distance fields, false to use bitmaps (default)
+     */
+    void setSignedDistanceFieldText(bool signedDistanceFieldText);
+
+    /**
+     * @brief Set how OpenGL errors are checked for. Checking for errors with glGetError
+     * synchronises the CPU with the GPU on many drivers, so checking less often can speed up
+     * rendering.
+     * @param errorChecking noerrorchecking: Never check.
+     *                      errorcheckingperframe: Check once per frame, in swapBuffers.
+     *                      errorcheckingpercall: Check after every rendering call (default).
+     *                      errorcheckingcallback: Have the driver report errors and warnings
+     *                      asynchronously, via GL_KHR_debug (some drivers only report messages
+     *                      for debug contexts). The messages are queued and written to the log
+     *                      once per frame, in swapBuffers. Falls back to checking per frame if
+     *                      GL_KHR_debug is not available.
+     *                      An exception is thrown when an error is detected, except with
+     *                      errorcheckingcallback, which only logs it.
+     */
+    void setOpenGLErrorChecking(OpenGLErrorChecking errorChecking);
+
+    /**
+     * @brief Get the number of OpenGL state changes (binding programs, buffers, textures and
+     * vertex arrays, enabling vertex attributes, etc) the renderer has made and the number it has
+     * skipped, because they would not have changed anything
+     * @return The statistics
+     */
+    const GLStateStatistics& getStateStatistics() const;
+
+    /**
+     * @brief Set the number of OpenGL state changes made and skipped to 0
+     */
+    void resetStateStatistics();
+
+    /**
+     * @brief Make the renderer forget the OpenGL state it has set, so that it sets it again the
+     * next time it renders. The renderer keeps track of the state it sets to avoid setting it
+     * again, so this has to be called if the application changes the OpenGL state itself (for
+     * example binding its own programs, buffers or textures) between rendering calls.
+     */
+    void invalidateStateCache();
+
+    /**
+     * @brief Set the maximum amount of GPU memory retained text geometry can occupy. When this
+     * is exceeded, the geometry of the least recently rendered texts is released (the texts remain
+     * valid and are rebuilt when next rendered).
+     * @param bytes The memory limit, in bytes (4MB by default)
+     */
+    void setRetainedTextMemoryLimit(unsigned long bytes);
+
+    /**
+     * @brief Get the amount of GPU memory retained text geometry currently occupies
+     * @return The memory, in bytes
+     */
+    unsigned long getRetainedTextMemory() const;
+
+    /**
+     * @brief Start recording the rendered frames to disk. Each frame is captured when swapBuffers
+     * is called, but read back from the GPU two frames later and written by a separate thread, so that
+     * rendering does not have to wait for it (see FrameCapture).
+     * @param path For PNG, the beginning of the path of each frame's file, to which the frame number
+     *             and the .png extension are appended. For Y4M, the path of the video file. The path
+     *             is relative to the base path.
+     * @param format The format in which frames are saved (framecapturepng or framecapturey4m)
+     * @param frameRate The frame rate recorded in Y4M video (frames per second)
+     */
+    void startFrameCapture(const std::string &path, FrameCaptureFormat format = framecapturepng,
+                           int frameRate = 30);
+
+    /**
+     * @brief Stop recording frames, waiting for all captured frames to be written.
+     */
+    void stopFrameCapture();
+
+    /**
+     * @brief Enable or disable profiling. While it is enabled, the time each frame takes to render
+     * is measured on the CPU and, with OpenGL 3.3 or GL_ARB_timer_query, on the GPU, along with the
+     * time taken by the renderer's stages (sections "scene", "multi-draw", "surfaces", "text",
+     * "bounding boxes", "frame capture" and "swap"). Passes of the application can be measured
+     * too, by wrapping them in sections of their own (see getProfiler and ProfilerScope). Each frame
+     * ends when swapBuffers is called, and its GPU times are read back a few frames later, so as
+     * not to stall rendering.
+     * @param enabled True to enable profiling, false to disable it (default)
+     */
+    void setProfiling(bool enabled);
+
+    /**
+     * @brief Get the profiler, to enter and leave sections of the application's own, read the times
+     * measured or export them (see setProfiling)
+     * @return The profiler
+     */
+    Profiler& getProfiler();
+
+    /**
+     * @brief Write the times of the most recent frame that has been profiled on the screen, at the
+     * top left corner, when the buffers are swapped (only while profiling is enabled)
+     * @param profilerOverlay True to show the times, false to hide them (default)
+     */
+    void setProfilerOverlay(bool profilerOverlay);
+
+    /**
+     * @brief Store a scene object's geometry in the renderer's geometry arena, a pair of large
+     * vertex and index buffers shared by all objects added to it, instead of giving it buffers of
+     * its own. Only supported with OpenGL 3.3 and only for objects that are not animated.
+     * @param sceneObject The scene object
+     * @return True if the object has been added to the arena, false if OpenGL 3.3 is not available
+     *         (the object is then rendered from its own buffers, as usual)
+     */
+    bool addToGeometryArena(SceneObject &sceneObject);
+
+    /**
+     * @brief Clear a scene object from the GPU buffers, or remove it from the geometry arena
+     * (the object itself remains intact)
      * @param sceneObject The scene object
      */
     void clearBuffers(SceneObject &sceneObject);
@@ -302,9 +820,20 @@ namespace small3d
 
     /**
      * @brief This is a double buffered system and this commands swaps
-     * the buffers
+     * the buffers. When rendering headless, it waits for the frame to finish
+     * rendering instead.
      */
     void swapBuffers();
 
+    /**
+     * @brief Read the rendered frame into memory. Bounding boxes that are waiting to be drawn are
+     * rendered first, so this can be called just before swapBuffers or, when rendering headless,
+     * also after it.
+     * @param pixels Filled with the frame, as RGBA values of one byte each, starting from the top row
+     * @param width Set to the width of the frame, in pixels
+     * @param height Set to the height of the frame, in pixels
+     */
+    void readFrame(std::vector<unsigned char> &pixels, int &width, int &height);
+
   };
 }
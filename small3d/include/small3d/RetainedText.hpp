@@ -0,0 +1,72 @@
+/*
+ *  RetainedText.hpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <list>
+
+namespace small3d {
+
+  /**
+   * @class RetainedText
+   *
+   * @brief Text whose geometry is kept on the GPU between frames (see Renderer.createText).
+   */
+  class RetainedText {
+  public:
+
+    std::string text;
+    glm::vec3 colour;
+    int fontSize;
+    std::string fontPath;
+
+    GLuint vaoId = 0;
+    GLuint vertexBufferObjectId = 0;
+
+    /**
+     * @brief Number of glyph quads in the vertex buffer
+     */
+    unsigned long numGlyphs = 0;
+
+    /**
+     * @brief Size of the geometry on the GPU, in bytes
+     */
+    unsigned long memorySize = 0;
+
+    /**
+     * @brief Generation of the glyph atlas the geometry was built for
+     */
+    unsigned long atlasGeneration = 0;
+
+    /**
+     * @brief Whether the geometry was built from signed distance field glyphs
+     */
+    bool signedDistanceField = false;
+
+    /**
+     * @brief Set when the text, font or size has changed since the geometry was built
+     */
+    bool changed = true;
+
+    /**
+     * @brief Position in the renderer's list of retained text, ordered by last use
+     */
+    std::list<unsigned int>::iterator usage;
+
+    /**
+     * @brief Default constructor
+     */
+    RetainedText() = default;
+
+    /**
+     * @brief Destructor
+     */
+    ~RetainedText() = default;
+  };
+}
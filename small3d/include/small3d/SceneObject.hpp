@@ -49,6 +49,12 @@ namespace small3d
     GLuint textureId = 0;
     GLuint uvBufferObjectId = 0;
 
+    /**
+     * @brief Handle of the object's geometry in the renderer's geometry arena (0 if it has
+     * its own buffers, see Renderer.addToGeometryArena)
+     */
+    unsigned int geometryArenaHandle = 0;
+
     /**
      * @brief Constructor
      *
@@ -68,10 +74,14 @@ namespace small3d
      *                            to be found. If this is not set, it is assumed to be the directory
      *                            containing the application executable when using SDL, or the
      *                            directory from where the execution command is entered when 
-     *                            using GLFW.
+     *                            using GLFW or rendering headless.
+     * @param interleavedStride   If set, the object's vertex positions, normals and texture coordinates
+     *                            are interleaved, with this stride in bytes, when they are loaded (see
+     *                            Model.interleave), so that they are rendered from a single buffer.
+     *                            0 (default) keeps them in separate buffers.
      */
     SceneObject(std::string name, std::string modelPath, int numFrames = 1, std::string texturePath = "",
-                std::string boundingBoxSetPath = "", std::string basePath = "");
+                std::string boundingBoxSetPath = "", std::string basePath = "", int interleavedStride = 0);
 
     /**
      * @brief Destructor
@@ -130,6 +140,22 @@ namespace small3d
      */
     const glm::mat4x4& getRotationAdjustment();
 
+    /**
+     * @brief Get the transformation of the object's model to the scene, as it is rendered
+     *        (rotation adjustment, rotation and offset). This can be passed to the queries of
+     *        a MeshBVH built for the model.
+     * @return The transformation matrix
+     */
+    glm::mat4x4 getTransformation() const;
+
+    /**
+     * @brief Get the offset and rotation of the object, as the placement of its bounding boxes.
+     *        The collision queries of the object use this, without changing the offset and
+     *        rotation of the boxes, so they can be made from many threads at the same time.
+     * @return The placement
+     */
+    Placement getPlacement() const;
+
     /**
      * @brief Start animating the object
      */
@@ -170,18 +196,90 @@ namespace small3d
      * @return	true if a collision is detected, false otherwise.
      */
 
-    bool collidesWith(glm::vec3 point);
+    bool collidesWith(glm::vec3 point) const;
+
+    /**
+     * @brief Check which of many points collide with the object (for example, the bullets or
+     *        particles of a frame). See BoundingBoxSet.collidesWith.
+     *
+     * @param	points	The points
+     * @param	collisions	Bit (n % 32) of collisions[n / 32] is set if point n collides
+     */
+
+    void collidesWith(const std::vector<glm::vec3> &points, std::vector<uint32_t> &collisions) const;
 
     /**
      *
      * @brief	Check if the object collides with another given object.
      *
      * @param	otherObject	The other object.
+     * @param	mode	How to check: whether a corner of a bounding box of either object is inside
+     *		  	a bounding box of the other (collisionvertices, the default) or, exactly, whether
+     *		  	any two bounding boxes overlap (collisionorientedboxes). See BoundingBoxSet.collidesWith.
      *
      * @return	true if there is a collision, false if not.
      */
 
-    bool collidesWith(SceneObject &otherObject);
+    bool collidesWith(const SceneObject &otherObject, CollisionMode mode = collisionvertices) const;
+
+    /**
+     *
+     * @brief	Check if the object collides with another given object, using what has been found
+     *		out the last time the two objects have been checked (see CollisionCache). This is
+     *		meant for pairs of objects that are checked on every frame.
+     *
+     * @param	otherObject	The other object.
+     * @param	cache	The cache for the pair (the objects have to be checked in the same order each time)
+     * @param	mode	How to check (see above)
+     *
+     * @return	true if there is a collision, false if not.
+     */
+
+    bool collidesWith(const SceneObject &otherObject, CollisionCache &cache,
+                      CollisionMode mode = collisionvertices) const;
+
+    /**
+     *
+     * @brief	Check if the object has collided with another object while moving in a straight
+     *		line from a previous offset to its current one (see BoundingBoxSet.sweptCollidesWith)
+     *
+     * @param	previousOffset	The offset of the object before it moved (for example, during the last frame)
+     * @param	otherObject	The other object (which is assumed not to have moved)
+     * @param	timeOfImpact	When the objects first collide, from 0 (at the previous offset) to 1 (at the
+     *			current offset)
+     *
+     * @return	true if there is a collision, false if not.
+     */
+
+    bool sweptCollidesWith(const glm::vec3 &previousOffset, const SceneObject &otherObject,
+                           float &timeOfImpact) const;
+
+    /**
+     * @brief Find the first bounding box of the object hit by a ray (for example, to pick the
+     *        object under the mouse cursor)
+     *
+     * @param	origin	The origin of the ray
+     * @param	direction	The direction of the ray
+     * @param	hit	The box hit first and the distance to it
+     * @param	maxDistance	How far along the ray to look
+     *
+     * @return	true if a bounding box has been hit, false if not.
+     */
+
+    bool castRay(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit,
+                 float maxDistance = std::numeric_limits<float>::max()) const;
+
+    /**
+     * @brief Find the first bounding box of the object hit by a line segment
+     *
+     * @param	start	The start of the segment
+     * @param	end	The end of the segment
+     * @param	hit	The box hit first and its distance from the start of the segment
+     *
+     * @return	true if a bounding box has been hit, false if not.
+     */
+
+    bool intersectsSegment(const glm::vec3 &start, const glm::vec3 &end, RayHit &hit) const;
 
   };
 
@@ -13,7 +13,7 @@
 #include <vorbis/vorbisfile.h>
 #include "SoundData.hpp"
 
-#ifndef SMALL3D_GLFW
+#if !defined(SMALL3D_GLFW) && !defined(SMALL3D_HEADLESS)
 #include <SDL.h>
 #endif
 
@@ -49,7 +49,7 @@ namespace small3d {
      *                   to be found. If this is not set, it is assumed to be the directory
      *                   containing the application executable when using SDL, or the
      *                   directory from where the execution command is entered when 
-     *                   using GLFW.
+     *                   using GLFW or rendering headless.
      */
     SoundPlayer(std::string basePath = "");
 
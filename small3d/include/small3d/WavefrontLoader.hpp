@@ -7,7 +7,7 @@
  */
 #pragma once
 
-#ifndef SMALL3D_GLFW
+#if !defined(SMALL3D_GLFW) && !defined(SMALL3D_HEADLESS)
 #include <SDL.h>
 #endif
 
@@ -60,7 +60,7 @@ namespace small3d {
      *                   to be found. If this is not set, it is assumed to be the directory
      *                   containing the application executable when using SDL, or the
      *                   directory from where the execution command is entered when 
-     *                   using GLFW.
+     *                   using GLFW or rendering headless.
      */
 
     WavefrontLoader(std::string basePath = "");
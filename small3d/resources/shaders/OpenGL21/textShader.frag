@@ -0,0 +1,10 @@
+#version 120
+
+varying vec2 textureCoords;
+uniform sampler2D textureImage;
+uniform vec3 colour;
+
+void main()
+{
+    gl_FragColor = vec4(colour, texture2D(textureImage, textureCoords).r);
+}
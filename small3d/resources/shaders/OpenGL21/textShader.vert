@@ -0,0 +1,15 @@
+#version 120
+
+attribute vec2 position;
+attribute vec2 uvCoords;
+
+uniform vec4 textRectangle;
+uniform vec2 atlasSize;
+
+varying vec2 textureCoords;
+
+void main()
+{
+    gl_Position = vec4(mix(textRectangle.xy, textRectangle.zw, position), -0.5, 1.0);
+    textureCoords = uvCoords / atlasSize;
+}
@@ -8,21 +8,22 @@ smooth out float cosAngIncidence;
 out vec2 textureCoords;
 
 uniform vec3 offset;
-uniform mat4 perspectiveMatrix;
 
 uniform mat4 xRotationMatrix;
 uniform mat4 yRotationMatrix;
 uniform mat4 zRotationMatrix;
 
-uniform vec3 cameraPosition;
-
-uniform mat4 xCameraRotationMatrix;
-uniform mat4 yCameraRotationMatrix;
-uniform mat4 zCameraRotationMatrix;
-
 uniform mat4 rotationAdjustmentMatrix;
 
-uniform vec3 lightDirection;
+// Camera and lighting, shared by all objects rendered in a frame
+layout(std140) uniform FrameData
+{
+    mat4 perspectiveMatrix;
+    mat4 cameraRotationMatrix;
+    vec3 cameraPosition;
+    vec3 lightDirection;
+    float lightIntensity;
+};
 
 void main()
 {
@@ -30,8 +31,7 @@ void main()
 			* yRotationMatrix
 			+ vec4(offset.x, offset.y, offset.z, 0.0);
 
-    vec4 cameraPos = (worldPos - vec4(cameraPosition.x, cameraPosition.y, cameraPosition.z, 0.0))
-			 * yCameraRotationMatrix * xCameraRotationMatrix * zCameraRotationMatrix;
+    vec4 cameraPos = cameraRotationMatrix * (worldPos - vec4(cameraPosition, 0.0));
 
     gl_Position = perspectiveMatrix * cameraPos;
 
@@ -0,0 +1,15 @@
+#version 330
+
+in vec2 textureCoords;
+uniform sampler2D textureImage;
+uniform vec3 colour;
+out vec4 outputColour;
+
+void main()
+{
+    // The field is 0.5 on the outline of the glyphs. Smoothing over the
+    // screen space rate of change keeps edges sharp at any scale.
+    float distance = texture(textureImage, textureCoords).r;
+    float smoothing = max(0.7 * fwidth(distance), 0.001);
+    outputColour = vec4(colour, smoothstep(0.5 - smoothing, 0.5 + smoothing, distance));
+}
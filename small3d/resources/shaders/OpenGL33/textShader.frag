@@ -0,0 +1,11 @@
+#version 330
+
+in vec2 textureCoords;
+uniform sampler2D textureImage;
+uniform vec3 colour;
+out vec4 outputColour;
+
+void main()
+{
+    outputColour = vec4(colour, texture(textureImage, textureCoords).r);
+}
@@ -0,0 +1,15 @@
+#version 330
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 uvCoords;
+
+uniform vec4 textRectangle;
+uniform vec2 atlasSize;
+
+out vec2 textureCoords;
+
+void main()
+{
+    gl_Position = vec4(mix(textRectangle.xy, textRectangle.zw, position), -0.5, 1.0);
+    textureCoords = uvCoords / atlasSize;
+}
@@ -4,7 +4,16 @@ smooth in float cosAngIncidence;
 in vec2 textureCoords;
 uniform sampler2D textureImage;
 uniform vec4 colour;
-uniform float lightIntensity;
+
+// Camera and lighting, shared by all objects rendered in a frame
+layout(std140) uniform FrameData
+{
+    mat4 perspectiveMatrix;
+    mat4 cameraRotationMatrix;
+    vec3 cameraPosition;
+    vec3 lightDirection;
+    float lightIntensity;
+};
 
 out vec4 outputColour;
 
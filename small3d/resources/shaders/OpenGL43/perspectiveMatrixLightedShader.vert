@@ -0,0 +1,56 @@
+#version 430
+
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uvCoords;
+
+// Index of the object in the objects buffer (one per instance, starting
+// from the draw command's base instance)
+layout(location = 3) in uint objectIndex;
+
+struct Object
+{
+    // Rotation adjustment, rotation and offset
+    mat4 transformation;
+    // Rotation only (for the normals)
+    mat4 rotation;
+    vec4 colour;
+};
+
+layout(std430, binding = 0) readonly buffer Objects
+{
+    Object objects[];
+};
+
+smooth out float cosAngIncidence;
+out vec2 textureCoords;
+flat out vec4 objectColour;
+
+// Camera and lighting, shared by all objects rendered in a frame
+layout(std140) uniform FrameData
+{
+    mat4 perspectiveMatrix;
+    mat4 cameraRotationMatrix;
+    vec3 cameraPosition;
+    vec3 lightDirection;
+    float lightIntensity;
+};
+
+void main()
+{
+    Object object = objects[objectIndex];
+
+    vec4 worldPos = object.transformation * position;
+
+    vec4 cameraPos = cameraRotationMatrix * (worldPos - vec4(cameraPosition, 0.0));
+
+    gl_Position = perspectiveMatrix * cameraPos;
+
+    vec4 normalInWorld = normalize(perspectiveMatrix * (object.rotation * vec4(normal, 1)));
+
+    vec4 lightDirectionWorld = normalize(perspectiveMatrix * vec4(lightDirection, 1));
+
+    cosAngIncidence = clamp(dot(normalInWorld, lightDirectionWorld), 0, 1);
+    textureCoords = uvCoords;
+    objectColour = object.colour;
+}
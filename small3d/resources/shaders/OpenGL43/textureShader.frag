@@ -0,0 +1,40 @@
+#version 430
+
+smooth in float cosAngIncidence;
+in vec2 textureCoords;
+flat in vec4 objectColour;
+uniform sampler2D textureImage;
+
+// Camera and lighting, shared by all objects rendered in a frame
+layout(std140) uniform FrameData
+{
+    mat4 perspectiveMatrix;
+    mat4 cameraRotationMatrix;
+    vec3 cameraPosition;
+    vec3 lightDirection;
+    float lightIntensity;
+};
+
+out vec4 outputColour;
+
+void main()
+{
+if (objectColour != vec4(0, 0, 0, 0)) {
+    outputColour = vec4((cosAngIncidence * objectColour).rgb, objectColour.a);
+}
+else {
+
+  vec4 tcolour = texture(textureImage, textureCoords);
+  
+  if (lightIntensity == -1)
+  {
+    outputColour = tcolour;
+  }
+  else
+  {
+    vec4 textureWtLight = lightIntensity * cosAngIncidence * tcolour;
+    outputColour = vec4(textureWtLight.rgb, tcolour.a);
+  }
+}
+
+}
@@ -8,10 +8,17 @@
 
 #include "BoundingBoxSet.hpp"
 #include <fstream>
+#include <cmath>
+#include <algorithm>
 #include "Exception.hpp"
 #include "GetTokens.hpp"
 #include "MathFunctions.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SMALL3D_SSE
+#endif
+
 using namespace std;
 
 namespace small3d {
@@ -24,9 +31,13 @@ namespace small3d {
     vertices.clear();
     facesVertexIndexes.clear();
     numBoxes = 0;
+    version = 0;
+    rotationAdjustment = glm::mat4x4(1.0f);
+    setMinCoords = glm::vec3(0.0f, 0.0f, 0.0f);
+    setMaxCoords = glm::vec3(0.0f, 0.0f, 0.0f);
 
     if (basePath.empty()) {
-#ifndef SMALL3D_GLFW
+#if !defined(SMALL3D_GLFW) && !defined(SMALL3D_HEADLESS)
       this->basePath = string(SDL_GetBasePath());
 #endif
     }
@@ -97,6 +108,29 @@ namespace small3d {
         }
       }
 
+      // Flat copies of the geometry, so that it does not need to be converted every time
+      // it is rendered. The faces are split into triangles.
+
+      vertexData.clear();
+      vertexData.reserve(vertices.size() * 3);
+      for (const vector<float> &vertex : vertices) {
+        vertexData.insert(vertexData.end(), vertex.begin(), vertex.begin() + 3);
+      }
+
+      indexData.clear();
+      indexData.reserve(numBoxes * 36);
+      for (int idx = 0; idx < numBoxes; ++idx) {
+        for (int idx2 = 0; idx2 < 6; ++idx2) {
+          const vector<unsigned int> &face = facesVertexIndexes[6 * idx + idx2];
+          unsigned int triangleIndexes[6] = {face[0], face[1], face[2], face[2], face[3], face[0]};
+          for (unsigned int triangleIndex : triangleIndexes) {
+            indexData.push_back(triangleIndex + 8 * idx);
+          }
+        }
+      }
+
+      calculateExtents();
+
       LOGINFO("Loaded " + intToStr(numBoxes) + " bounding boxes.");
     }
     else
@@ -108,91 +142,1161 @@ namespace small3d {
   void BoundingBoxSet::setRotationAdjustment(const glm::mat4x4 &ajdustmentMatrix) {
 
     rotationAdjustment = ajdustmentMatrix;
+    calculateExtents();
+  }
+
+  void BoundingBoxSet::calculateExtents() {
+    boxCentres.resize(numBoxes);
+    boxHalfSizes.resize(numBoxes);
+    boxMinX.resize(numBoxes);
+    boxMaxX.resize(numBoxes);
+    boxMinY.resize(numBoxes);
+    boxMaxY.resize(numBoxes);
+    boxMinZ.resize(numBoxes);
+    boxMaxZ.resize(numBoxes);
+
+    for (int idx = 0; idx < numBoxes; ++idx) {
+      glm::vec3 minCoords, maxCoords, minLocalCoords, maxLocalCoords;
+
+      for (int checkidx = idx * 8; checkidx < (idx + 1) * 8; ++checkidx) {
+        const vector<float> &vertex = vertices[static_cast<unsigned int>(checkidx)];
+        glm::vec3 coords(vertex[0], vertex[1], vertex[2]);
+        glm::vec3 rotatedCoords = glm::vec3(rotationAdjustment * glm::vec4(coords, 1.0f));
+
+        if (checkidx == idx * 8) {
+          minCoords = rotatedCoords;
+          maxCoords = rotatedCoords;
+          minLocalCoords = coords;
+          maxLocalCoords = coords;
+        }
+        else {
+          minCoords = glm::min(minCoords, rotatedCoords);
+          maxCoords = glm::max(maxCoords, rotatedCoords);
+          minLocalCoords = glm::min(minLocalCoords, coords);
+          maxLocalCoords = glm::max(maxLocalCoords, coords);
+        }
+      }
+
+      boxCentres[idx] = 0.5f * (minLocalCoords + maxLocalCoords);
+      boxHalfSizes[idx] = 0.5f * (maxLocalCoords - minLocalCoords);
+
+      boxMinX[idx] = minCoords.x;
+      boxMaxX[idx] = maxCoords.x;
+      boxMinY[idx] = minCoords.y;
+      boxMaxY[idx] = maxCoords.y;
+      boxMinZ[idx] = minCoords.z;
+      boxMaxZ[idx] = maxCoords.z;
+
+      setMinCoords = idx == 0 ? minCoords : glm::min(setMinCoords, minCoords);
+      setMaxCoords = idx == 0 ? maxCoords : glm::max(setMaxCoords, maxCoords);
+
+      // The oriented boxes (see orientedBoxesCollideWith) are also kept within the extents of
+      // the set, in case a box is not aligned with the axes of the space of the boxes.
+      for (int corner = 0; corner < 8; ++corner) {
+        glm::vec3 cornerCoords(corner & 1 ? maxLocalCoords.x : minLocalCoords.x,
+                               corner & 2 ? maxLocalCoords.y : minLocalCoords.y,
+                               corner & 4 ? maxLocalCoords.z : minLocalCoords.z);
+        glm::vec3 rotatedCoords = glm::vec3(rotationAdjustment * glm::vec4(cornerCoords, 1.0f));
+        setMinCoords = glm::min(setMinCoords, rotatedCoords);
+        setMaxCoords = glm::max(setMaxCoords, rotatedCoords);
+      }
+    }
+
+    if (numBoxes == 0) {
+      setMinCoords = glm::vec3(0.0f, 0.0f, 0.0f);
+      setMaxCoords = glm::vec3(0.0f, 0.0f, 0.0f);
+    }
+
+    // Anything cached about the boxes is out of date
+    ++version;
+
+    buildBoxTree();
+  }
+
+  void BoundingBoxSet::buildBoxTree() {
+    boxTree.clear();
+    boxTreeOrder.resize(numBoxes);
+    for (int idx = 0; idx < numBoxes; ++idx) {
+      boxTreeOrder[idx] = idx;
+    }
+
+    if (numBoxes > 0) {
+      boxTree.reserve(2 * (numBoxes / BOX_TREE_LEAF_SIZE) + 1);
+      buildBoxTreeNode(0, numBoxes, 0);
+    }
   }
 
+  void BoundingBoxSet::buildBoxTreeNode(int firstBox, int numBoxes, int depth) {
+    BoxTreeNode node;
+    node.secondChild = -1;
+    node.firstBox = firstBox;
+    node.numBoxes = numBoxes;
+
+    glm::vec3 minCentre, maxCentre;
+    for (int idx = firstBox; idx < firstBox + numBoxes; ++idx) {
+      int box = boxTreeOrder[idx];
+      glm::vec3 minCoords(boxMinX[box], boxMinY[box], boxMinZ[box]);
+      glm::vec3 maxCoords(boxMaxX[box], boxMaxY[box], boxMaxZ[box]);
+      glm::vec3 centre = 0.5f * (minCoords + maxCoords);
+      if (idx == firstBox) {
+        node.minCoords = minCoords;
+        node.maxCoords = maxCoords;
+        minCentre = centre;
+        maxCentre = centre;
+      }
+      else {
+        node.minCoords = glm::min(node.minCoords, minCoords);
+        node.maxCoords = glm::max(node.maxCoords, maxCoords);
+        minCentre = glm::min(minCentre, centre);
+        maxCentre = glm::max(maxCentre, centre);
+      }
+    }
+
+    size_t nodeIdx = boxTree.size();
+    boxTree.push_back(node);
+
+    if (numBoxes <= BOX_TREE_LEAF_SIZE || depth == BOX_TREE_MAX_DEPTH - 1) {
+      return;
+    }
+
+    // Split the boxes in half along the axis on which their centres are most spread out
+    glm::vec3 spread = maxCentre - minCentre;
+    int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+    const vector<float> &minCoords = axis == 0 ? boxMinX : (axis == 1 ? boxMinY : boxMinZ);
+    const vector<float> &maxCoords = axis == 0 ? boxMaxX : (axis == 1 ? boxMaxY : boxMaxZ);
+
+    int half = numBoxes / 2;
+    nth_element(boxTreeOrder.begin() + firstBox, boxTreeOrder.begin() + firstBox + half,
+                boxTreeOrder.begin() + firstBox + numBoxes, [&minCoords, &maxCoords](int a, int b) {
+                  return minCoords[a] + maxCoords[a] < minCoords[b] + maxCoords[b];
+                });
+
+    boxTree[nodeIdx].numBoxes = 0;
+    buildBoxTreeNode(firstBox, half, depth + 1);
+    boxTree[nodeIdx].secondChild = static_cast<int>(boxTree.size());
+    buildBoxTreeNode(firstBox + half, numBoxes - half, depth + 1);
+  }
+
+  bool BoundingBoxSet::containsInBoxSpace(const glm::vec3 &point) const {
+    if (boxTree.empty()) {
+      return false;
+    }
+
+    int stack[BOX_TREE_MAX_DEPTH + 1];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+      int nodeIdx = stack[--stackSize];
+      const BoxTreeNode &node = boxTree[nodeIdx];
+
+      if (point.x < node.minCoords.x || point.x > node.maxCoords.x ||
+          point.y < node.minCoords.y || point.y > node.maxCoords.y ||
+          point.z < node.minCoords.z || point.z > node.maxCoords.z) {
+        continue;
+      }
+
+      if (node.numBoxes == 0) {
+        stack[stackSize++] = node.secondChild;
+        stack[stackSize++] = nodeIdx + 1;
+        continue;
+      }
+
+      for (int idx = node.firstBox; idx < node.firstBox + node.numBoxes; ++idx) {
+        int box = boxTreeOrder[idx];
+        if (point.x > boxMinX[box] && point.x < boxMaxX[box] &&
+            point.y > boxMinY[box] && point.y < boxMaxY[box] &&
+            point.z > boxMinZ[box] && point.z < boxMaxZ[box]) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  Placement::Placement() {
+    offset = glm::vec3(0.0f, 0.0f, 0.0f);
+    rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+  }
+
+  Placement::Placement(const glm::vec3 &offset, const glm::vec3 &rotation) {
+    this->offset = offset;
+    this->rotation = rotation;
+  }
+
+  CollisionCache::CollisionCache() {
+    reset();
+  }
+
+  void CollisionCache::reset() {
+    boxSet = nullptr;
+    otherBoxSet = nullptr;
+    version = 0;
+    otherVersion = 0;
+    separated = false;
+    axis = glm::vec3(1.0f, 0.0f, 0.0f);
+    gap = 0.0f;
+    box = -1;
+    otherBox = -1;
+    fullChecks = 0;
+  }
+
+  bool CollisionCache::isSeparated() const {
+    return separated;
+  }
+
+  /**
+   * Get the rotation taking world space to the space of a set (before its rotation adjustment)
+   * @param placement The placement of the set
+   * @return The rotation matrix
+   */
+  static glm::mat4x4 getInverseRotation(const Placement &placement) {
+    return rotateY(-placement.rotation.y) * rotateX(-placement.rotation.x) * rotateZ(-placement.rotation.z);
+  }
+
+  Placement BoundingBoxSet::getPlacement() const {
+    return Placement(offset, rotation);
+  }
 
   bool BoundingBoxSet::collidesWith(glm::vec3 point) const {
-    bool collides = false;
-    glm::mat4 rotationMatrix = rotateY(-rotation.y) * rotateX(-rotation.x) * rotateZ(-rotation.z);
+    return collidesWith(getPlacement(), point);
+  }
 
-    glm::vec4 pointInBoxSpace = glm::vec4(point, 1.0f) - glm::vec4(offset, 0.0f);
+  bool BoundingBoxSet::collidesWith(const Placement &placement, glm::vec3 point) const {
+    glm::mat4 rotationMatrix = getInverseRotation(placement);
+
+    glm::vec4 pointInBoxSpace = glm::vec4(point, 1.0f) - glm::vec4(placement.offset, 0.0f);
     pointInBoxSpace = rotationMatrix * pointInBoxSpace;
 
+    return containsInBoxSpace(glm::vec3(pointInBoxSpace));
+  }
+
+  void BoundingBoxSet::collidesWith(const glm::vec3 *points, size_t numPoints, uint32_t *collisions) const {
+    collidesWith(getPlacement(), points, numPoints, collisions);
+  }
+
+  void BoundingBoxSet::collidesWith(const Placement &placement, const glm::vec3 *points, size_t numPoints,
+                                    uint32_t *collisions) const {
+    for (size_t idx = 0; idx < (numPoints + 31) / 32; ++idx) {
+      collisions[idx] = 0;
+    }
+
+    if (boxTree.empty()) {
+      return;
+    }
+
+    glm::mat4 rotationMatrix = getInverseRotation(placement);
+    size_t firstScalarPoint = 0;
+
+#ifdef SMALL3D_SSE
+    // The points are transformed and tested in groups of four, with the coordinates of each
+    // group in separate registers. A node of the tree is visited if any of the points in the
+    // group that have not been found to collide yet are inside it.
+    __m128 r00 = _mm_set1_ps(rotationMatrix[0][0]), r10 = _mm_set1_ps(rotationMatrix[1][0]),
+      r20 = _mm_set1_ps(rotationMatrix[2][0]), r01 = _mm_set1_ps(rotationMatrix[0][1]),
+      r11 = _mm_set1_ps(rotationMatrix[1][1]), r21 = _mm_set1_ps(rotationMatrix[2][1]),
+      r02 = _mm_set1_ps(rotationMatrix[0][2]), r12 = _mm_set1_ps(rotationMatrix[1][2]),
+      r22 = _mm_set1_ps(rotationMatrix[2][2]);
+    __m128 offsetX = _mm_set1_ps(placement.offset.x), offsetY = _mm_set1_ps(placement.offset.y),
+      offsetZ = _mm_set1_ps(placement.offset.z);
+    int stack[BOX_TREE_MAX_DEPTH + 1];
+
+    for (; firstScalarPoint + 4 <= numPoints; firstScalarPoint += 4) {
+      const glm::vec3 *p = &points[firstScalarPoint];
+      __m128 x = _mm_sub_ps(_mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x), offsetX);
+      __m128 y = _mm_sub_ps(_mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y), offsetY);
+      __m128 z = _mm_sub_ps(_mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z), offsetZ);
+      __m128 pointX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, x), _mm_mul_ps(r10, y)), _mm_mul_ps(r20, z));
+      __m128 pointY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r01, x), _mm_mul_ps(r11, y)), _mm_mul_ps(r21, z));
+      __m128 pointZ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r02, x), _mm_mul_ps(r12, y)), _mm_mul_ps(r22, z));
+
+      __m128 colliding = _mm_setzero_ps();
+      int stackSize = 0;
+      stack[stackSize++] = 0;
+
+      while (stackSize > 0) {
+        int nodeIdx = stack[--stackSize];
+        const BoxTreeNode &node = boxTree[nodeIdx];
+
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(pointX, _mm_set1_ps(node.minCoords.x)),
+                                              _mm_cmple_ps(pointX, _mm_set1_ps(node.maxCoords.x))),
+                                   _mm_and_ps(_mm_cmpge_ps(pointY, _mm_set1_ps(node.minCoords.y)),
+                                              _mm_cmple_ps(pointY, _mm_set1_ps(node.maxCoords.y))));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(pointZ, _mm_set1_ps(node.minCoords.z)),
+                                               _mm_cmple_ps(pointZ, _mm_set1_ps(node.maxCoords.z))));
+        if (_mm_movemask_ps(_mm_andnot_ps(colliding, inside)) == 0) {
+          continue;
+        }
+
+        if (node.numBoxes == 0) {
+          stack[stackSize++] = node.secondChild;
+          stack[stackSize++] = nodeIdx + 1;
+          continue;
+        }
+
+        for (int idx = node.firstBox; idx < node.firstBox + node.numBoxes; ++idx) {
+          int box = boxTreeOrder[idx];
+          inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(pointX, _mm_set1_ps(boxMinX[box])),
+                                         _mm_cmplt_ps(pointX, _mm_set1_ps(boxMaxX[box]))),
+                              _mm_and_ps(_mm_cmpgt_ps(pointY, _mm_set1_ps(boxMinY[box])),
+                                         _mm_cmplt_ps(pointY, _mm_set1_ps(boxMaxY[box]))));
+          inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpgt_ps(pointZ, _mm_set1_ps(boxMinZ[box])),
+                                                 _mm_cmplt_ps(pointZ, _mm_set1_ps(boxMaxZ[box]))));
+          colliding = _mm_or_ps(colliding, inside);
+        }
+
+        if (_mm_movemask_ps(colliding) == 0xf) {
+          break;
+        }
+      }
+
+      collisions[firstScalarPoint / 32] |=
+        static_cast<uint32_t>(_mm_movemask_ps(colliding)) << (firstScalarPoint % 32);
+    }
+#endif
+
+    for (size_t idx = firstScalarPoint; idx < numPoints; ++idx) {
+      glm::vec3 difference = points[idx] - placement.offset;
+      glm::vec3 point(rotationMatrix[0][0] * difference.x + rotationMatrix[1][0] * difference.y +
+                      rotationMatrix[2][0] * difference.z,
+                      rotationMatrix[0][1] * difference.x + rotationMatrix[1][1] * difference.y +
+                      rotationMatrix[2][1] * difference.z,
+                      rotationMatrix[0][2] * difference.x + rotationMatrix[1][2] * difference.y +
+                      rotationMatrix[2][2] * difference.z);
+      if (containsInBoxSpace(point)) {
+        collisions[idx / 32] |= 1u << (idx % 32);
+      }
+    }
+  }
+
+  void BoundingBoxSet::collidesWith(const vector<glm::vec3> &points, vector<uint32_t> &collisions) const {
+    collidesWith(getPlacement(), points, collisions);
+  }
+
+  void BoundingBoxSet::collidesWith(const Placement &placement, const vector<glm::vec3> &points,
+                                    vector<uint32_t> &collisions) const {
+    collisions.resize((points.size() + 31) / 32);
+    if (!points.empty()) {
+      collidesWith(placement, &points[0], points.size(), &collisions[0]);
+    }
+  }
+
+  /**
+   * Get the rotation taking the space of a set (with its rotation adjustment applied) to world space
+   * @param placement The placement of the set
+   * @return The rotation matrix
+   */
+  static glm::mat4x4 getRotation(const Placement &placement) {
+    return rotateZ(placement.rotation.z) * rotateX(placement.rotation.x) * rotateY(placement.rotation.y);
+  }
+
+  glm::mat4x4 BoundingBoxSet::getTransformation(const Placement &placement) const {
+    glm::mat4x4 transformation = rotateZ(placement.rotation.z) * rotateX(placement.rotation.x) *
+      rotateY(placement.rotation.y) * rotationAdjustment;
+    transformation[3] += glm::vec4(placement.offset, 0.0f);
+    return transformation;
+  }
+
+  /**
+   * Separating axis test between two oriented boxes
+   * @param t        The distance between the centres of the boxes, in the space of the first box
+   * @param a        Half the size of the first box
+   * @param b        Half the size of the second box
+   * @param r        The products of the axes of the first box with those of the second
+   * @param absR     The absolute values of r, plus a small tolerance
+   * @return True if the boxes overlap, false if there is an axis separating them
+   */
+  static bool orientedBoxesOverlap(const glm::vec3 &t, const glm::vec3 &a, const glm::vec3 &b,
+                                   const float r[3][3], const float absR[3][3]) {
+    // The faces of the boxes are tested first, since they are the most likely to separate them,
+    // followed by the cross products of their edges.
+    for (int i = 0; i < 3; ++i) {
+      if (fabs(t[i]) > a[i] + b[0] * absR[i][0] + b[1] * absR[i][1] + b[2] * absR[i][2]) return false;
+    }
+
+    for (int j = 0; j < 3; ++j) {
+      if (fabs(t[0] * r[0][j] + t[1] * r[1][j] + t[2] * r[2][j]) >
+          a[0] * absR[0][j] + a[1] * absR[1][j] + a[2] * absR[2][j] + b[j]) return false;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+      int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+      for (int j = 0; j < 3; ++j) {
+        int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+        if (fabs(t[i2] * r[i1][j] - t[i1] * r[i2][j]) >
+            a[i1] * absR[i2][j] + a[i2] * absR[i1][j] + b[j1] * absR[i][j2] + b[j2] * absR[i][j1]) return false;
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * Narrow the times during which two boxes, one of which is moving, overlap along an axis
+   * @param distance The distance between the centres of the boxes along the axis, at the start
+   * @param movement How much the moving box moves along the axis
+   * @param reach    The sum of the extents of the boxes along the axis
+   * @param entry    The time from which the boxes overlap along all axes tested so far
+   * @param exit     The time until which the boxes overlap along all axes tested so far
+   * @return True if the boxes overlap along all axes tested so far at some time, false otherwise
+   */
+  static bool sweepAlongAxis(float distance, float movement, float reach, float &entry, float &exit) {
+    if (movement == 0.0f) {
+      return fabs(distance) <= reach;
+    }
+
+    float t1 = (distance - reach) / movement;
+    float t2 = (distance + reach) / movement;
+    if (t1 > t2) swap(t1, t2);
+
+    entry = max(entry, t1);
+    exit = min(exit, t2);
+    return entry <= exit;
+  }
+
+  /**
+   * Separating axis test between two oriented boxes, one of which is moving in a straight line
+   * without rotating. Since the boxes can only overlap at the times when they overlap along all
+   * 15 axes, the time of impact is the latest time at which they start overlapping along one.
+   * @param t        The distance between the centres of the boxes at the start, in the space of the
+   *                 first box
+   * @param u        The movement of the first box, in its own space
+   * @param a        Half the size of the first box
+   * @param b        Half the size of the second box
+   * @param r        The products of the axes of the first box with those of the second
+   * @param absR     The absolute values of r, plus a tolerance
+   * @param maxTime  The time until which to look (the movement takes time 1)
+   * @param time     The time of impact
+   * @return True if the boxes overlap before maxTime, false otherwise
+   */
+  static bool sweptOrientedBoxesOverlap(const glm::vec3 &t, const glm::vec3 &u, const glm::vec3 &a,
+                                        const glm::vec3 &b, const float r[3][3], const float absR[3][3],
+                                        float maxTime, float &time) {
+    float entry = 0.0f, exit = maxTime;
+
+    for (int i = 0; i < 3; ++i) {
+      if (!sweepAlongAxis(t[i], u[i], a[i] + b[0] * absR[i][0] + b[1] * absR[i][1] + b[2] * absR[i][2],
+                          entry, exit)) return false;
+    }
+
+    for (int j = 0; j < 3; ++j) {
+      if (!sweepAlongAxis(t[0] * r[0][j] + t[1] * r[1][j] + t[2] * r[2][j],
+                          u[0] * r[0][j] + u[1] * r[1][j] + u[2] * r[2][j],
+                          a[0] * absR[0][j] + a[1] * absR[1][j] + a[2] * absR[2][j] + b[j],
+                          entry, exit)) return false;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+      int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+      for (int j = 0; j < 3; ++j) {
+        int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+        if (!sweepAlongAxis(t[i2] * r[i1][j] - t[i1] * r[i2][j],
+                            u[i2] * r[i1][j] - u[i1] * r[i2][j],
+                            a[i1] * absR[i2][j] + a[i2] * absR[i1][j] + b[j1] * absR[i][j2] + b[j2] * absR[i][j1],
+                            entry, exit)) return false;
+      }
+    }
+
+    time = entry;
+    return true;
+  }
+
+  /**
+   * Get the axes of the boxes of a set (all its boxes have the same orientation)
+   * @param transformation The transformation of the set (see getTransformation)
+   * @param axes           The axes, normalised
+   * @param scale          The scale of the set along each axis
+   */
+  static void getBoxAxes(const glm::mat4x4 &transformation, glm::vec3 axes[3], glm::vec3 &scale) {
+    for (int i = 0; i < 3; ++i) {
+      axes[i] = glm::vec3(transformation[i]);
+      scale[i] = glm::length(axes[i]);
+      if (scale[i] > 0.0f) axes[i] /= scale[i];
+    }
+  }
+
+  /**
+   * Get the products of the axes of the boxes of two sets (see orientedBoxesOverlap)
+   * @param axes      The axes of the first set
+   * @param otherAxes The axes of the second set
+   * @param r         The products
+   * @param absR      The absolute values of the products, plus a tolerance which avoids missing
+   *                  separations along the cross product of two (nearly) parallel edges
+   */
+  static void getAxisProducts(const glm::vec3 axes[3], const glm::vec3 otherAxes[3], float r[3][3], float absR[3][3]) {
+    const float EPSILON = 1e-6f;
+
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        r[i][j] = glm::dot(axes[i], otherAxes[j]);
+        absR[i][j] = fabs(r[i][j]) + EPSILON;
+      }
+    }
+  }
+
+  bool BoundingBoxSet::orientedBoxesCollideWith(const Placement &placement, const BoundingBoxSet &otherBoxSet,
+                                                const Placement &otherPlacement, int &box, int &otherBox) const {
+    // The boxes of the smaller set are looked up in the tree of the larger one
+    if (numBoxes > otherBoxSet.numBoxes) {
+      return otherBoxSet.orientedBoxesCollideWith(otherPlacement, *this, placement, otherBox, box);
+    }
+
+    if (otherBoxSet.boxTree.empty()) {
+      return false;
+    }
+
+    glm::mat4x4 transformation = getTransformation(placement);
+    glm::mat4x4 otherTransformation = otherBoxSet.getTransformation(otherPlacement);
+
+    // All the boxes of a set have the same orientation, so the axes and the rotation between
+    // the two sets are only calculated once.
+    glm::vec3 axes[3], otherAxes[3], scale, otherScale;
+    getBoxAxes(transformation, axes, scale);
+    getBoxAxes(otherTransformation, otherAxes, otherScale);
+
+    float r[3][3], absR[3][3];
+    getAxisProducts(axes, otherAxes, r, absR);
+
+    // The tree of the other set is in the space of that set, with its rotation adjustment
+    // applied (see collidesWith(glm::vec3)).
+    glm::mat4x4 toOtherSetSpace;
+    glm::vec3 axesInOtherSetSpace[3];
+    if (otherBoxSet.boxTree.size() > 1) {
+      toOtherSetSpace = getInverseRotation(otherPlacement);
+      for (int i = 0; i < 3; ++i) {
+        axesInOtherSetSpace[i] = glm::vec3(toOtherSetSpace * glm::vec4(axes[i], 0.0f));
+      }
+    }
+
+    // If the tree is a single leaf, its boxes are simply checked one by one.
+    bool useTree = otherBoxSet.boxTree.size() > 1;
+
+    int stack[BOX_TREE_MAX_DEPTH + 1];
+
     for (int idx = 0; idx < numBoxes; ++idx) {
-      float minZ, maxZ, minX, maxX, minY, maxY;
+      glm::vec3 centre = glm::vec3(transformation * glm::vec4(boxCentres[idx], 1.0f));
+      glm::vec3 a = boxHalfSizes[idx] * scale;
+      float reach = glm::length(a);
 
-      glm::vec4 coords(vertices[static_cast<unsigned int>(idx * 8)][0], vertices[static_cast<unsigned int>(idx * 8)][1],
-        vertices[static_cast<unsigned int>(idx * 8)][2], 1);
+      // The extents of the box in the space of the other set
+      glm::vec3 queryMinCoords, queryMaxCoords;
+      if (useTree) {
+        glm::vec3 queryCentre = glm::vec3(toOtherSetSpace * glm::vec4(centre - otherPlacement.offset, 0.0f));
+        glm::vec3 queryHalfSize = glm::abs(axesInOtherSetSpace[0]) * a.x + glm::abs(axesInOtherSetSpace[1]) * a.y +
+          glm::abs(axesInOtherSetSpace[2]) * a.z;
+        queryMinCoords = queryCentre - queryHalfSize;
+        queryMaxCoords = queryCentre + queryHalfSize;
+      }
 
-      glm::vec4 rotatedCoords;
-      rotatedCoords = rotationAdjustment * coords;
+      int stackSize = 0;
+      stack[stackSize++] = 0;
 
-      minX = rotatedCoords.x;
-      maxX = rotatedCoords.x;
-      minY = rotatedCoords.y;
-      maxY = rotatedCoords.y;
-      minZ = rotatedCoords.z;
-      maxZ = rotatedCoords.z;
+      while (stackSize > 0) {
+        int nodeIdx = stack[--stackSize];
+        const BoxTreeNode &node = otherBoxSet.boxTree[nodeIdx];
 
-      for (int checkidx = idx * 8; checkidx < (idx + 1) * 8; ++checkidx) {
-        coords = glm::vec4(vertices[static_cast<unsigned int>(checkidx)][0], vertices[static_cast<unsigned int>(checkidx)][1],
-          vertices[static_cast<unsigned int>(checkidx)][2], 1);
-        rotatedCoords = rotationAdjustment * coords;
+        if (useTree &&
+            (queryMinCoords.x > node.maxCoords.x || queryMaxCoords.x < node.minCoords.x ||
+             queryMinCoords.y > node.maxCoords.y || queryMaxCoords.y < node.minCoords.y ||
+             queryMinCoords.z > node.maxCoords.z || queryMaxCoords.z < node.minCoords.z)) {
+          continue;
+        }
+
+        if (node.numBoxes == 0) {
+          stack[stackSize++] = node.secondChild;
+          stack[stackSize++] = nodeIdx + 1;
+          continue;
+        }
 
-        if (rotatedCoords.x < minX)
-          minX = rotatedCoords.x;
-        if (rotatedCoords.x > maxX)
-          maxX = rotatedCoords.x;
-        if (rotatedCoords.y < minY)
-          minY = rotatedCoords.y;
-        if (rotatedCoords.y > maxY)
-          maxY = rotatedCoords.y;
-        if (rotatedCoords.z < minZ)
-          minZ = rotatedCoords.z;
-        if (rotatedCoords.z > maxZ)
-          maxZ = rotatedCoords.z;
+        for (int orderIdx = node.firstBox; orderIdx < node.firstBox + node.numBoxes; ++orderIdx) {
+          int otherIdx = otherBoxSet.boxTreeOrder[orderIdx];
+          glm::vec3 otherCentre = glm::vec3(otherTransformation * glm::vec4(otherBoxSet.boxCentres[otherIdx], 1.0f));
+          glm::vec3 b = otherBoxSet.boxHalfSizes[otherIdx] * otherScale;
+
+          glm::vec3 distance = otherCentre - centre;
+
+          // Boxes further apart than the sum of their half diagonals cannot overlap
+          float pairReach = reach + glm::length(b);
+          if (glm::dot(distance, distance) > pairReach * pairReach) continue;
+
+          // The distance between the centres, in the space of this set's boxes
+          glm::vec3 t(glm::dot(distance, axes[0]), glm::dot(distance, axes[1]), glm::dot(distance, axes[2]));
+
+          if (orientedBoxesOverlap(t, a, b, r, absR)) {
+            box = idx;
+            otherBox = otherIdx;
+            return true;
+          }
+        }
       }
+    }
+
+    return false;
+  }
+
+  bool BoundingBoxSet::boxPairCollides(const Placement &placement, int box, const BoundingBoxSet &otherBoxSet,
+                                       const Placement &otherPlacement, int otherBox) const {
+    glm::mat4x4 transformation = getTransformation(placement);
+    glm::mat4x4 otherTransformation = otherBoxSet.getTransformation(otherPlacement);
+
+    glm::vec3 axes[3], otherAxes[3], scale, otherScale;
+    getBoxAxes(transformation, axes, scale);
+    getBoxAxes(otherTransformation, otherAxes, otherScale);
+
+    float r[3][3], absR[3][3];
+    getAxisProducts(axes, otherAxes, r, absR);
+
+    glm::vec3 distance = glm::vec3(otherTransformation * glm::vec4(otherBoxSet.boxCentres[otherBox], 1.0f)) -
+      glm::vec3(transformation * glm::vec4(boxCentres[box], 1.0f));
+    glm::vec3 t(glm::dot(distance, axes[0]), glm::dot(distance, axes[1]), glm::dot(distance, axes[2]));
+
+    return orientedBoxesOverlap(t, boxHalfSizes[box] * scale, otherBoxSet.boxHalfSizes[otherBox] * otherScale, r, absR);
+  }
+
+  float BoundingBoxSet::getMaxMovement(const Placement &from, const Placement &to) const {
+    // Each of the three rotations moves a point at most by the angle it turns by, times the
+    // distance of the point from the origin of the set.
+    glm::vec3 turn = glm::abs(to.rotation - from.rotation);
+    float radius = glm::length(glm::max(glm::abs(setMinCoords), glm::abs(setMaxCoords)));
+    return glm::length(to.offset - from.offset) + (turn.x + turn.y + turn.z) * radius;
+  }
+
+  void BoundingBoxSet::projectOnAxis(const Placement &placement, const glm::mat4x4 &rotationMatrix,
+                                     const glm::vec3 &axis, float &minProjection, float &maxProjection) const {
+    glm::vec3 centre = glm::vec3(rotationMatrix * glm::vec4(0.5f * (setMinCoords + setMaxCoords), 1.0f)) +
+      placement.offset;
+    glm::vec3 halfSize = 0.5f * (setMaxCoords - setMinCoords);
+
+    float projectedCentre = glm::dot(centre, axis);
+    float projectedHalfSize = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      projectedHalfSize += fabs(glm::dot(glm::vec3(rotationMatrix[i]), axis)) * halfSize[i];
+    }
+
+    minProjection = projectedCentre - projectedHalfSize;
+    maxProjection = projectedCentre + projectedHalfSize;
+  }
 
-      if (pointInBoxSpace.x > minX && pointInBoxSpace.x < maxX &&
-          pointInBoxSpace.y > minY && pointInBoxSpace.y < maxY &&
-          pointInBoxSpace.z > minZ && pointInBoxSpace.z < maxZ) {
+  float BoundingBoxSet::getGapAlongAxis(const Placement &placement, const glm::mat4x4 &rotationMatrix,
+                                        const BoundingBoxSet &otherBoxSet, const Placement &otherPlacement,
+                                        const glm::mat4x4 &otherRotationMatrix, const glm::vec3 &axis) const {
+    float minProjection, maxProjection, otherMinProjection, otherMaxProjection;
+    projectOnAxis(placement, rotationMatrix, axis, minProjection, maxProjection);
+    otherBoxSet.projectOnAxis(otherPlacement, otherRotationMatrix, axis, otherMinProjection, otherMaxProjection);
+    return max(otherMinProjection - maxProjection, minProjection - otherMaxProjection);
+  }
+
+  bool BoundingBoxSet::findSeparatingAxis(const Placement &placement, const BoundingBoxSet &otherBoxSet,
+                                          const Placement &otherPlacement, glm::vec3 &axis, float &gap) const {
+    // The axes of the boxes enclosing each set, their cross products and the line between
+    // their centres are tried, and the one along which the sets are furthest apart is kept.
+    glm::mat4x4 rotationMatrix = getRotation(placement);
+    glm::mat4x4 otherRotationMatrix = getRotation(otherPlacement);
+
+    glm::vec3 candidates[16];
+    for (int i = 0; i < 3; ++i) {
+      candidates[i] = glm::vec3(rotationMatrix[i]);
+      candidates[3 + i] = glm::vec3(otherRotationMatrix[i]);
+      for (int j = 0; j < 3; ++j) {
+        candidates[6 + 3 * i + j] = glm::cross(glm::vec3(rotationMatrix[i]), glm::vec3(otherRotationMatrix[j]));
+      }
+    }
+    candidates[15] = glm::vec3(otherRotationMatrix * glm::vec4(0.5f * (otherBoxSet.setMinCoords +
+                                                                       otherBoxSet.setMaxCoords), 1.0f)) +
+      otherPlacement.offset - glm::vec3(rotationMatrix * glm::vec4(0.5f * (setMinCoords + setMaxCoords), 1.0f)) -
+      placement.offset;
 
-        collides = true;
-        break;
+    gap = 0.0f;
+    for (const glm::vec3 &candidate : candidates) {
+      float length = glm::length(candidate);
+      // Cross products of (nearly) parallel axes do not separate anything that the axes themselves do not
+      if (length < 1e-3f) continue;
+      glm::vec3 candidateAxis = candidate / length;
+      float candidateGap = getGapAlongAxis(placement, rotationMatrix, otherBoxSet, otherPlacement,
+                                           otherRotationMatrix, candidateAxis);
+      if (candidateGap > gap) {
+        gap = candidateGap;
+        axis = candidateAxis;
       }
     }
 
+    return gap > 0.0f;
+  }
+
+  bool BoundingBoxSet::collidesWith(const BoundingBoxSet &otherBoxSet, CollisionMode mode) const {
+    return collidesWith(getPlacement(), otherBoxSet, otherBoxSet.getPlacement(), mode);
+  }
+
+  bool BoundingBoxSet::collidesWith(const Placement &placement, const BoundingBoxSet &otherBoxSet,
+                                    const Placement &otherPlacement, CollisionMode mode) const {
+    if (mode == collisionorientedboxes) {
+      int box, otherBox;
+      return orientedBoxesCollideWith(placement, otherBoxSet, otherPlacement, box, otherBox);
+    }
+
+    // A single transformation takes the other set's vertices to the space of this set
+    // (see collidesWith(glm::vec3)).
+    glm::mat4 rotationMatrix = getInverseRotation(placement);
+
+    glm::mat4 otherRotationMatrix =
+        rotateZ(otherPlacement.rotation.z) * rotateX(otherPlacement.rotation.x) * rotateY(otherPlacement.rotation.y);
+
+    glm::mat4 transformation = rotationMatrix * otherRotationMatrix * otherBoxSet.rotationAdjustment;
+    glm::vec4 translation = rotationMatrix * glm::vec4(otherPlacement.offset - placement.offset, 0.0f);
+
+    const vector<float> &otherVertexData = otherBoxSet.vertexData;
+
+    for (size_t idx = 0; idx + 2 < otherVertexData.size(); idx += 3) {
+      glm::vec4 pointInBoxSpace = transformation * glm::vec4(otherVertexData[idx], otherVertexData[idx + 1],
+                                                             otherVertexData[idx + 2], 1.0f) + translation;
+
+      if (containsInBoxSpace(glm::vec3(pointInBoxSpace))) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  bool BoundingBoxSet::collidesWith(const Placement &placement, const BoundingBoxSet &otherBoxSet,
+                                    const Placement &otherPlacement, CollisionMode mode, CollisionCache &cache) const {
+    if (cache.boxSet != this || cache.otherBoxSet != &otherBoxSet || cache.version != version ||
+        cache.otherVersion != otherBoxSet.version) {
+      unsigned int fullChecks = cache.fullChecks;
+      cache.reset();
+      cache.fullChecks = fullChecks;
+      cache.boxSet = this;
+      cache.otherBoxSet = &otherBoxSet;
+      cache.version = version;
+      cache.otherVersion = otherBoxSet.version;
+    }
+
+    if (cache.separated) {
+      // The sets cannot have closed the gap between them without moving further than its width
+      if (getMaxMovement(cache.placement, placement) +
+          otherBoxSet.getMaxMovement(cache.otherPlacement, otherPlacement) < cache.gap) {
+        return false;
+      }
+
+      float gap = getGapAlongAxis(placement, getRotation(placement), otherBoxSet, otherPlacement,
+                                  getRotation(otherPlacement), cache.axis);
+      if (gap > 0.0f) {
+        cache.gap = gap;
+        cache.placement = placement;
+        cache.otherPlacement = otherPlacement;
+        return false;
+      }
+
+      cache.separated = false;
+    }
+
+    if (mode == collisionorientedboxes && cache.box >= 0) {
+      if (boxPairCollides(placement, cache.box, otherBoxSet, otherPlacement, cache.otherBox)) {
+        return true;
+      }
+      cache.box = -1;
+      cache.otherBox = -1;
+    }
+
+    ++cache.fullChecks;
+
+    bool collides;
+    if (mode == collisionorientedboxes) {
+      collides = orientedBoxesCollideWith(placement, otherBoxSet, otherPlacement, cache.box, cache.otherBox);
+    }
+    else {
+      collides = collidesWith(placement, otherBoxSet, otherPlacement, collisionvertices);
+    }
+
+    if (!collides && findSeparatingAxis(placement, otherBoxSet, otherPlacement, cache.axis, cache.gap)) {
+      cache.separated = true;
+      cache.placement = placement;
+      cache.otherPlacement = otherPlacement;
+    }
+
     return collides;
   }
 
-  bool BoundingBoxSet::collidesWith(BoundingBoxSet &otherBoxSet) const {
+  bool BoundingBoxSet::sweptCollidesWith(const glm::vec3 &previousOffset, const BoundingBoxSet &otherBoxSet,
+                                         float &timeOfImpact) const {
+    return sweptCollidesWith(getPlacement(), previousOffset, otherBoxSet, otherBoxSet.getPlacement(), timeOfImpact);
+  }
+
+  bool BoundingBoxSet::sweptCollidesWith(const Placement &placement, const glm::vec3 &previousOffset,
+                                         const BoundingBoxSet &otherBoxSet, const Placement &otherPlacement,
+                                         float &timeOfImpact) const {
+    timeOfImpact = 1.0f;
+
+    if (otherBoxSet.boxTree.empty()) {
+      return false;
+    }
+
+    glm::vec3 movement = placement.offset - previousOffset;
+
+    // The boxes of this set are moved back to where they were at the start
+    glm::mat4x4 transformation = getTransformation(placement);
+    transformation[3] += glm::vec4(previousOffset - placement.offset, 0.0f);
+    glm::mat4x4 otherTransformation = otherBoxSet.getTransformation(otherPlacement);
+
+    glm::vec3 axes[3], otherAxes[3], scale, otherScale;
+    getBoxAxes(transformation, axes, scale);
+    getBoxAxes(otherTransformation, otherAxes, otherScale);
+
+    float r[3][3], absR[3][3];
+    getAxisProducts(axes, otherAxes, r, absR);
+
+    glm::vec3 u(glm::dot(movement, axes[0]), glm::dot(movement, axes[1]), glm::dot(movement, axes[2]));
+    float movementLengthSquared = glm::dot(movement, movement);
+
+    // The tree of the other set is queried with the extents of the space each box sweeps through
+    // (see orientedBoxesCollideWith)
+    glm::mat4x4 toOtherSetSpace = getInverseRotation(otherPlacement);
+    glm::vec3 axesInOtherSetSpace[3];
+    for (int i = 0; i < 3; ++i) {
+      axesInOtherSetSpace[i] = glm::vec3(toOtherSetSpace * glm::vec4(axes[i], 0.0f));
+    }
+    glm::vec3 movementInOtherSetSpace = glm::vec3(toOtherSetSpace * glm::vec4(movement, 0.0f));
+
     bool collides = false;
+    int stack[BOX_TREE_MAX_DEPTH + 1];
+
+    for (int idx = 0; idx < numBoxes && timeOfImpact > 0.0f; ++idx) {
+      glm::vec3 centre = glm::vec3(transformation * glm::vec4(boxCentres[idx], 1.0f));
+      glm::vec3 a = boxHalfSizes[idx] * scale;
+      float reach = glm::length(a);
+
+      glm::vec3 queryCentre = glm::vec3(toOtherSetSpace * glm::vec4(centre - otherPlacement.offset, 0.0f));
+      glm::vec3 queryHalfSize = glm::abs(axesInOtherSetSpace[0]) * a.x + glm::abs(axesInOtherSetSpace[1]) * a.y +
+        glm::abs(axesInOtherSetSpace[2]) * a.z;
+      glm::vec3 queryMinCoords = glm::min(queryCentre, queryCentre + movementInOtherSetSpace) - queryHalfSize;
+      glm::vec3 queryMaxCoords = glm::max(queryCentre, queryCentre + movementInOtherSetSpace) + queryHalfSize;
+
+      int stackSize = 0;
+      stack[stackSize++] = 0;
 
-    glm::mat4 rotationMatrix =
-        rotateZ(otherBoxSet.rotation.z) * rotateX(otherBoxSet.rotation.x) * rotateY(otherBoxSet.rotation.y);
+      while (stackSize > 0) {
+        int nodeIdx = stack[--stackSize];
+        const BoxTreeNode &node = otherBoxSet.boxTree[nodeIdx];
 
-    for (vector<vector<float> >::iterator vertex = otherBoxSet.vertices.begin();
-         vertex != otherBoxSet.vertices.end(); ++vertex) {
+        if (queryMinCoords.x > node.maxCoords.x || queryMaxCoords.x < node.minCoords.x ||
+            queryMinCoords.y > node.maxCoords.y || queryMaxCoords.y < node.minCoords.y ||
+            queryMinCoords.z > node.maxCoords.z || queryMaxCoords.z < node.minCoords.z) {
+          continue;
+        }
+
+        if (node.numBoxes == 0) {
+          stack[stackSize++] = node.secondChild;
+          stack[stackSize++] = nodeIdx + 1;
+          continue;
+        }
 
-      glm::vec4 otherCoords(vertex->at(0), vertex->at(1), vertex->at(2), 1.0f);
-      glm::vec4 rotatedOtherCoords;
+        for (int orderIdx = node.firstBox; orderIdx < node.firstBox + node.numBoxes; ++orderIdx) {
+          int otherIdx = otherBoxSet.boxTreeOrder[orderIdx];
+          glm::vec3 otherCentre = glm::vec3(otherTransformation * glm::vec4(otherBoxSet.boxCentres[otherIdx], 1.0f));
+          glm::vec3 b = otherBoxSet.boxHalfSizes[otherIdx] * otherScale;
 
-      rotatedOtherCoords =  rotationMatrix * otherBoxSet.rotationAdjustment * otherCoords;
+          glm::vec3 distance = otherCentre - centre;
 
-      rotatedOtherCoords.x += otherBoxSet.offset.x;
-      rotatedOtherCoords.y += otherBoxSet.offset.y;
-      rotatedOtherCoords.z += otherBoxSet.offset.z;
+          // Boxes whose centres never get closer than the sum of their half diagonals cannot overlap
+          float closestTime = movementLengthSquared > 0.0f ?
+            min(max(glm::dot(distance, movement) / movementLengthSquared, 0.0f), 1.0f) : 0.0f;
+          glm::vec3 closestDistance = distance - movement * closestTime;
+          float pairReach = reach + glm::length(b);
+          if (glm::dot(closestDistance, closestDistance) > pairReach * pairReach) continue;
 
-      if (collidesWith(glm::vec3(rotatedOtherCoords.x, rotatedOtherCoords.y, rotatedOtherCoords.z))) {
+          glm::vec3 t(glm::dot(distance, axes[0]), glm::dot(distance, axes[1]), glm::dot(distance, axes[2]));
 
-        collides = true;
-        break;
+          float time;
+          if (sweptOrientedBoxesOverlap(t, u, a, b, r, absR, timeOfImpact, time)) {
+            timeOfImpact = time;
+            collides = true;
+          }
+        }
       }
     }
 
     return collides;
   }
 
+  void BoundingBoxSet::getWorldExtents(glm::vec3 &minCoords, glm::vec3 &maxCoords) const {
+    getWorldExtents(getPlacement(), minCoords, maxCoords);
+  }
+
+  void BoundingBoxSet::getWorldExtents(const Placement &placement, glm::vec3 &minCoords, glm::vec3 &maxCoords) const {
+    glm::mat4x4 rotationMatrix = rotateZ(placement.rotation.z) * rotateX(placement.rotation.x) *
+      rotateY(placement.rotation.y);
+
+    glm::vec3 centre = 0.5f * (setMinCoords + setMaxCoords);
+    glm::vec3 halfSize = 0.5f * (setMaxCoords - setMinCoords);
+
+    glm::vec3 worldCentre = glm::vec3(rotationMatrix * glm::vec4(centre, 1.0f)) + placement.offset;
+
+    // The projection of the rotated box on each world axis
+    glm::vec3 worldHalfSize;
+    for (int i = 0; i < 3; ++i) {
+      worldHalfSize[i] = fabs(rotationMatrix[0][i]) * halfSize.x + fabs(rotationMatrix[1][i]) * halfSize.y +
+        fabs(rotationMatrix[2][i]) * halfSize.z;
+    }
+
+    minCoords = worldCentre - worldHalfSize;
+    maxCoords = worldCentre + worldHalfSize;
+  }
+
+  /**
+   * Slab test between a ray and an axis aligned box
+   * @param origin           The origin of the ray
+   * @param inverseDirection 1 divided by each coordinate of the direction of the ray
+   * @param minCoords        The minimum coordinates of the box
+   * @param maxCoords        The maximum coordinates of the box
+   * @param maxDistance      How far along the ray to look
+   * @param distance         The distance at which the ray enters the box (0 if it starts inside it)
+   * @return True if the ray hits the box, false otherwise
+   */
+  static bool intersectSlabs(const glm::vec3 &origin, const glm::vec3 &inverseDirection, const glm::vec3 &minCoords,
+                             const glm::vec3 &maxCoords, float maxDistance, float &distance) {
+    glm::vec3 t1 = (minCoords - origin) * inverseDirection;
+    glm::vec3 t2 = (maxCoords - origin) * inverseDirection;
+    glm::vec3 nearT = glm::min(t1, t2);
+    glm::vec3 farT = glm::max(t1, t2);
+    distance = max(max(nearT.x, nearT.y), max(nearT.z, 0.0f));
+    return distance <= min(min(farT.x, farT.y), min(farT.z, maxDistance));
+  }
+
+  bool BoundingBoxSet::transformRay(const Placement &placement, glm::vec3 &origin, glm::vec3 &direction) const {
+    glm::mat4x4 rotationMatrix = getInverseRotation(placement);
+    origin = glm::vec3(rotationMatrix * glm::vec4(origin - placement.offset, 0.0f));
+
+    float length = glm::length(direction);
+    if (length == 0.0f) {
+      direction = glm::vec3(1.0f, 1.0f, 1.0f);
+      return false;
+    }
+    glm::vec3 directionInBoxSpace = glm::vec3(rotationMatrix * glm::vec4(direction / length, 0.0f));
+
+    // Directions parallel to an axis are nudged, so that the slab tests do not multiply 0 by infinity
+    for (int i = 0; i < 3; ++i) {
+      if (fabs(directionInBoxSpace[i]) < 1e-20f) {
+        directionInBoxSpace[i] = directionInBoxSpace[i] < 0.0f ? -1e-20f : 1e-20f;
+      }
+      direction[i] = 1.0f / directionInBoxSpace[i];
+    }
+
+    return true;
+  }
+
+  void BoundingBoxSet::castRayInBoxSpace(const glm::vec3 &origin, const glm::vec3 &inverseDirection,
+                                         float maxDistance, RayHit &hit) const {
+    hit.boxIndex = -1;
+    hit.distance = maxDistance;
+
+    if (boxTree.empty()) {
+      return;
+    }
+
+    int stack[BOX_TREE_MAX_DEPTH + 1];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+      int nodeIdx = stack[--stackSize];
+      const BoxTreeNode &node = boxTree[nodeIdx];
+
+      // Nodes further than the closest box hit so far are skipped
+      float distance;
+      if (!intersectSlabs(origin, inverseDirection, node.minCoords, node.maxCoords, hit.distance, distance)) {
+        continue;
+      }
+
+      if (node.numBoxes == 0) {
+        stack[stackSize++] = node.secondChild;
+        stack[stackSize++] = nodeIdx + 1;
+        continue;
+      }
+
+      for (int idx = node.firstBox; idx < node.firstBox + node.numBoxes; ++idx) {
+        int box = boxTreeOrder[idx];
+        if (intersectSlabs(origin, inverseDirection, glm::vec3(boxMinX[box], boxMinY[box], boxMinZ[box]),
+                           glm::vec3(boxMaxX[box], boxMaxY[box], boxMaxZ[box]), hit.distance, distance) &&
+            (hit.boxIndex < 0 || distance < hit.distance)) {
+          hit.boxIndex = box;
+          hit.distance = distance;
+        }
+      }
+    }
+  }
+
+  void BoundingBoxSet::castRaysInBoxSpace(const vector<glm::vec3> &origins, const vector<glm::vec3> &inverseDirections,
+                                          const vector<float> &maxDistances, vector<RayHit> &hits) const {
+    size_t numRays = origins.size();
+    hits.resize(numRays);
+    size_t firstScalarRay = 0;
+
+#ifdef SMALL3D_SSE
+    if (!boxTree.empty()) {
+      // The rays are tested in groups of four, with the coordinates of each group in separate registers.
+      // A node of the tree is visited if any of the rays in the group might hit a box in it.
+      const __m128 zero = _mm_setzero_ps();
+      const __m128i noBox = _mm_set1_epi32(-1);
+      int stack[BOX_TREE_MAX_DEPTH + 1];
+
+      for (; firstScalarRay + 4 <= numRays; firstScalarRay += 4) {
+        const glm::vec3 *o = &origins[firstScalarRay];
+        const glm::vec3 *d = &inverseDirections[firstScalarRay];
+        __m128 originX = _mm_setr_ps(o[0].x, o[1].x, o[2].x, o[3].x);
+        __m128 originY = _mm_setr_ps(o[0].y, o[1].y, o[2].y, o[3].y);
+        __m128 originZ = _mm_setr_ps(o[0].z, o[1].z, o[2].z, o[3].z);
+        __m128 inverseDirectionX = _mm_setr_ps(d[0].x, d[1].x, d[2].x, d[3].x);
+        __m128 inverseDirectionY = _mm_setr_ps(d[0].y, d[1].y, d[2].y, d[3].y);
+        __m128 inverseDirectionZ = _mm_setr_ps(d[0].z, d[1].z, d[2].z, d[3].z);
+        __m128 closest = _mm_loadu_ps(&maxDistances[firstScalarRay]);
+        __m128i closestBox = noBox;
+
+        // Slab test of the four rays against a box, setting the entry distances and returning
+        // a mask of the rays that hit it
+        auto intersectSlabs4 = [&](float minX, float minY, float minZ, float maxX, float maxY, float maxZ,
+                                   __m128 &entry) {
+          __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minX), originX), inverseDirectionX);
+          __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maxX), originX), inverseDirectionX);
+          __m128 nearT = _mm_min_ps(t1, t2);
+          __m128 farT = _mm_max_ps(t1, t2);
+          t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minY), originY), inverseDirectionY);
+          t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maxY), originY), inverseDirectionY);
+          nearT = _mm_max_ps(nearT, _mm_min_ps(t1, t2));
+          farT = _mm_min_ps(farT, _mm_max_ps(t1, t2));
+          t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minZ), originZ), inverseDirectionZ);
+          t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maxZ), originZ), inverseDirectionZ);
+          nearT = _mm_max_ps(nearT, _mm_min_ps(t1, t2));
+          farT = _mm_min_ps(farT, _mm_max_ps(t1, t2));
+          entry = _mm_max_ps(nearT, zero);
+          return _mm_cmple_ps(entry, _mm_min_ps(farT, closest));
+        };
+
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+          int nodeIdx = stack[--stackSize];
+          const BoxTreeNode &node = boxTree[nodeIdx];
+
+          __m128 entry;
+          if (_mm_movemask_ps(intersectSlabs4(node.minCoords.x, node.minCoords.y, node.minCoords.z,
+                                              node.maxCoords.x, node.maxCoords.y, node.maxCoords.z, entry)) == 0) {
+            continue;
+          }
+
+          if (node.numBoxes == 0) {
+            stack[stackSize++] = node.secondChild;
+            stack[stackSize++] = nodeIdx + 1;
+            continue;
+          }
+
+          for (int idx = node.firstBox; idx < node.firstBox + node.numBoxes; ++idx) {
+            int box = boxTreeOrder[idx];
+            __m128 hitMask = intersectSlabs4(boxMinX[box], boxMinY[box], boxMinZ[box],
+                                             boxMaxX[box], boxMaxY[box], boxMaxZ[box], entry);
+            __m128 closer = _mm_or_ps(_mm_cmplt_ps(entry, closest),
+                                      _mm_castsi128_ps(_mm_cmpeq_epi32(closestBox, noBox)));
+            __m128 update = _mm_and_ps(hitMask, closer);
+            closest = _mm_or_ps(_mm_and_ps(update, entry), _mm_andnot_ps(update, closest));
+            __m128i updateBox = _mm_castps_si128(update);
+            closestBox = _mm_or_si128(_mm_and_si128(updateBox, _mm_set1_epi32(box)),
+                                      _mm_andnot_si128(updateBox, closestBox));
+          }
+        }
+
+        float closestValues[4];
+        int closestBoxValues[4];
+        _mm_storeu_ps(closestValues, closest);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(closestBoxValues), closestBox);
+        for (int ray = 0; ray < 4; ++ray) {
+          hits[firstScalarRay + ray].boxIndex = closestBoxValues[ray];
+          hits[firstScalarRay + ray].distance = closestValues[ray];
+        }
+      }
+    }
+#endif
+
+    for (size_t ray = firstScalarRay; ray < numRays; ++ray) {
+      castRayInBoxSpace(origins[ray], inverseDirections[ray], maxDistances[ray], hits[ray]);
+    }
+  }
+
+  bool BoundingBoxSet::castRay(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit,
+                               float maxDistance) const {
+    return castRay(getPlacement(), origin, direction, hit, maxDistance);
+  }
+
+  bool BoundingBoxSet::castRay(const Placement &placement, const glm::vec3 &origin, const glm::vec3 &direction,
+                               RayHit &hit, float maxDistance) const {
+    glm::vec3 originInBoxSpace = origin;
+    glm::vec3 inverseDirection = direction;
+
+    if (!transformRay(placement, originInBoxSpace, inverseDirection)) {
+      maxDistance = 0.0f;
+    }
+
+    castRayInBoxSpace(originInBoxSpace, inverseDirection, maxDistance, hit);
+    return hit.boxIndex >= 0;
+  }
+
+  bool BoundingBoxSet::intersectsSegment(const glm::vec3 &start, const glm::vec3 &end, RayHit &hit) const {
+    return intersectsSegment(getPlacement(), start, end, hit);
+  }
+
+  bool BoundingBoxSet::intersectsSegment(const Placement &placement, const glm::vec3 &start, const glm::vec3 &end,
+                                         RayHit &hit) const {
+    return castRay(placement, start, end - start, hit, glm::length(end - start));
+  }
+
+  void BoundingBoxSet::castRays(const vector<glm::vec3> &origins, const vector<glm::vec3> &directions,
+                                vector<RayHit> &hits, float maxDistance) const {
+    castRays(getPlacement(), origins, directions, hits, maxDistance);
+  }
+
+  void BoundingBoxSet::castRays(const Placement &placement, const vector<glm::vec3> &origins,
+                                const vector<glm::vec3> &directions, vector<RayHit> &hits, float maxDistance) const {
+    if (origins.size() != directions.size()) {
+      throw Exception("The number of ray origins and directions is not the same.");
+    }
+
+    vector<glm::vec3> originsInBoxSpace(origins);
+    vector<glm::vec3> inverseDirections(directions);
+    vector<float> maxDistances(origins.size(), maxDistance);
+
+    for (size_t ray = 0; ray < origins.size(); ++ray) {
+      if (!transformRay(placement, originsInBoxSpace[ray], inverseDirections[ray])) {
+        maxDistances[ray] = 0.0f;
+      }
+    }
+
+    castRaysInBoxSpace(originsInBoxSpace, inverseDirections, maxDistances, hits);
+  }
+
+  void BoundingBoxSet::intersectSegments(const vector<glm::vec3> &starts, const vector<glm::vec3> &ends,
+                                         vector<RayHit> &hits) const {
+    intersectSegments(getPlacement(), starts, ends, hits);
+  }
+
+  void BoundingBoxSet::intersectSegments(const Placement &placement, const vector<glm::vec3> &starts,
+                                         const vector<glm::vec3> &ends, vector<RayHit> &hits) const {
+    if (starts.size() != ends.size()) {
+      throw Exception("The number of segment starts and ends is not the same.");
+    }
+
+    vector<glm::vec3> originsInBoxSpace(starts);
+    vector<glm::vec3> inverseDirections(starts.size());
+    vector<float> maxDistances(starts.size());
+
+    for (size_t segment = 0; segment < starts.size(); ++segment) {
+      inverseDirections[segment] = ends[segment] - starts[segment];
+      maxDistances[segment] = glm::length(inverseDirections[segment]);
+      transformRay(placement, originsInBoxSpace[segment], inverseDirections[segment]);
+    }
+
+    castRaysInBoxSpace(originsInBoxSpace, inverseDirections, maxDistances, hits);
+  }
+
   int BoundingBoxSet::getNumBoxes() const {
     return numBoxes;
   }
@@ -0,0 +1,347 @@
+/*
+ *  CollisionWorld.cpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#include "CollisionWorld.hpp"
+#include "Exception.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace small3d {
+
+  const size_t CollisionWorld::PAIRS_PER_TASK;
+
+  CollisionPair::CollisionPair() {
+    first = nullptr;
+    second = nullptr;
+    colliding = false;
+    cache = nullptr;
+  }
+
+  CollisionWorld::CollisionWorld(CollisionMode mode, unsigned int numThreads) {
+    this->mode = mode;
+    axis = 0;
+    sorted = true;
+    stopping = false;
+    batch = nullptr;
+    batchSize = 0;
+    nextPair = 0;
+    batchNumber = 0;
+    busyWorkers = 0;
+    numDetections = 0;
+    setNumThreads(numThreads);
+  }
+
+  CollisionWorld::~CollisionWorld() {
+    stopWorkers();
+  }
+
+  void CollisionWorld::setNumThreads(unsigned int numThreads) {
+    stopWorkers();
+    if (numThreads == 0) {
+      numThreads = thread::hardware_concurrency();
+    }
+    this->numThreads = max(numThreads, 1u);
+  }
+
+  unsigned int CollisionWorld::getNumThreads() const {
+    return numThreads;
+  }
+
+  void CollisionWorld::startWorkers() {
+    stopping = false;
+    for (unsigned int idx = 1; idx < numThreads; ++idx) {
+      workers.push_back(thread(&CollisionWorld::work, this, batchNumber));
+    }
+  }
+
+  void CollisionWorld::stopWorkers() {
+    if (workers.empty()) {
+      return;
+    }
+
+    {
+      lock_guard<mutex> lock(workMutex);
+      stopping = true;
+    }
+    workCondition.notify_all();
+
+    for (thread &worker : workers) {
+      worker.join();
+    }
+    workers.clear();
+  }
+
+  void CollisionWorld::add(SceneObject &object) {
+    if (object.boundingBoxSet.vertices.size() == 0) {
+      throw Exception("No bounding boxes have been provided for " + object.getName() +
+                      ", so it cannot be added to the collision world.");
+    }
+
+    for (const Entry &entry : entries) {
+      if (entry.object == &object) {
+        throw Exception(object.getName() + " is already in the collision world.");
+      }
+    }
+
+    Entry entry;
+    entry.object = &object;
+    entry.minCoords = glm::vec3(0.0f, 0.0f, 0.0f);
+    entry.maxCoords = glm::vec3(0.0f, 0.0f, 0.0f);
+    entries.push_back(entry);
+
+    // The endpoints are put in place the next time they are sorted. Since many objects
+    // are often added at once, they are then sorted from scratch.
+    sorted = false;
+    Endpoint endpoint;
+    endpoint.value = 0.0f;
+    endpoint.entry = static_cast<unsigned int>(entries.size() - 1);
+    endpoint.isMax = false;
+    endpoints.push_back(endpoint);
+    endpoint.isMax = true;
+    endpoints.push_back(endpoint);
+  }
+
+  void CollisionWorld::remove(SceneObject &object) {
+    unsigned int removedEntry = 0;
+    while (removedEntry < entries.size() && entries[removedEntry].object != &object) {
+      ++removedEntry;
+    }
+
+    if (removedEntry == entries.size()) {
+      throw Exception(object.getName() + " is not in the collision world.");
+    }
+
+    entries.erase(entries.begin() + removedEntry);
+
+    // Another object could take the place of this one in memory
+    for (auto pairCache = pairCaches.begin(); pairCache != pairCaches.end();) {
+      if (pairCache->first.first == &object || pairCache->first.second == &object) {
+        pairCache = pairCaches.erase(pairCache);
+      }
+      else {
+        ++pairCache;
+      }
+    }
+
+    size_t kept = 0;
+    for (const Endpoint &endpoint : endpoints) {
+      if (endpoint.entry != removedEntry) {
+        endpoints[kept] = endpoint;
+        if (endpoints[kept].entry > removedEntry) --endpoints[kept].entry;
+        ++kept;
+      }
+    }
+    endpoints.resize(kept);
+  }
+
+  size_t CollisionWorld::getNumObjects() const {
+    return entries.size();
+  }
+
+  void CollisionWorld::updateExtents() {
+    glm::vec3 sum(0.0f, 0.0f, 0.0f), sumOfSquares(0.0f, 0.0f, 0.0f);
+
+    for (Entry &entry : entries) {
+      entry.object->boundingBoxSet.getWorldExtents(entry.object->getPlacement(), entry.minCoords, entry.maxCoords);
+
+      glm::vec3 centre = 0.5f * (entry.minCoords + entry.maxCoords);
+      sum += centre;
+      sumOfSquares += centre * centre;
+    }
+
+    // Sweeping along the axis on which the objects are most spread out leaves the fewest
+    // overlaps to check on the other two. The axis is only changed when another one is
+    // clearly better, because the endpoints then have to be sorted from scratch.
+    if (!entries.empty()) {
+      float numEntries = static_cast<float>(entries.size());
+      glm::vec3 variance = sumOfSquares / numEntries - (sum / numEntries) * (sum / numEntries);
+      int bestAxis = variance.x >= variance.y && variance.x >= variance.z ? 0 : (variance.y >= variance.z ? 1 : 2);
+      if (variance[bestAxis] > 1.5f * variance[axis]) {
+        axis = bestAxis;
+        sorted = false;
+      }
+    }
+
+    for (Endpoint &endpoint : endpoints) {
+      const Entry &entry = entries[endpoint.entry];
+      endpoint.value = endpoint.isMax ? entry.maxCoords[axis] : entry.minCoords[axis];
+    }
+  }
+
+  void CollisionWorld::sortEndpoints() {
+    // Minimums come before maximums with the same value, so that extents which only touch
+    // are considered to overlap.
+    auto comesBefore = [](const Endpoint &a, const Endpoint &b) {
+      return a.value < b.value || (a.value == b.value && !a.isMax && b.isMax);
+    };
+
+    if (!sorted) {
+      sort(endpoints.begin(), endpoints.end(), comesBefore);
+      sorted = true;
+      return;
+    }
+
+    // Insertion sort, which is fast for endpoints that are nearly in order already
+    for (size_t idx = 1; idx < endpoints.size(); ++idx) {
+      Endpoint endpoint = endpoints[idx];
+      size_t position = idx;
+      while (position > 0 && comesBefore(endpoint, endpoints[position - 1])) {
+        endpoints[position] = endpoints[position - 1];
+        --position;
+      }
+      endpoints[position] = endpoint;
+    }
+  }
+
+  const vector<CollisionPair>& CollisionWorld::detectCollisions() {
+    pairs.clear();
+    ++numDetections;
+
+    updateExtents();
+    sortEndpoints();
+
+    int otherAxis1 = (axis + 1) % 3, otherAxis2 = (axis + 2) % 3;
+
+    activeEntries.clear();
+    for (const Endpoint &endpoint : endpoints) {
+      if (endpoint.isMax) {
+        for (size_t idx = 0; idx < activeEntries.size(); ++idx) {
+          if (activeEntries[idx] == endpoint.entry) {
+            activeEntries[idx] = activeEntries.back();
+            activeEntries.pop_back();
+            break;
+          }
+        }
+        continue;
+      }
+
+      const Entry &entry = entries[endpoint.entry];
+      for (unsigned int activeEntry : activeEntries) {
+        const Entry &other = entries[activeEntry];
+        if (entry.minCoords[otherAxis1] <= other.maxCoords[otherAxis1] &&
+            other.minCoords[otherAxis1] <= entry.maxCoords[otherAxis1] &&
+            entry.minCoords[otherAxis2] <= other.maxCoords[otherAxis2] &&
+            other.minCoords[otherAxis2] <= entry.maxCoords[otherAxis2]) {
+          // The objects of a pair are always in the same order, so that its cache can be used
+          CollisionPair pair;
+          pair.first = other.object;
+          pair.second = entry.object;
+          if (less<const SceneObject*>()(pair.second, pair.first)) {
+            swap(pair.first, pair.second);
+          }
+          PairCache &pairCache = pairCaches[make_pair(pair.first, pair.second)];
+          pairCache.lastUsed = numDetections;
+          pair.cache = &pairCache.cache;
+          pairs.push_back(pair);
+        }
+      }
+      activeEntries.push_back(endpoint.entry);
+    }
+
+    // The caches of pairs whose extents no longer overlap are dropped
+    for (auto pairCache = pairCaches.begin(); pairCache != pairCaches.end();) {
+      if (pairCache->second.lastUsed != numDetections) {
+        pairCache = pairCaches.erase(pairCache);
+      }
+      else {
+        ++pairCache;
+      }
+    }
+
+    checkPairs(pairs);
+
+    return pairs;
+  }
+
+  void CollisionWorld::checkPairs(vector<CollisionPair> &pairs) {
+    batch = pairs.empty() ? nullptr : &pairs[0];
+    batchSize = pairs.size();
+    nextPair = 0;
+    batchError = nullptr;
+
+    // Small batches are not worth waking the workers up for
+    if (numThreads == 1 || batchSize < 2 * PAIRS_PER_TASK) {
+      checkBatch();
+    }
+    else {
+      if (workers.empty()) {
+        startWorkers();
+      }
+
+      {
+        lock_guard<mutex> lock(workMutex);
+        ++batchNumber;
+        busyWorkers = static_cast<unsigned int>(workers.size());
+      }
+      workCondition.notify_all();
+
+      checkBatch();
+
+      unique_lock<mutex> lock(workMutex);
+      doneCondition.wait(lock, [this] { return busyWorkers == 0; });
+    }
+
+    batch = nullptr;
+    batchSize = 0;
+
+    if (batchError) {
+      exception_ptr error = batchError;
+      batchError = nullptr;
+      rethrow_exception(error);
+    }
+  }
+
+  void CollisionWorld::checkBatch() {
+    while (true) {
+      size_t first = nextPair.fetch_add(PAIRS_PER_TASK);
+      if (first >= batchSize) {
+        return;
+      }
+      size_t last = min(first + PAIRS_PER_TASK, batchSize);
+
+      try {
+        for (size_t idx = first; idx < last; ++idx) {
+          CollisionPair &pair = batch[idx];
+          pair.colliding = pair.cache == nullptr ? pair.first->collidesWith(*pair.second, mode) :
+            pair.first->collidesWith(*pair.second, *pair.cache, mode);
+        }
+      }
+      catch (...) {
+        lock_guard<mutex> lock(workMutex);
+        if (!batchError) {
+          batchError = current_exception();
+        }
+        nextPair = batchSize;
+      }
+    }
+  }
+
+  void CollisionWorld::work(unsigned int lastBatchNumber) {
+    while (true) {
+      {
+        unique_lock<mutex> lock(workMutex);
+        workCondition.wait(lock, [this, lastBatchNumber] { return stopping || batchNumber != lastBatchNumber; });
+        if (stopping) {
+          return;
+        }
+        lastBatchNumber = batchNumber;
+      }
+
+      checkBatch();
+
+      bool lastWorker;
+      {
+        lock_guard<mutex> lock(workMutex);
+        lastWorker = --busyWorkers == 0;
+      }
+      if (lastWorker) {
+        doneCondition.notify_all();
+      }
+    }
+  }
+
+}
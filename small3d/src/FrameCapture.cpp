@@ -0,0 +1,307 @@
+/*
+ *  FrameCapture.cpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#include "FrameCapture.hpp"
+#include "Exception.hpp"
+#include <png.h>
+#include <zlib.h>
+#include <cstring>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+namespace small3d {
+
+  FrameCapture::FrameCapture(GLStateCache &stateCache, const string &path, FrameCaptureFormat format,
+                             int width, int height, int frameRate, bool useFences) : stateCache(stateCache) {
+    this->path = path;
+    this->format = format;
+    this->width = width;
+    this->height = height;
+    this->useFences = useFences;
+    frameNumber = 0;
+    stopping = false;
+    y4mFile = nullptr;
+
+    if (width <= 0 || height <= 0) {
+      throw Exception("Cannot capture frames of size " + to_string(width) + "x" + to_string(height));
+    }
+
+    if (format == framecapturey4m) {
+      y4mFile = fopen(path.c_str(), "wb");
+      if (!y4mFile) {
+        throw Exception("Could not open file " + path + " for writing");
+      }
+      // Full range BT.601 colours, with the chroma sampled at the centre of each 2x2 block
+      fprintf(y4mFile, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, frameRate);
+    }
+
+    glGenBuffers(RING_SIZE, pixelBufferObjectIds);
+    for (int slot = 0; slot < RING_SIZE; ++slot) {
+      stateCache.bindBuffer(GL_PIXEL_PACK_BUFFER, pixelBufferObjectIds[slot]);
+      glBufferData(GL_PIXEL_PACK_BUFFER, 4 * width * height, nullptr, GL_STREAM_READ);
+      fences[slot] = nullptr;
+      pending[slot] = false;
+      pendingFrameNumbers[slot] = 0;
+    }
+    stateCache.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    worker = thread(&FrameCapture::work, this);
+  }
+
+  FrameCapture::~FrameCapture() {
+    if (worker.joinable()) {
+      {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+      }
+      queueCondition.notify_all();
+      worker.join();
+    }
+
+    if (y4mFile) {
+      fclose(y4mFile);
+    }
+  }
+
+  void FrameCapture::capture() {
+    {
+      lock_guard<mutex> lock(queueMutex);
+      if (!workerError.empty()) {
+        throw Exception(workerError);
+      }
+    }
+
+    int slot = frameNumber % RING_SIZE;
+
+    // The copy to the pixel buffer object is queued on the GPU and glReadPixels returns immediately.
+    stateCache.bindBuffer(GL_PIXEL_PACK_BUFFER, pixelBufferObjectIds[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    stateCache.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (useFences) {
+      fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    pending[slot] = true;
+    pendingFrameNumbers[slot] = frameNumber;
+    ++frameNumber;
+
+    // Read back the frame captured two frames ago, which should be ready by now.
+    int oldestSlot = (slot + 1) % RING_SIZE;
+    if (pending[oldestSlot]) {
+      readBack(oldestSlot);
+    }
+  }
+
+  void FrameCapture::readBack(int slot) {
+    if (useFences && fences[slot] != nullptr) {
+      while (glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+      glDeleteSync(fences[slot]);
+      fences[slot] = nullptr;
+    }
+
+    CapturedFrame frame;
+    frame.number = pendingFrameNumbers[slot];
+
+    {
+      unique_lock<mutex> lock(queueMutex);
+      queueCondition.wait(lock, [this] {
+          return queue.size() < MAX_QUEUED_FRAMES || !workerError.empty();
+        });
+      if (!sparePixels.empty()) {
+        frame.pixels.swap(sparePixels.back());
+        sparePixels.pop_back();
+      }
+    }
+
+    frame.pixels.resize(4 * width * height);
+
+    stateCache.bindBuffer(GL_PIXEL_PACK_BUFFER, pixelBufferObjectIds[slot]);
+    void *mappedPixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (mappedPixels == nullptr) {
+      stateCache.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      throw Exception("Could not map the pixels of captured frame " + to_string(frame.number));
+    }
+    memcpy(&frame.pixels[0], mappedPixels, frame.pixels.size());
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    stateCache.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pending[slot] = false;
+
+    {
+      lock_guard<mutex> lock(queueMutex);
+      queue.push_back(std::move(frame));
+    }
+    queueCondition.notify_all();
+  }
+
+  void FrameCapture::finish() {
+    if (!worker.joinable()) return;
+
+    // Read back the remaining frames in the order in which they were captured
+    for (unsigned long n = 0; n < RING_SIZE; ++n) {
+      int slot = (frameNumber + n) % RING_SIZE;
+      if (pending[slot]) {
+        readBack(slot);
+      }
+    }
+
+    {
+      lock_guard<mutex> lock(queueMutex);
+      stopping = true;
+    }
+    queueCondition.notify_all();
+    worker.join();
+
+    stateCache.deleteBuffers(RING_SIZE, pixelBufferObjectIds);
+
+    if (y4mFile) {
+      fclose(y4mFile);
+      y4mFile = nullptr;
+    }
+
+    if (!workerError.empty()) {
+      throw Exception(workerError);
+    }
+  }
+
+  unsigned long FrameCapture::getFrameCount() const {
+    return frameNumber;
+  }
+
+  void FrameCapture::work() {
+    while (true) {
+      CapturedFrame frame;
+      bool failed;
+
+      {
+        unique_lock<mutex> lock(queueMutex);
+        queueCondition.wait(lock, [this] { return !queue.empty() || stopping; });
+        if (queue.empty()) break;
+        frame = std::move(queue.front());
+        queue.pop_front();
+        failed = !workerError.empty();
+      }
+
+      string error;
+
+      if (!failed) {
+        try {
+          if (format == framecapturepng) {
+            writePng(frame);
+          }
+          else {
+            writeY4m(frame);
+          }
+        }
+        catch (Exception &e) {
+          error = e.what();
+        }
+      }
+
+      {
+        lock_guard<mutex> lock(queueMutex);
+        if (!error.empty()) {
+          workerError = error;
+        }
+        sparePixels.push_back(std::move(frame.pixels));
+      }
+      queueCondition.notify_all();
+    }
+  }
+
+  void FrameCapture::writePng(const CapturedFrame &frame) {
+    ostringstream fileName;
+    fileName << path << setfill('0') << setw(6) << frame.number << ".png";
+
+    FILE *fp = fopen(fileName.str().c_str(), "wb");
+    if (!fp) {
+      throw Exception("Could not open file " + fileName.str() + " for writing");
+    }
+
+    png_structp pngStructure = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop pngInformation = pngStructure ? png_create_info_struct(pngStructure) : nullptr;
+
+    if (!pngInformation) {
+      png_destroy_write_struct(&pngStructure, nullptr);
+      fclose(fp);
+      throw Exception("Could not create PNG write structure.");
+    }
+
+    if (setjmp(png_jmpbuf(pngStructure))) {
+      png_destroy_write_struct(&pngStructure, &pngInformation);
+      fclose(fp);
+      throw Exception("Could not write file " + fileName.str());
+    }
+
+    png_init_io(pngStructure, fp);
+    // Speed matters more than size, so that the worker thread keeps up with rendering.
+    png_set_compression_level(pngStructure, Z_BEST_SPEED);
+    png_set_IHDR(pngStructure, pngInformation, width, height, 8, PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(pngStructure, pngInformation);
+    png_set_filler(pngStructure, 0, PNG_FILLER_AFTER); // Drop the alpha values
+
+    // OpenGL stores the bottom row first
+    for (int y = height - 1; y >= 0; --y) {
+      png_write_row(pngStructure, const_cast<png_bytep>(&frame.pixels[4 * width * y]));
+    }
+
+    png_write_end(pngStructure, nullptr);
+    png_destroy_write_struct(&pngStructure, &pngInformation);
+    fclose(fp);
+  }
+
+  void FrameCapture::writeY4m(const CapturedFrame &frame) {
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    unsigned long lumaSize = static_cast<unsigned long>(width) * height;
+    unsigned long chromaSize = static_cast<unsigned long>(chromaWidth) * chromaHeight;
+
+    y4mPlanes.resize(lumaSize + 2 * chromaSize);
+    unsigned char *yPlane = &y4mPlanes[0];
+    unsigned char *uPlane = yPlane + lumaSize;
+    unsigned char *vPlane = uPlane + chromaSize;
+
+    for (int y = 0; y < height; ++y) {
+      const unsigned char *row = &frame.pixels[4 * width * (height - 1 - y)];
+      for (int x = 0; x < width; ++x) {
+        const unsigned char *p = row + 4 * x;
+        yPlane[y * width + x] = static_cast<unsigned char>((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+      }
+    }
+
+    for (int cy = 0; cy < chromaHeight; ++cy) {
+      for (int cx = 0; cx < chromaWidth; ++cx) {
+        int r = 0, g = 0, b = 0, count = 0;
+        for (int y = 2 * cy; y < 2 * cy + 2 && y < height; ++y) {
+          for (int x = 2 * cx; x < 2 * cx + 2 && x < width; ++x) {
+            const unsigned char *p = &frame.pixels[4 * (width * (height - 1 - y) + x)];
+            r += p[0];
+            g += p[1];
+            b += p[2];
+            ++count;
+          }
+        }
+        r /= count;
+        g /= count;
+        b /= count;
+        uPlane[cy * chromaWidth + cx] = static_cast<unsigned char>(min(255, (-43 * r - 85 * g + 128 * b + 32896) >> 8));
+        vPlane[cy * chromaWidth + cx] = static_cast<unsigned char>(min(255, (128 * r - 107 * g - 21 * b + 32896) >> 8));
+      }
+    }
+
+    if (fputs("FRAME\n", y4mFile) == EOF ||
+        fwrite(&y4mPlanes[0], 1, y4mPlanes.size(), y4mFile) != y4mPlanes.size()) {
+      throw Exception("Could not write frame " + to_string(frame.number) + " to " + path);
+    }
+  }
+
+}
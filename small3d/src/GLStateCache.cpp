@@ -0,0 +1,304 @@
+/*
+ *  GLStateCache.cpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#include "GLStateCache.hpp"
+
+using namespace std;
+
+namespace small3d {
+
+  // The element array buffer binding is part of the vertex array object state, so it is not
+  // in this list (see VertexArrayState).
+  static const GLenum BUFFER_TARGETS[] = {
+    GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_DRAW_INDIRECT_BUFFER,
+    GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GL_PIXEL_PACK_BUFFER
+  };
+
+  const GLuint GLStateCache::UNKNOWN;
+
+  unsigned long GLStateStatistics::getSkipped() const {
+    return skippedPrograms + skippedVertexArrays + skippedBuffers + skippedTextures +
+      skippedVertexAttributes + skippedCapabilities + skippedClearColours;
+  }
+
+  GLStateCache::VertexArrayState::VertexArrayState() {
+    elementArrayBuffer = UNKNOWN;
+    enabledAttributes = 0;
+    knownAttributes = 0;
+  }
+
+  GLStateCache::GLStateCache() {
+    vertexArraysSupported = true;
+    invalidate();
+    resetStatistics();
+  }
+
+  void GLStateCache::invalidate() {
+    program = UNKNOWN;
+    vertexArray = vertexArraysSupported ? UNKNOWN : 0;
+    vertexArrays.clear();
+    for (int idx = 0; idx < NUM_BUFFER_TARGETS; ++idx) {
+      buffers[idx] = UNKNOWN;
+    }
+    activeTextureUnit = UNKNOWN;
+    for (int idx = 0; idx < MAX_TEXTURE_UNITS; ++idx) {
+      textures[idx] = UNKNOWN;
+    }
+    blendEnabled = -1;
+    depthTestEnabled = -1;
+    cullFaceEnabled = -1;
+    blendSource = UNKNOWN;
+    blendDestination = UNKNOWN;
+    depthFunction = UNKNOWN;
+    depthWrites = -1;
+    cullFaceMode = UNKNOWN;
+    frontFaceMode = UNKNOWN;
+    clearColourKnown = false;
+  }
+
+  void GLStateCache::setVertexArraysSupported(bool vertexArraysSupported) {
+    this->vertexArraysSupported = vertexArraysSupported;
+    invalidate();
+  }
+
+  const GLStateStatistics& GLStateCache::getStatistics() const {
+    return statistics;
+  }
+
+  void GLStateCache::resetStatistics() {
+    statistics.issued = 0;
+    statistics.skippedPrograms = 0;
+    statistics.skippedVertexArrays = 0;
+    statistics.skippedBuffers = 0;
+    statistics.skippedTextures = 0;
+    statistics.skippedVertexAttributes = 0;
+    statistics.skippedCapabilities = 0;
+    statistics.skippedClearColours = 0;
+  }
+
+  bool GLStateCache::change(bool changed, unsigned long &skipped) {
+    if (changed) {
+      ++statistics.issued;
+    }
+    else {
+      ++skipped;
+    }
+    return changed;
+  }
+
+  int GLStateCache::getBufferTarget(GLenum target) const {
+    for (int idx = 0; idx < NUM_BUFFER_TARGETS; ++idx) {
+      if (BUFFER_TARGETS[idx] == target) return idx;
+    }
+    return -1;
+  }
+
+  int* GLStateCache::getCapability(GLenum capability) {
+    switch (capability) {
+    case GL_BLEND:
+      return &blendEnabled;
+    case GL_DEPTH_TEST:
+      return &depthTestEnabled;
+    case GL_CULL_FACE:
+      return &cullFaceEnabled;
+    default:
+      return nullptr;
+    }
+  }
+
+  GLStateCache::VertexArrayState* GLStateCache::getVertexArrayState() {
+    // Without vertex array objects (OpenGL 2.1), the state kept for object 0 is the global state.
+    return vertexArray == UNKNOWN ? nullptr : &vertexArrays[vertexArray];
+  }
+
+  void GLStateCache::useProgram(GLuint program) {
+    if (change(this->program != program, statistics.skippedPrograms)) {
+      glUseProgram(program);
+      this->program = program;
+    }
+  }
+
+  void GLStateCache::bindVertexArray(GLuint vertexArray) {
+    if (change(this->vertexArray != vertexArray, statistics.skippedVertexArrays)) {
+      glBindVertexArray(vertexArray);
+      this->vertexArray = vertexArray;
+    }
+  }
+
+  void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+    if (target == GL_ELEMENT_ARRAY_BUFFER) {
+      // If the bound vertex array object is not known, it is not known which one the binding goes to.
+      VertexArrayState *state = getVertexArrayState();
+      if (change(state == nullptr || state->elementArrayBuffer != buffer, statistics.skippedBuffers)) {
+        glBindBuffer(target, buffer);
+        if (state != nullptr) state->elementArrayBuffer = buffer;
+      }
+      return;
+    }
+
+    int idx = getBufferTarget(target);
+    if (change(idx < 0 || buffers[idx] != buffer, statistics.skippedBuffers)) {
+      glBindBuffer(target, buffer);
+      if (idx >= 0) buffers[idx] = buffer;
+    }
+  }
+
+  void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    glBindBufferBase(target, index, buffer);
+    ++statistics.issued;
+    int idx = getBufferTarget(target);
+    if (idx >= 0) buffers[idx] = buffer;
+  }
+
+  void GLStateCache::activeTexture(GLenum textureUnit) {
+    if (change(activeTextureUnit != textureUnit, statistics.skippedTextures)) {
+      glActiveTexture(textureUnit);
+      activeTextureUnit = textureUnit;
+    }
+  }
+
+  void GLStateCache::bindTexture(GLenum target, GLuint texture) {
+    int unit = activeTextureUnit == UNKNOWN ? -1 : static_cast<int>(activeTextureUnit - GL_TEXTURE0);
+    bool cached = target == GL_TEXTURE_2D && unit >= 0 && unit < MAX_TEXTURE_UNITS;
+    if (change(!cached || textures[unit] != texture, statistics.skippedTextures)) {
+      glBindTexture(target, texture);
+      if (cached) textures[unit] = texture;
+    }
+  }
+
+  void GLStateCache::enableVertexAttribArray(GLuint index) {
+    VertexArrayState *state = getVertexArrayState();
+    unsigned int bit = 1u << index;
+    bool known = state != nullptr && (state->knownAttributes & bit) != 0;
+    if (change(!known || (state->enabledAttributes & bit) == 0, statistics.skippedVertexAttributes)) {
+      glEnableVertexAttribArray(index);
+      if (state != nullptr) {
+        state->enabledAttributes |= bit;
+        state->knownAttributes |= bit;
+      }
+    }
+  }
+
+  void GLStateCache::disableVertexAttribArray(GLuint index) {
+    VertexArrayState *state = getVertexArrayState();
+    unsigned int bit = 1u << index;
+    bool known = state != nullptr && (state->knownAttributes & bit) != 0;
+    if (change(!known || (state->enabledAttributes & bit) != 0, statistics.skippedVertexAttributes)) {
+      glDisableVertexAttribArray(index);
+      if (state != nullptr) {
+        state->enabledAttributes &= ~bit;
+        state->knownAttributes |= bit;
+      }
+    }
+  }
+
+  void GLStateCache::enable(GLenum capability) {
+    int *state = getCapability(capability);
+    if (change(state == nullptr || *state != 1, statistics.skippedCapabilities)) {
+      glEnable(capability);
+      if (state != nullptr) *state = 1;
+    }
+  }
+
+  void GLStateCache::disable(GLenum capability) {
+    int *state = getCapability(capability);
+    if (change(state == nullptr || *state != 0, statistics.skippedCapabilities)) {
+      glDisable(capability);
+      if (state != nullptr) *state = 0;
+    }
+  }
+
+  void GLStateCache::blendFunc(GLenum source, GLenum destination) {
+    if (change(blendSource != source || blendDestination != destination, statistics.skippedCapabilities)) {
+      glBlendFunc(source, destination);
+      blendSource = source;
+      blendDestination = destination;
+    }
+  }
+
+  void GLStateCache::depthFunc(GLenum function) {
+    if (change(depthFunction != function, statistics.skippedCapabilities)) {
+      glDepthFunc(function);
+      depthFunction = function;
+    }
+  }
+
+  void GLStateCache::depthMask(GLboolean flag) {
+    int value = flag == GL_FALSE ? 0 : 1;
+    if (change(depthWrites != value, statistics.skippedCapabilities)) {
+      glDepthMask(flag);
+      depthWrites = value;
+    }
+  }
+
+  void GLStateCache::cullFace(GLenum mode) {
+    if (change(cullFaceMode != mode, statistics.skippedCapabilities)) {
+      glCullFace(mode);
+      cullFaceMode = mode;
+    }
+  }
+
+  void GLStateCache::frontFace(GLenum mode) {
+    if (change(frontFaceMode != mode, statistics.skippedCapabilities)) {
+      glFrontFace(mode);
+      frontFaceMode = mode;
+    }
+  }
+
+  void GLStateCache::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+    if (change(!clearColourKnown || clearColour[0] != red || clearColour[1] != green ||
+               clearColour[2] != blue || clearColour[3] != alpha, statistics.skippedClearColours)) {
+      glClearColor(red, green, blue, alpha);
+      clearColour[0] = red;
+      clearColour[1] = green;
+      clearColour[2] = blue;
+      clearColour[3] = alpha;
+      clearColourKnown = true;
+    }
+  }
+
+  void GLStateCache::deleteBuffers(GLsizei count, const GLuint *bufferIds) {
+    glDeleteBuffers(count, bufferIds);
+
+    for (GLsizei n = 0; n < count; ++n) {
+      GLuint buffer = bufferIds[n];
+      if (buffer == 0) continue;
+
+      // Deleting a buffer unbinds it from the targets of the context and from the bound vertex
+      // array object, but not from other vertex array objects, which still use it.
+      for (int idx = 0; idx < NUM_BUFFER_TARGETS; ++idx) {
+        if (buffers[idx] == buffer) buffers[idx] = 0;
+      }
+      for (auto &idStatePair : vertexArrays) {
+        if (idStatePair.second.elementArrayBuffer == buffer) {
+          idStatePair.second.elementArrayBuffer = idStatePair.first == vertexArray ? 0 : UNKNOWN;
+        }
+      }
+    }
+  }
+
+  void GLStateCache::deleteTextures(GLsizei count, const GLuint *textureIds) {
+    glDeleteTextures(count, textureIds);
+
+    for (GLsizei n = 0; n < count; ++n) {
+      if (textureIds[n] == 0) continue;
+      for (int idx = 0; idx < MAX_TEXTURE_UNITS; ++idx) {
+        if (textures[idx] == textureIds[n]) textures[idx] = 0;
+      }
+    }
+  }
+
+  void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint *vertexArrayIds) {
+    glDeleteVertexArrays(count, vertexArrayIds);
+
+    for (GLsizei n = 0; n < count; ++n) {
+      if (vertexArrayIds[n] == 0) continue;
+      vertexArrays.erase(vertexArrayIds[n]);
+      if (vertexArray == vertexArrayIds[n]) vertexArray = 0;
+    }
+  }
+
+}
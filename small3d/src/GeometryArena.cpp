@@ -0,0 +1,360 @@
+/*
+ *  GeometryArena.cpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#include "GeometryArena.hpp"
+#include "Exception.hpp"
+#include "MathFunctions.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace small3d {
+
+  const int GeometryArena::VERTEX_STRIDE;
+
+  GeometryArena::FreeList::FreeList(unsigned long capacity) {
+    this->capacity = capacity;
+    reset(0);
+  }
+
+  bool GeometryArena::FreeList::allocate(unsigned long size, unsigned long &position) {
+    if (size == 0) {
+      position = 0;
+      return true;
+    }
+
+    // First fit
+    for (map<unsigned long, unsigned long>::iterator block = blocks.begin(); block != blocks.end(); ++block) {
+      if (block->second >= size) {
+        position = block->first;
+        unsigned long remainingSize = block->second - size;
+        blocks.erase(block);
+        if (remainingSize > 0) {
+          blocks[position + size] = remainingSize;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void GeometryArena::FreeList::free(unsigned long position, unsigned long size) {
+    if (size == 0) {
+      return;
+    }
+
+    map<unsigned long, unsigned long>::iterator block = blocks.insert(make_pair(position, size)).first;
+
+    // Merge with the next block
+    map<unsigned long, unsigned long>::iterator next = block;
+    ++next;
+    if (next != blocks.end() && block->first + block->second == next->first) {
+      block->second += next->second;
+      blocks.erase(next);
+    }
+
+    // Merge with the previous block
+    if (block != blocks.begin()) {
+      map<unsigned long, unsigned long>::iterator previous = block;
+      --previous;
+      if (previous->first + previous->second == block->first) {
+        previous->second += block->second;
+        blocks.erase(block);
+      }
+    }
+  }
+
+  void GeometryArena::FreeList::grow(unsigned long newCapacity) {
+    unsigned long oldCapacity = capacity;
+    capacity = newCapacity;
+    free(oldCapacity, newCapacity - oldCapacity);
+  }
+
+  void GeometryArena::FreeList::reset(unsigned long used) {
+    blocks.clear();
+    if (used < capacity) {
+      blocks[used] = capacity - used;
+    }
+  }
+
+  unsigned long GeometryArena::FreeList::getCapacity() const {
+    return capacity;
+  }
+
+  unsigned long GeometryArena::FreeList::getFreeSpace() const {
+    unsigned long freeSpace = 0;
+    for (const pair<const unsigned long, unsigned long> &block : blocks) {
+      freeSpace += block.second;
+    }
+    return freeSpace;
+  }
+
+  unsigned long GeometryArena::FreeList::getEnd() const {
+    if (!blocks.empty() && blocks.rbegin()->first + blocks.rbegin()->second == capacity) {
+      return blocks.rbegin()->first;
+    }
+    return capacity;
+  }
+
+  GeometryArena::GeometryArena(GLStateCache &stateCache, unsigned long vertexCapacity,
+                               unsigned long indexCapacity) :
+    stateCache(stateCache), vertexSpace(vertexCapacity), indexSpace(indexCapacity) {
+    initLogger();
+    nextHandle = 1;
+    vaoId = 0;
+    vertexBufferObjectId = 0;
+    indexBufferObjectId = 0;
+    fragmented = false;
+  }
+
+  void GeometryArena::createBuffers() {
+    glGenVertexArrays(1, &vaoId);
+
+    glGenBuffers(1, &vertexBufferObjectId);
+    stateCache.bindBuffer(GL_COPY_WRITE_BUFFER, vertexBufferObjectId);
+    glBufferData(GL_COPY_WRITE_BUFFER, vertexSpace.getCapacity() * VERTEX_STRIDE, nullptr, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &indexBufferObjectId);
+    stateCache.bindBuffer(GL_COPY_WRITE_BUFFER, indexBufferObjectId);
+    glBufferData(GL_COPY_WRITE_BUFFER, indexSpace.getCapacity() * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+
+    stateCache.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    setUpVertexArray();
+  }
+
+  void GeometryArena::reallocate(GLuint &bufferId, unsigned long newSize, const vector<BufferMove> &moves) {
+    GLuint newBufferId = 0;
+    glGenBuffers(1, &newBufferId);
+    stateCache.bindBuffer(GL_COPY_WRITE_BUFFER, newBufferId);
+    glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+
+    // The copies are made on the GPU, without the data passing through the CPU.
+    stateCache.bindBuffer(GL_COPY_READ_BUFFER, bufferId);
+    for (const BufferMove &move : moves) {
+      if (move.size > 0) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, move.from, move.to, move.size);
+      }
+    }
+
+    stateCache.bindBuffer(GL_COPY_READ_BUFFER, 0);
+    stateCache.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    stateCache.deleteBuffers(1, &bufferId);
+    bufferId = newBufferId;
+  }
+
+  void GeometryArena::setUpVertexArray() {
+    stateCache.bindVertexArray(vaoId);
+
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, vertexBufferObjectId);
+
+    // Attribute - vertex
+    stateCache.enableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, VERTEX_STRIDE, 0);
+
+    // Attribute - normals
+    stateCache.enableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_STRIDE, (void *) Model::INTERLEAVED_NORMAL_OFFSET);
+
+    // Attribute - texture coordinates
+    stateCache.enableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, VERTEX_STRIDE, (void *) Model::INTERLEAVED_UV_OFFSET);
+
+    stateCache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObjectId);
+
+    stateCache.bindVertexArray(0);
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  void GeometryArena::ensureSpace(FreeList &space, GLuint &bufferId, unsigned long elementSize,
+                                  unsigned long size, unsigned long &position) {
+    if (space.allocate(size, position)) {
+      return;
+    }
+
+    unsigned long oldCapacity = space.getCapacity();
+    unsigned long newCapacity = oldCapacity * 2;
+    while (newCapacity < oldCapacity + size) {
+      newCapacity *= 2;
+    }
+
+    LOGINFO("Growing geometry arena buffer to " + intToStr(static_cast<int>(newCapacity * elementSize)) + " bytes");
+
+    BufferMove move = {0, 0, oldCapacity * elementSize};
+    reallocate(bufferId, newCapacity * elementSize, vector<BufferMove>(1, move));
+    space.grow(newCapacity);
+    setUpVertexArray();
+
+    if (!space.allocate(size, position)) {
+      throw Exception("Failed to allocate space in geometry arena.");
+    }
+  }
+
+  unsigned int GeometryArena::add(const Model &model) {
+
+    if (vaoId == 0) {
+      createBuffers();
+    }
+    else if (fragmented) {
+      defragment();
+    }
+
+    const vector<float> *vertices = &model.interleavedData;
+    Model interleavedModel;
+
+    if (model.interleavedStride != VERTEX_STRIDE) {
+      interleavedModel = model;
+      interleavedModel.interleave(VERTEX_STRIDE);
+      vertices = &interleavedModel.interleavedData;
+    }
+
+    GeometryArenaAllocation allocation;
+    allocation.numVertices = vertices->size() * sizeof(float) / VERTEX_STRIDE;
+    allocation.numIndices = model.indexData.size();
+
+    ensureSpace(vertexSpace, vertexBufferObjectId, VERTEX_STRIDE, allocation.numVertices, allocation.firstVertex);
+    ensureSpace(indexSpace, indexBufferObjectId, sizeof(unsigned int), allocation.numIndices, allocation.firstIndex);
+
+    stateCache.bindBuffer(GL_COPY_WRITE_BUFFER, vertexBufferObjectId);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstVertex * VERTEX_STRIDE,
+                    allocation.numVertices * VERTEX_STRIDE, vertices->data());
+
+    // The indexes remain relative to the model's first vertex (see glDrawElementsBaseVertex)
+    stateCache.bindBuffer(GL_COPY_WRITE_BUFFER, indexBufferObjectId);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstIndex * sizeof(unsigned int),
+                    allocation.numIndices * sizeof(unsigned int), model.indexData.data());
+
+    stateCache.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    unsigned int handle = nextHandle++;
+    allocations.insert(make_pair(handle, allocation));
+
+    return handle;
+  }
+
+  void GeometryArena::remove(unsigned int handle) {
+    unordered_map<unsigned int, GeometryArenaAllocation>::iterator handleAllocationPair = allocations.find(handle);
+
+    if (handleAllocationPair == allocations.end()) {
+      return;
+    }
+
+    const GeometryArenaAllocation &allocation = handleAllocationPair->second;
+    vertexSpace.free(allocation.firstVertex, allocation.numVertices);
+    indexSpace.free(allocation.firstIndex, allocation.numIndices);
+    allocations.erase(handleAllocationPair);
+
+    // Free space before the end of the last allocation is only reusable by models small enough
+    // to fit in it, so compact the buffers when there is too much of it.
+    unsigned long vertexEnd = vertexSpace.getEnd();
+    unsigned long vertexHoles = vertexSpace.getFreeSpace() - (vertexSpace.getCapacity() - vertexEnd);
+    unsigned long indexEnd = indexSpace.getEnd();
+    unsigned long indexHoles = indexSpace.getFreeSpace() - (indexSpace.getCapacity() - indexEnd);
+
+    // This is done the next time the arena is used, so that removing many models at once
+    // only leads to a single defragmentation.
+    if (vertexHoles > vertexEnd / 4 || indexHoles > indexEnd / 4) {
+      fragmented = true;
+    }
+  }
+
+  const GeometryArenaAllocation& GeometryArena::getAllocation(unsigned int handle) const {
+    unordered_map<unsigned int, GeometryArenaAllocation>::const_iterator handleAllocationPair =
+      allocations.find(handle);
+
+    if (handleAllocationPair == allocations.end()) {
+      throw Exception("Geometry with handle " + intToStr(static_cast<int>(handle)) +
+                      " not found in the geometry arena.");
+    }
+
+    return handleAllocationPair->second;
+  }
+
+  void GeometryArena::defragment() {
+
+    fragmented = false;
+
+    if (vaoId == 0) {
+      return;
+    }
+
+    vector<GeometryArenaAllocation*> byVertex, byIndex;
+    for (pair<const unsigned int, GeometryArenaAllocation> &handleAllocationPair : allocations) {
+      byVertex.push_back(&handleAllocationPair.second);
+      byIndex.push_back(&handleAllocationPair.second);
+    }
+
+    sort(byVertex.begin(), byVertex.end(), [](const GeometryArenaAllocation *a, const GeometryArenaAllocation *b) {
+        return a->firstVertex < b->firstVertex;
+      });
+    sort(byIndex.begin(), byIndex.end(), [](const GeometryArenaAllocation *a, const GeometryArenaAllocation *b) {
+        return a->firstIndex < b->firstIndex;
+      });
+
+    vector<BufferMove> moves;
+    unsigned long position = 0;
+
+    for (GeometryArenaAllocation *allocation : byVertex) {
+      BufferMove move = {allocation->firstVertex * VERTEX_STRIDE, position * VERTEX_STRIDE,
+                         allocation->numVertices * VERTEX_STRIDE};
+      moves.push_back(move);
+      allocation->firstVertex = allocation->numVertices > 0 ? position : 0;
+      position += allocation->numVertices;
+    }
+
+    reallocate(vertexBufferObjectId, vertexSpace.getCapacity() * VERTEX_STRIDE, moves);
+    vertexSpace.reset(position);
+
+    moves.clear();
+    position = 0;
+
+    for (GeometryArenaAllocation *allocation : byIndex) {
+      BufferMove move = {allocation->firstIndex * sizeof(unsigned int), position * sizeof(unsigned int),
+                         allocation->numIndices * sizeof(unsigned int)};
+      moves.push_back(move);
+      allocation->firstIndex = allocation->numIndices > 0 ? position : 0;
+      position += allocation->numIndices;
+    }
+
+    reallocate(indexBufferObjectId, indexSpace.getCapacity() * sizeof(unsigned int), moves);
+    indexSpace.reset(position);
+
+    setUpVertexArray();
+
+    LOGINFO("Geometry arena defragmented");
+  }
+
+  void GeometryArena::bind() {
+    if (fragmented) {
+      defragment();
+    }
+    stateCache.bindVertexArray(vaoId);
+  }
+
+  void GeometryArena::deleteBuffers() {
+    if (vaoId != 0) {
+      stateCache.deleteVertexArrays(1, &vaoId);
+      stateCache.deleteBuffers(1, &vertexBufferObjectId);
+      stateCache.deleteBuffers(1, &indexBufferObjectId);
+      vaoId = 0;
+      vertexBufferObjectId = 0;
+      indexBufferObjectId = 0;
+    }
+    allocations.clear();
+    fragmented = false;
+    vertexSpace.reset(0);
+    indexSpace.reset(0);
+  }
+
+  unsigned long GeometryArena::getFreeVertices() const {
+    return vertexSpace.getFreeSpace();
+  }
+
+  unsigned long GeometryArena::getFreeIndices() const {
+    return indexSpace.getFreeSpace();
+  }
+
+}
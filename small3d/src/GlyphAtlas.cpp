@@ -0,0 +1,369 @@
+/*
+ *  GlyphAtlas.cpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#include "GlyphAtlas.hpp"
+#include "Exception.hpp"
+#include "MathFunctions.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace small3d {
+
+  // Empty pixels left to the right of and below each glyph, so that
+  // linear filtering does not pick up parts of neighbouring glyphs.
+  static const unsigned long GLYPH_PADDING = 1;
+
+  const unsigned long GlyphAtlas::SIGNED_DISTANCE_FIELD_SPREAD;
+
+  // Number of samples per pixel, in each dimension, used to locate the outline of a glyph
+  // when computing its signed distance field (must be even)
+  static const unsigned long SIGNED_DISTANCE_FIELD_SAMPLING = 4;
+
+  // Squared distance assigned to pixels that are not features, before the transform
+  static const float FAR_AWAY = 1e20f;
+
+  /**
+   * Exact squared euclidean distance transform of a single row or column
+   * (Felzenszwalb and Huttenlocher). On entry, distances[i] is 0 for feature
+   * positions and FAR_AWAY for all others. On return, it contains the squared
+   * distance from i to the nearest feature position.
+   */
+  static void distanceTransform1D(vector<float> &distances, vector<float> &values, vector<int> &parabolas,
+                                  vector<float> &boundaries) {
+    const float infinity = numeric_limits<float>::infinity();
+    int length = static_cast<int>(distances.size());
+    values = distances;
+
+    int k = 0;
+    parabolas[0] = 0;
+    boundaries[0] = -infinity;
+    boundaries[1] = infinity;
+
+    for (int q = 1; q < length; ++q) {
+      float s = ((values[q] + q * q) - (values[parabolas[k]] + parabolas[k] * parabolas[k])) /
+        (2.0f * q - 2.0f * parabolas[k]);
+      while (s <= boundaries[k]) {
+        --k;
+        s = ((values[q] + q * q) - (values[parabolas[k]] + parabolas[k] * parabolas[k])) /
+          (2.0f * q - 2.0f * parabolas[k]);
+      }
+      ++k;
+      parabolas[k] = q;
+      boundaries[k] = s;
+      boundaries[k + 1] = infinity;
+    }
+
+    k = 0;
+    for (int q = 0; q < length; ++q) {
+      while (boundaries[k + 1] < q) ++k;
+      distances[q] = static_cast<float>((q - parabolas[k]) * (q - parabolas[k])) + values[parabolas[k]];
+    }
+  }
+
+  /**
+   * Distance, in pixels, from each pixel of a grid to the nearest pixel for
+   * which features is true.
+   */
+  static void distanceTransform(const vector<bool> &features, unsigned long width, unsigned long height,
+                                vector<float> &result) {
+    unsigned long maxDimension = width > height ? width : height;
+    vector<float> line, values;
+    vector<int> parabolas(maxDimension);
+    vector<float> boundaries(maxDimension + 1);
+
+    result.resize(width * height);
+    for (unsigned long idx = 0; idx < width * height; ++idx) {
+      result[idx] = features[idx] ? 0.0f : FAR_AWAY;
+    }
+
+    line.resize(height);
+    for (unsigned long x = 0; x < width; ++x) {
+      for (unsigned long y = 0; y < height; ++y) line[y] = result[y * width + x];
+      distanceTransform1D(line, values, parabolas, boundaries);
+      for (unsigned long y = 0; y < height; ++y) result[y * width + x] = line[y];
+    }
+
+    line.resize(width);
+    for (unsigned long y = 0; y < height; ++y) {
+      for (unsigned long x = 0; x < width; ++x) line[x] = result[y * width + x];
+      distanceTransform1D(line, values, parabolas, boundaries);
+      for (unsigned long x = 0; x < width; ++x) {
+        result[y * width + x] = sqrt(line[x]);
+      }
+    }
+  }
+
+  /**
+   * Coverage of a glyph's bitmap at a position (in pixels, 0 being the centre of the
+   * first pixel), interpolated bilinearly, from 0 to 1.
+   */
+  static float coverage(const unsigned char *bitmap, unsigned long pitch, unsigned long width,
+                        unsigned long rows, float x, float y) {
+    float floorX = floor(x), floorY = floor(y);
+    long col = static_cast<long>(floorX), row = static_cast<long>(floorY);
+    float fractionX = x - floorX, fractionY = y - floorY;
+
+    float values[2][2];
+    for (long r = 0; r < 2; ++r) {
+      for (long c = 0; c < 2; ++c) {
+        bool withinBitmap = row + r >= 0 && row + r < static_cast<long>(rows) &&
+          col + c >= 0 && col + c < static_cast<long>(width);
+        values[r][c] = withinBitmap ? bitmap[(row + r) * pitch + col + c] / 255.0f : 0.0f;
+      }
+    }
+
+    return (values[0][0] * (1.0f - fractionX) + values[0][1] * fractionX) * (1.0f - fractionY) +
+      (values[1][0] * (1.0f - fractionX) + values[1][1] * fractionX) * fractionY;
+  }
+
+  GlyphAtlas::GlyphAtlas(GLStateCache &stateCache, unsigned long width, unsigned long height,
+                         unsigned long maxHeight) : stateCache(stateCache) {
+    initLogger();
+    this->width = width;
+    this->height = height;
+    this->maxHeight = maxHeight;
+    shelfX = 0;
+    shelfY = 0;
+    shelfHeight = 0;
+    dirtyTop = height;
+    dirtyBottom = 0;
+    generation = 0;
+    textureId = 0;
+    textureHeight = 0;
+    pixels.assign(width * height, 0);
+  }
+
+  void GlyphAtlas::allocate(AtlasGlyph &glyph) {
+    unsigned long paddedWidth = glyph.width + GLYPH_PADDING;
+    unsigned long paddedRows = glyph.rows + GLYPH_PADDING;
+
+    if (paddedWidth > width || paddedRows > maxHeight) {
+      throw Exception("Glyph is too large to fit in the glyph atlas.");
+    }
+
+    // Shelf packing: glyphs are placed next to each other in rows ("shelves")
+    // as high as the tallest glyph placed on them.
+    if (shelfX + paddedWidth > width) {
+      shelfY += shelfHeight;
+      shelfX = 0;
+      shelfHeight = 0;
+    }
+
+    // Since the glyph is not taller than maxHeight, this ends at the latest once the
+    // atlas has grown to maxHeight and has been reset.
+    while (shelfY + paddedRows > height) {
+      if (height >= maxHeight) {
+        LOGINFO("Glyph atlas full. Resetting it.");
+        glyphs.clear();
+        memset(&pixels[0], 0, pixels.size());
+        shelfX = 0;
+        shelfY = 0;
+        shelfHeight = 0;
+        dirtyTop = 0;
+        dirtyBottom = height;
+        ++generation;
+        continue;
+      }
+      // The pixels are stored row by row, so existing glyphs keep their positions.
+      height = height * 2 > maxHeight ? maxHeight : height * 2;
+      pixels.resize(width * height, 0);
+      LOGINFO("Glyph atlas height increased to " + intToStr(static_cast<int>(height)));
+    }
+
+    glyph.x = shelfX;
+    glyph.y = shelfY;
+
+    shelfX += paddedWidth;
+    if (shelfHeight < paddedRows) {
+      shelfHeight = paddedRows;
+    }
+  }
+
+  void GlyphAtlas::store(const AtlasGlyph &glyph, const unsigned char *bitmap, unsigned long pitch) {
+    for (unsigned long row = 0; row < glyph.rows; ++row) {
+      memcpy(&pixels[(glyph.y + row) * width + glyph.x], &bitmap[row * pitch], glyph.width);
+    }
+
+    if (dirtyTop > glyph.y) dirtyTop = glyph.y;
+    if (dirtyBottom < glyph.y + glyph.rows) dirtyBottom = glyph.y + glyph.rows;
+  }
+
+  AtlasGlyph GlyphAtlas::getGlyph(FT_Face face, int fontSize, unsigned long character, bool signedDistanceField) {
+    GlyphKey key = {face, fontSize, character, signedDistanceField};
+
+    auto keyGlyphPair = glyphs.find(key);
+
+    if (keyGlyphPair != glyphs.end()) {
+      return keyGlyphPair->second;
+    }
+
+    FT_Error error = FT_Load_Char(face, (FT_ULong) character, FT_LOAD_RENDER);
+
+    if (error != 0) {
+      throw Exception("Failed to load character glyph.");
+    }
+
+    FT_GlyphSlot slot = face->glyph;
+
+    AtlasGlyph glyph;
+    glyph.x = 0;
+    glyph.y = 0;
+    glyph.width = static_cast<unsigned long>(slot->bitmap.width);
+    glyph.rows = static_cast<unsigned long>(slot->bitmap.rows);
+    glyph.left = slot->bitmap_left;
+    glyph.top = slot->bitmap_top;
+    glyph.advance = slot->advance.x / 64;
+    glyph.padding = 0;
+
+    if (glyph.width * glyph.rows > 0) {
+
+      unsigned long pitch = static_cast<unsigned long>(abs(slot->bitmap.pitch));
+
+      if (signedDistanceField) {
+        unsigned long spread = SIGNED_DISTANCE_FIELD_SPREAD;
+        unsigned long fieldWidth = glyph.width + 2 * spread;
+        unsigned long fieldRows = glyph.rows + 2 * spread;
+
+        // The outline is located more precisely than the bitmap's pixels by computing the
+        // distances on a grid that samples the (bilinearly interpolated) bitmap at a higher
+        // resolution.
+        unsigned long sampleWidth = fieldWidth * SIGNED_DISTANCE_FIELD_SAMPLING;
+        unsigned long sampleRows = fieldRows * SIGNED_DISTANCE_FIELD_SAMPLING;
+        float sampling = static_cast<float>(SIGNED_DISTANCE_FIELD_SAMPLING);
+
+        vector<bool> inside(sampleWidth * sampleRows), outside(sampleWidth * sampleRows);
+
+        for (unsigned long sampleRow = 0; sampleRow < sampleRows; ++sampleRow) {
+          float y = (sampleRow + 0.5f) / sampling - 0.5f - spread;
+          for (unsigned long sampleCol = 0; sampleCol < sampleWidth; ++sampleCol) {
+            float x = (sampleCol + 0.5f) / sampling - 0.5f - spread;
+            bool covered = coverage(slot->bitmap.buffer, pitch, glyph.width, glyph.rows, x, y) >= 0.5f;
+            inside[sampleRow * sampleWidth + sampleCol] = covered;
+            outside[sampleRow * sampleWidth + sampleCol] = !covered;
+          }
+        }
+
+        vector<float> distanceToInside, distanceToOutside;
+        distanceTransform(inside, sampleWidth, sampleRows, distanceToInside);
+        distanceTransform(outside, sampleWidth, sampleRows, distanceToOutside);
+
+        vector<unsigned char> field(fieldWidth * fieldRows);
+
+        unsigned long centre = SIGNED_DISTANCE_FIELD_SAMPLING / 2;
+
+        for (unsigned long row = 0; row < fieldRows; ++row) {
+          for (unsigned long col = 0; col < fieldWidth; ++col) {
+            // Average the signed distances of the samples around the pixel's centre
+            float distance = 0.0f;
+            for (unsigned long sampleRow = row * SIGNED_DISTANCE_FIELD_SAMPLING + centre - 1;
+                 sampleRow <= row * SIGNED_DISTANCE_FIELD_SAMPLING + centre; ++sampleRow) {
+              for (unsigned long sampleCol = col * SIGNED_DISTANCE_FIELD_SAMPLING + centre - 1;
+                   sampleCol <= col * SIGNED_DISTANCE_FIELD_SAMPLING + centre; ++sampleCol) {
+                unsigned long idx = sampleRow * sampleWidth + sampleCol;
+                // Sample centres are half a sample away from the outline on either side
+                distance += inside[idx] ? distanceToOutside[idx] - 0.5f : 0.5f - distanceToInside[idx];
+              }
+            }
+            distance /= 4.0f * sampling;
+
+            float value = 0.5f + 0.5f * distance / spread;
+            if (value < 0.0f) value = 0.0f;
+            if (value > 1.0f) value = 1.0f;
+            field[row * fieldWidth + col] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+          }
+        }
+
+        glyph.width = fieldWidth;
+        glyph.rows = fieldRows;
+        glyph.left -= static_cast<int>(spread);
+        glyph.top += static_cast<int>(spread);
+        glyph.padding = spread;
+
+        allocate(glyph);
+        store(glyph, &field[0], fieldWidth);
+      }
+      else {
+        allocate(glyph);
+        store(glyph, slot->bitmap.buffer, pitch);
+      }
+    }
+
+    glyphs.insert(make_pair(key, glyph));
+
+    return glyph;
+  }
+
+  void GlyphAtlas::bind(bool isOpenGL33Supported) {
+
+    if (textureId == 0) {
+      glGenTextures(1, &textureId);
+      stateCache.bindTexture(GL_TEXTURE_2D, textureId);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      textureHeight = 0;
+    }
+    else {
+      stateCache.bindTexture(GL_TEXTURE_2D, textureId);
+    }
+
+    // Single channel. OpenGL 2.1 has no GL_RED textures, but luminance
+    // is also read from the red component in the shaders.
+    GLint internalFormat = isOpenGL33Supported ? GL_R8 : GL_LUMINANCE;
+    GLenum format = isOpenGL33Supported ? GL_RED : GL_LUMINANCE;
+
+    if (textureHeight != height) {
+      glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, static_cast<GLsizei>(width), static_cast<GLsizei>(height),
+                   0, format, GL_UNSIGNED_BYTE, &pixels[0]);
+      textureHeight = height;
+    }
+    else if (dirtyTop < dirtyBottom) {
+      // Only upload the rows that have changed
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, static_cast<GLint>(dirtyTop),
+                      static_cast<GLsizei>(width), static_cast<GLsizei>(dirtyBottom - dirtyTop),
+                      format, GL_UNSIGNED_BYTE, &pixels[dirtyTop * width]);
+    }
+
+    dirtyTop = height;
+    dirtyBottom = 0;
+  }
+
+  void GlyphAtlas::deleteTexture() {
+    if (textureId != 0) {
+      stateCache.deleteTextures(1, &textureId);
+      textureId = 0;
+    }
+    textureHeight = 0;
+    glyphs.clear();
+    memset(&pixels[0], 0, pixels.size());
+    shelfX = 0;
+    shelfY = 0;
+    shelfHeight = 0;
+    dirtyTop = height;
+    dirtyBottom = 0;
+    ++generation;
+  }
+
+  unsigned long GlyphAtlas::getWidth() const {
+    return width;
+  }
+
+  unsigned long GlyphAtlas::getHeight() const {
+    return height;
+  }
+
+  unsigned long GlyphAtlas::getGeneration() const {
+    return generation;
+  }
+
+}
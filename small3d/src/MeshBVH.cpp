@@ -0,0 +1,622 @@
+/*
+ *  MeshBVH.cpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#include "MeshBVH.hpp"
+#include "Exception.hpp"
+#include "Logger.hpp"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+namespace small3d {
+
+  static const char FILE_MAGIC[4] = {'S', 'B', 'V', 'H'};
+
+  const uint32_t MeshBVH::FILE_VERSION;
+
+  static float surfaceArea(const glm::vec3 &minCoords, const glm::vec3 &maxCoords) {
+    glm::vec3 size = maxCoords - minCoords;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+  }
+
+  /**
+   * Rotate a vector from world space to the space of a model
+   * @param transformation The transformation of the model (rotation and translation only, so
+   *                       the inverse of its rotation is its transpose)
+   * @param vector         The vector
+   * @return The vector in the space of the model
+   */
+  static glm::vec3 rotateToModelSpace(const glm::mat4x4 &transformation, const glm::vec3 &vector) {
+    return glm::vec3(glm::dot(glm::vec3(transformation[0]), vector),
+                     glm::dot(glm::vec3(transformation[1]), vector),
+                     glm::dot(glm::vec3(transformation[2]), vector));
+  }
+
+  /**
+   * Transform a point from world space to the space of a model
+   * @param transformation The transformation of the model (rotation and translation only)
+   * @param point          The point
+   * @return The point in the space of the model
+   */
+  static glm::vec3 toModelSpace(const glm::mat4x4 &transformation, const glm::vec3 &point) {
+    return rotateToModelSpace(transformation, point - glm::vec3(transformation[3]));
+  }
+
+  /**
+   * Slab test between a ray and an axis aligned box (see BoundingBoxSet)
+   * @return The distance at which the ray enters the box, or -1 if it does not hit it
+   */
+  static float intersectSlabs(const glm::vec3 &origin, const glm::vec3 &inverseDirection, const glm::vec3 &minCoords,
+                              const glm::vec3 &maxCoords, float maxDistance) {
+    glm::vec3 t1 = (minCoords - origin) * inverseDirection;
+    glm::vec3 t2 = (maxCoords - origin) * inverseDirection;
+    glm::vec3 nearT = glm::min(t1, t2);
+    glm::vec3 farT = glm::max(t1, t2);
+    float entry = max(max(nearT.x, nearT.y), max(nearT.z, 0.0f));
+    return entry <= min(min(farT.x, farT.y), min(farT.z, maxDistance)) ? entry : -1.0f;
+  }
+
+  /**
+   * Get the point of a triangle closest to a given point (from Real-Time Collision Detection,
+   * by Christer Ericson)
+   */
+  static glm::vec3 closestPointOnTriangle(const glm::vec3 &point, const glm::vec3 &a, const glm::vec3 &b,
+                                          const glm::vec3 &c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = point - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    glm::vec3 bp = point - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = point - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+      return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    float denominator = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+  }
+
+  /**
+   * Separating axis test between a triangle and an axis aligned box centred at the origin
+   * (Tomas Akenine-Möller's triangle-box overlap test)
+   */
+  static bool triangleOverlapsBox(const glm::vec3 v[3], const glm::vec3 &halfSize) {
+    // The axes of the box
+    for (int i = 0; i < 3; ++i) {
+      if (min(v[0][i], min(v[1][i], v[2][i])) > halfSize[i] ||
+          max(v[0][i], max(v[1][i], v[2][i])) < -halfSize[i]) return false;
+    }
+
+    // The plane of the triangle
+    glm::vec3 edges[3] = {v[1] - v[0], v[2] - v[1], v[0] - v[2]};
+    glm::vec3 normal = glm::cross(edges[0], edges[1]);
+    float reach = halfSize.x * fabs(normal.x) + halfSize.y * fabs(normal.y) + halfSize.z * fabs(normal.z);
+    if (fabs(glm::dot(normal, v[0])) > reach) return false;
+
+    // The cross products of the edges of the triangle with the axes of the box
+    for (int e = 0; e < 3; ++e) {
+      for (int i = 0; i < 3; ++i) {
+        int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+        // The cross product of axis i with the edge
+        glm::vec3 axis(0.0f, 0.0f, 0.0f);
+        axis[i1] = -edges[e][i2];
+        axis[i2] = edges[e][i1];
+        float p0 = glm::dot(axis, v[0]), p1 = glm::dot(axis, v[1]), p2 = glm::dot(axis, v[2]);
+        reach = halfSize[i1] * fabs(axis[i1]) + halfSize[i2] * fabs(axis[i2]);
+        if (min(p0, min(p1, p2)) > reach || max(p0, max(p1, p2)) < -reach) return false;
+      }
+    }
+
+    return true;
+  }
+
+  MeshBVH::MeshBVH() {
+    modelHash = 0;
+  }
+
+  MeshBVH::MeshBVH(const Model &model, const string &cacheFile) {
+    modelHash = 0;
+
+    if (!cacheFile.empty() && load(cacheFile, model)) {
+      return;
+    }
+
+    build(model);
+
+    if (!cacheFile.empty()) {
+      try {
+        save(cacheFile);
+      }
+      catch (Exception &e) {
+        // Not being able to save the hierarchy is not a reason to stop
+        LOGERROR(string(e.what()));
+      }
+    }
+  }
+
+  uint64_t MeshBVH::hashModel(const Model &model) {
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const void *data, size_t size) {
+      const unsigned char *bytes = static_cast<const unsigned char *>(data);
+      for (size_t idx = 0; idx < size; ++idx) {
+        hash ^= bytes[idx];
+        hash *= 1099511628211ULL;
+      }
+    };
+
+    uint64_t sizes[2] = {model.vertexData.size(), model.indexData.size()};
+    add(sizes, sizeof(sizes));
+    if (!model.vertexData.empty()) add(&model.vertexData[0], model.vertexData.size() * sizeof(float));
+    if (!model.indexData.empty()) add(&model.indexData[0], model.indexData.size() * sizeof(unsigned int));
+    return hash;
+  }
+
+  void MeshBVH::build(const Model &model) {
+    size_t numVertices = model.vertexData.size() / 4;
+    int numTriangles = static_cast<int>(model.indexData.size() / 3);
+
+    vector<glm::vec3> vertices(3 * numTriangles);
+    vector<glm::vec3> minCoords(numTriangles), maxCoords(numTriangles);
+    vector<int> order(numTriangles);
+
+    for (int idx = 0; idx < numTriangles; ++idx) {
+      for (int corner = 0; corner < 3; ++corner) {
+        unsigned int vertex = model.indexData[3 * idx + corner];
+        if (vertex >= numVertices) {
+          throw Exception("The index data of the model refers to vertices that do not exist.");
+        }
+        vertices[3 * idx + corner] = glm::vec3(model.vertexData[4 * vertex], model.vertexData[4 * vertex + 1],
+                                               model.vertexData[4 * vertex + 2]);
+      }
+      minCoords[idx] = glm::min(vertices[3 * idx], glm::min(vertices[3 * idx + 1], vertices[3 * idx + 2]));
+      maxCoords[idx] = glm::max(vertices[3 * idx], glm::max(vertices[3 * idx + 1], vertices[3 * idx + 2]));
+      order[idx] = idx;
+    }
+
+    nodes.clear();
+    if (numTriangles > 0) {
+      nodes.reserve(2 * (numTriangles / LEAF_SIZE) + 1);
+      buildNode(0, numTriangles, 0, minCoords, maxCoords, order);
+    }
+
+    triangleIndices = order;
+    triangleVertices.resize(3 * numTriangles);
+    for (int idx = 0; idx < numTriangles; ++idx) {
+      for (int corner = 0; corner < 3; ++corner) {
+        triangleVertices[3 * idx + corner] = vertices[3 * order[idx] + corner];
+      }
+    }
+
+    modelHash = hashModel(model);
+  }
+
+  void MeshBVH::buildNode(int firstTriangle, int numTriangles, int depth, const vector<glm::vec3> &minCoords,
+                          const vector<glm::vec3> &maxCoords, vector<int> &order) {
+    Node node;
+    node.secondChild = -1;
+    node.firstTriangle = firstTriangle;
+    node.numTriangles = numTriangles;
+
+    // The centres of the triangles' extents are kept doubled, to save multiplications
+    glm::vec3 minCentre, maxCentre;
+    for (int idx = firstTriangle; idx < firstTriangle + numTriangles; ++idx) {
+      int triangle = order[idx];
+      glm::vec3 centre = minCoords[triangle] + maxCoords[triangle];
+      if (idx == firstTriangle) {
+        node.minCoords = minCoords[triangle];
+        node.maxCoords = maxCoords[triangle];
+        minCentre = centre;
+        maxCentre = centre;
+      }
+      else {
+        node.minCoords = glm::min(node.minCoords, minCoords[triangle]);
+        node.maxCoords = glm::max(node.maxCoords, maxCoords[triangle]);
+        minCentre = glm::min(minCentre, centre);
+        maxCentre = glm::max(maxCentre, centre);
+      }
+    }
+
+    size_t nodeIdx = nodes.size();
+    nodes.push_back(node);
+
+    if (numTriangles <= LEAF_SIZE || depth == MAX_DEPTH - 1) {
+      return;
+    }
+
+    // The triangles are put in bins along each axis, by the centres of their extents. The split
+    // between two bins for which the sum of the surface areas of the two sides, each multiplied by
+    // its number of triangles, is lowest is the one for which queries are expected to be fastest.
+    glm::vec3 binMinCoords[NUM_BINS], binMaxCoords[NUM_BINS];
+    int binCounts[NUM_BINS];
+    float rightCosts[NUM_BINS];
+
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = numeric_limits<float>::max();
+
+    for (int axis = 0; axis < 3; ++axis) {
+      float extent = maxCentre[axis] - minCentre[axis];
+      if (extent <= 0.0f) continue;
+      float binScale = NUM_BINS / extent;
+
+      for (int bin = 0; bin < NUM_BINS; ++bin) {
+        binCounts[bin] = 0;
+      }
+
+      for (int idx = firstTriangle; idx < firstTriangle + numTriangles; ++idx) {
+        int triangle = order[idx];
+        int bin = min(NUM_BINS - 1, static_cast<int>(
+          (minCoords[triangle][axis] + maxCoords[triangle][axis] - minCentre[axis]) * binScale));
+        if (binCounts[bin] == 0) {
+          binMinCoords[bin] = minCoords[triangle];
+          binMaxCoords[bin] = maxCoords[triangle];
+        }
+        else {
+          binMinCoords[bin] = glm::min(binMinCoords[bin], minCoords[triangle]);
+          binMaxCoords[bin] = glm::max(binMaxCoords[bin], maxCoords[triangle]);
+        }
+        ++binCounts[bin];
+      }
+
+      // The cost of the right side of each split, sweeping from the right
+      glm::vec3 sideMinCoords, sideMaxCoords;
+      int sideCount = 0;
+      for (int bin = NUM_BINS - 1; bin > 0; --bin) {
+        if (binCounts[bin] > 0) {
+          sideMinCoords = sideCount == 0 ? binMinCoords[bin] : glm::min(sideMinCoords, binMinCoords[bin]);
+          sideMaxCoords = sideCount == 0 ? binMaxCoords[bin] : glm::max(sideMaxCoords, binMaxCoords[bin]);
+          sideCount += binCounts[bin];
+        }
+        rightCosts[bin] = sideCount == 0 ? 0.0f : surfaceArea(sideMinCoords, sideMaxCoords) * sideCount;
+      }
+
+      // The cost of the left side, sweeping from the left, splitting after each bin
+      sideCount = 0;
+      for (int bin = 0; bin < NUM_BINS - 1; ++bin) {
+        if (binCounts[bin] > 0) {
+          sideMinCoords = sideCount == 0 ? binMinCoords[bin] : glm::min(sideMinCoords, binMinCoords[bin]);
+          sideMaxCoords = sideCount == 0 ? binMaxCoords[bin] : glm::max(sideMaxCoords, binMaxCoords[bin]);
+          sideCount += binCounts[bin];
+        }
+        if (sideCount == 0 || sideCount == numTriangles) continue;
+        float cost = surfaceArea(sideMinCoords, sideMaxCoords) * sideCount + rightCosts[bin + 1];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestBin = bin;
+        }
+      }
+    }
+
+    int half;
+    if (bestAxis >= 0) {
+      float extent = maxCentre[bestAxis] - minCentre[bestAxis];
+      float binScale = NUM_BINS / extent;
+      float axisMinCentre = minCentre[bestAxis];
+      half = static_cast<int>(
+        partition(order.begin() + firstTriangle, order.begin() + firstTriangle + numTriangles,
+                  [&](int triangle) {
+                    return min(NUM_BINS - 1, static_cast<int>(
+                      (minCoords[triangle][bestAxis] + maxCoords[triangle][bestAxis] - axisMinCentre) *
+                      binScale)) <= bestBin;
+                  }) - (order.begin() + firstTriangle));
+    }
+    else {
+      // All the triangles are in the same place, so they are just split in half
+      half = numTriangles / 2;
+    }
+
+    nodes[nodeIdx].numTriangles = 0;
+    buildNode(firstTriangle, half, depth + 1, minCoords, maxCoords, order);
+    nodes[nodeIdx].secondChild = static_cast<int>(nodes.size());
+    buildNode(firstTriangle + half, numTriangles - half, depth + 1, minCoords, maxCoords, order);
+  }
+
+  void MeshBVH::save(const string &path) const {
+    ofstream file(path.c_str(), ios::binary | ios::trunc);
+    if (!file) {
+      throw Exception("Could not open file " + path + " for writing");
+    }
+
+    int32_t numNodes = static_cast<int32_t>(nodes.size());
+    int32_t numTriangles = static_cast<int32_t>(triangleIndices.size());
+
+    file.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+    file.write(reinterpret_cast<const char *>(&FILE_VERSION), sizeof(FILE_VERSION));
+    file.write(reinterpret_cast<const char *>(&modelHash), sizeof(modelHash));
+    file.write(reinterpret_cast<const char *>(&numNodes), sizeof(numNodes));
+    file.write(reinterpret_cast<const char *>(&numTriangles), sizeof(numTriangles));
+    if (numNodes > 0) {
+      file.write(reinterpret_cast<const char *>(&nodes[0]), nodes.size() * sizeof(Node));
+    }
+    if (numTriangles > 0) {
+      file.write(reinterpret_cast<const char *>(&triangleVertices[0]), triangleVertices.size() * sizeof(glm::vec3));
+      file.write(reinterpret_cast<const char *>(&triangleIndices[0]), triangleIndices.size() * sizeof(int));
+    }
+
+    if (!file) {
+      throw Exception("Could not write file " + path);
+    }
+  }
+
+  bool MeshBVH::load(const string &path, const Model &model) {
+    ifstream file(path.c_str(), ios::binary);
+    if (!file.is_open()) {
+      return false;
+    }
+
+    char magic[sizeof(FILE_MAGIC)];
+    uint32_t version = 0;
+    uint64_t hash = 0;
+    int32_t numNodes = 0, numTriangles = 0;
+
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    file.read(reinterpret_cast<char *>(&hash), sizeof(hash));
+    file.read(reinterpret_cast<char *>(&numNodes), sizeof(numNodes));
+    file.read(reinterpret_cast<char *>(&numTriangles), sizeof(numTriangles));
+
+    if (!file || memcmp(magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || version != FILE_VERSION) {
+      LOGINFO("Ignoring unreadable triangle hierarchy file " + path);
+      return false;
+    }
+
+    if (hash != hashModel(model) || numTriangles != static_cast<int32_t>(model.indexData.size() / 3) ||
+        numNodes < 0 || numNodes > 2 * numTriangles || (numNodes == 0) != (numTriangles == 0)) {
+      LOGINFO("Triangle hierarchy file " + path + " does not match its model");
+      return false;
+    }
+
+    vector<Node> loadedNodes(numNodes);
+    vector<glm::vec3> loadedVertices(3 * numTriangles);
+    vector<int> loadedIndices(numTriangles);
+    if (numNodes > 0) {
+      file.read(reinterpret_cast<char *>(&loadedNodes[0]), loadedNodes.size() * sizeof(Node));
+      file.read(reinterpret_cast<char *>(&loadedVertices[0]), loadedVertices.size() * sizeof(glm::vec3));
+      file.read(reinterpret_cast<char *>(&loadedIndices[0]), loadedIndices.size() * sizeof(int));
+    }
+
+    // The children of a node always come after it, so the depth of each node is known by the
+    // time its children are reached. Deeper trees would not fit in the stacks of the queries.
+    bool valid = static_cast<bool>(file);
+    vector<int> depths(loadedNodes.size(), -1);
+    if (!depths.empty()) depths[0] = 0;
+    for (size_t idx = 0; valid && idx < loadedNodes.size(); ++idx) {
+      const Node &node = loadedNodes[idx];
+      valid = node.numTriangles > 0 ?
+        node.firstTriangle >= 0 && node.firstTriangle + node.numTriangles <= numTriangles :
+        node.secondChild > static_cast<int>(idx) + 1 && node.secondChild < numNodes;
+      if (valid && node.numTriangles <= 0 && depths[idx] >= 0) {
+        valid = depths[idx] < MAX_DEPTH;
+        depths[idx + 1] = max(depths[idx + 1], depths[idx] + 1);
+        depths[node.secondChild] = max(depths[node.secondChild], depths[idx] + 1);
+      }
+    }
+    if (!valid) {
+      LOGINFO("Ignoring unreadable triangle hierarchy file " + path);
+      return false;
+    }
+
+    nodes.swap(loadedNodes);
+    triangleVertices.swap(loadedVertices);
+    triangleIndices.swap(loadedIndices);
+    modelHash = hash;
+    return true;
+  }
+
+  int MeshBVH::getNumTriangles() const {
+    return static_cast<int>(triangleIndices.size());
+  }
+
+  int MeshBVH::getNumNodes() const {
+    return static_cast<int>(nodes.size());
+  }
+
+  bool MeshBVH::castRay(const glm::vec3 &origin, const glm::vec3 &direction, MeshRayHit &hit,
+                        float maxDistance, const glm::mat4x4 &transformation) const {
+    hit.triangleIndex = -1;
+    hit.distance = maxDistance;
+
+    float length = glm::length(direction);
+    if (nodes.empty() || length == 0.0f) {
+      return false;
+    }
+
+    glm::vec3 originInModelSpace = toModelSpace(transformation, origin);
+    glm::vec3 directionInModelSpace = rotateToModelSpace(transformation, direction / length);
+
+    // Directions parallel to an axis are nudged, so that the slab tests do not multiply 0 by infinity
+    glm::vec3 inverseDirection;
+    for (int i = 0; i < 3; ++i) {
+      float coordinate = directionInModelSpace[i];
+      if (fabs(coordinate) < 1e-20f) {
+        coordinate = coordinate < 0.0f ? -1e-20f : 1e-20f;
+      }
+      inverseDirection[i] = 1.0f / coordinate;
+    }
+
+    int hitPosition = -1;
+    int stack[MAX_DEPTH + 1];
+    int stackSize = 0;
+    if (intersectSlabs(originInModelSpace, inverseDirection, nodes[0].minCoords, nodes[0].maxCoords,
+                       maxDistance) >= 0.0f) {
+      stack[stackSize++] = 0;
+    }
+
+    while (stackSize > 0) {
+      int nodeIdx = stack[--stackSize];
+      const Node &node = nodes[nodeIdx];
+
+      if (node.numTriangles == 0) {
+        // The nearer child is visited first, so that the further one can be skipped if
+        // a triangle is hit before it
+        int first = nodeIdx + 1, second = node.secondChild;
+        float firstEntry = intersectSlabs(originInModelSpace, inverseDirection, nodes[first].minCoords,
+                                          nodes[first].maxCoords, hit.distance);
+        float secondEntry = intersectSlabs(originInModelSpace, inverseDirection, nodes[second].minCoords,
+                                           nodes[second].maxCoords, hit.distance);
+        if (firstEntry >= 0.0f && secondEntry >= 0.0f && secondEntry < firstEntry) {
+          swap(first, second);
+          swap(firstEntry, secondEntry);
+        }
+        if (secondEntry >= 0.0f) stack[stackSize++] = second;
+        if (firstEntry >= 0.0f) stack[stackSize++] = first;
+        continue;
+      }
+
+      // Nodes pushed before a closer triangle was hit may now be too far
+      if (hitPosition >= 0 && intersectSlabs(originInModelSpace, inverseDirection, node.minCoords,
+                                             node.maxCoords, hit.distance) < 0.0f) {
+        continue;
+      }
+
+      for (int idx = node.firstTriangle; idx < node.firstTriangle + node.numTriangles; ++idx) {
+        // Möller-Trumbore ray-triangle intersection
+        const glm::vec3 *v = &triangleVertices[3 * idx];
+        glm::vec3 edge1 = v[1] - v[0], edge2 = v[2] - v[0];
+        glm::vec3 p = glm::cross(directionInModelSpace, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (determinant == 0.0f) continue;
+        float inverseDeterminant = 1.0f / determinant;
+
+        glm::vec3 s = originInModelSpace - v[0];
+        float u = glm::dot(s, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f) continue;
+
+        glm::vec3 q = glm::cross(s, edge1);
+        float w = glm::dot(directionInModelSpace, q) * inverseDeterminant;
+        if (w < 0.0f || u + w > 1.0f) continue;
+
+        float distance = glm::dot(edge2, q) * inverseDeterminant;
+        if (distance >= 0.0f && distance <= hit.distance && (hitPosition < 0 || distance < hit.distance)) {
+          hit.distance = distance;
+          hitPosition = idx;
+        }
+      }
+    }
+
+    if (hitPosition < 0) {
+      return false;
+    }
+
+    const glm::vec3 *v = &triangleVertices[3 * hitPosition];
+    glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+    hit.triangleIndex = triangleIndices[hitPosition];
+    hit.normal = glm::normalize(glm::vec3(transformation * glm::vec4(normal, 0.0f)));
+    return true;
+  }
+
+  bool MeshBVH::intersectsSphere(const glm::vec3 &centre, float radius, const glm::mat4x4 &transformation) const {
+    if (nodes.empty()) {
+      return false;
+    }
+
+    // Rotating and moving the model does not change the shape of the sphere
+    glm::vec3 centreInModelSpace = toModelSpace(transformation, centre);
+    float radiusSquared = radius * radius;
+
+    int stack[MAX_DEPTH + 1];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+      int nodeIdx = stack[--stackSize];
+      const Node &node = nodes[nodeIdx];
+
+      glm::vec3 distance = centreInModelSpace - glm::clamp(centreInModelSpace, node.minCoords, node.maxCoords);
+      if (glm::dot(distance, distance) > radiusSquared) {
+        continue;
+      }
+
+      if (node.numTriangles == 0) {
+        stack[stackSize++] = node.secondChild;
+        stack[stackSize++] = nodeIdx + 1;
+        continue;
+      }
+
+      for (int idx = node.firstTriangle; idx < node.firstTriangle + node.numTriangles; ++idx) {
+        const glm::vec3 *v = &triangleVertices[3 * idx];
+        distance = centreInModelSpace - closestPointOnTriangle(centreInModelSpace, v[0], v[1], v[2]);
+        if (glm::dot(distance, distance) <= radiusSquared) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  bool MeshBVH::intersectsBox(const glm::vec3 &minCoords, const glm::vec3 &maxCoords,
+                              const glm::mat4x4 &transformation) const {
+    if (nodes.empty()) {
+      return false;
+    }
+
+    glm::vec3 centre = (minCoords + maxCoords) * 0.5f;
+    glm::vec3 halfSize = (maxCoords - minCoords) * 0.5f;
+
+    // The nodes are checked against the extents of the box in the space of the model
+    glm::vec3 axes[3] = {glm::vec3(transformation[0]), glm::vec3(transformation[1]), glm::vec3(transformation[2])};
+    glm::vec3 centreInModelSpace = toModelSpace(transformation, centre);
+    glm::vec3 halfSizeInModelSpace(glm::dot(glm::abs(axes[0]), halfSize), glm::dot(glm::abs(axes[1]), halfSize),
+                                   glm::dot(glm::abs(axes[2]), halfSize));
+    glm::vec3 queryMinCoords = centreInModelSpace - halfSizeInModelSpace;
+    glm::vec3 queryMaxCoords = centreInModelSpace + halfSizeInModelSpace;
+
+    // and the triangles are moved to the space of the box, with the box at the origin.
+    glm::vec3 translation = glm::vec3(transformation[3]) - centre;
+
+    int stack[MAX_DEPTH + 1];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+      int nodeIdx = stack[--stackSize];
+      const Node &node = nodes[nodeIdx];
+
+      if (queryMinCoords.x > node.maxCoords.x || queryMaxCoords.x < node.minCoords.x ||
+          queryMinCoords.y > node.maxCoords.y || queryMaxCoords.y < node.minCoords.y ||
+          queryMinCoords.z > node.maxCoords.z || queryMaxCoords.z < node.minCoords.z) {
+        continue;
+      }
+
+      if (node.numTriangles == 0) {
+        stack[stackSize++] = node.secondChild;
+        stack[stackSize++] = nodeIdx + 1;
+        continue;
+      }
+
+      for (int idx = node.firstTriangle; idx < node.firstTriangle + node.numTriangles; ++idx) {
+        glm::vec3 v[3];
+        for (int corner = 0; corner < 3; ++corner) {
+          v[corner] = glm::vec3(transformation * glm::vec4(triangleVertices[3 * idx + corner], 0.0f)) + translation;
+        }
+        if (triangleOverlapsBox(v, halfSize)) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+}
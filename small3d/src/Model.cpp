@@ -7,11 +7,17 @@
  */
 
 #include "Model.hpp"
+#include "Exception.hpp"
+#include "MathFunctions.hpp"
 
 using namespace std;
 
 namespace small3d {
 
+  const int Model::INTERLEAVED_NORMAL_OFFSET;
+  const int Model::INTERLEAVED_UV_OFFSET;
+  const int Model::INTERLEAVED_MIN_STRIDE;
+
   Model::Model() {
     vertexData.clear();
     vertexDataSize = 0;
@@ -21,6 +27,47 @@ namespace small3d {
     normalsDataSize = 0;
     textureCoordsData.clear();
     textureCoordsDataSize = 0;
+    interleavedData.clear();
+    interleavedDataSize = 0;
+    interleavedStride = 0;
+  }
+
+  void Model::interleave(int stride) {
+
+    if (stride < INTERLEAVED_MIN_STRIDE || stride % sizeof(float) != 0) {
+      throw Exception("Invalid interleaved vertex stride " + intToStr(stride));
+    }
+
+    size_t numVertices = vertexData.size() / 4;
+    size_t floatsPerVertex = stride / sizeof(float);
+
+    // Models without a texture have no texture coordinates. Their place is left empty.
+    bool hasTextureCoords = textureCoordsData.size() >= numVertices * 2;
+
+    interleavedData.assign(numVertices * floatsPerVertex, 0.0f);
+
+    for (size_t idx = 0; idx < numVertices; ++idx) {
+      float *vertex = &interleavedData[idx * floatsPerVertex];
+
+      for (size_t component = 0; component < 4; ++component) {
+        vertex[component] = vertexData[idx * 4 + component];
+      }
+
+      if (normalsData.size() >= (idx + 1) * 3) {
+        for (size_t component = 0; component < 3; ++component) {
+          vertex[INTERLEAVED_NORMAL_OFFSET / sizeof(float) + component] = normalsData[idx * 3 + component];
+        }
+      }
+
+      if (hasTextureCoords) {
+        for (size_t component = 0; component < 2; ++component) {
+          vertex[INTERLEAVED_UV_OFFSET / sizeof(float) + component] = textureCoordsData[idx * 2 + component];
+        }
+      }
+    }
+
+    interleavedDataSize = static_cast<int>(interleavedData.size() * sizeof(float));
+    interleavedStride = stride;
   }
 
 }
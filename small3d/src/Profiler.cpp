@@ -0,0 +1,388 @@
+/*
+ *  Profiler.cpp
+ *
+ *     License: BSD 3-Clause License (see LICENSE file)
+ */
+
+#include "Profiler.hpp"
+#include "Exception.hpp"
+#include "Logger.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+
+namespace small3d {
+
+  static double millisecondsSince(const chrono::steady_clock::time_point &start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  }
+
+  static string escapeJson(const string &text) {
+    string escaped;
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        escaped += '\\';
+        escaped += c;
+      }
+      else if (static_cast<unsigned char>(c) < 0x20) {
+        ostringstream code;
+        code << "\\u" << hex << setw(4) << setfill('0') << static_cast<int>(c);
+        escaped += code.str();
+      }
+      else {
+        escaped += c;
+      }
+    }
+    return escaped;
+  }
+
+  static string quoteCsv(const string &text) {
+    string quoted = "\"";
+    for (char c : text) {
+      if (c == '"') quoted += '"';
+      quoted += c;
+    }
+    return quoted + "\"";
+  }
+
+  Profiler::Profiler() {
+    enabled = false;
+    gpuTiming = false;
+    frameNumber = 0;
+    historySize = 120;
+    currentFrame = 0;
+    pendingFrames.resize(FRAME_LATENCY + 1);
+    for (auto &frame : pendingFrames) {
+      frame.number = 0;
+      frame.pending = false;
+      frame.usedQueries = 0;
+      frame.cpuMilliseconds = 0.0;
+    }
+  }
+
+  void Profiler::setEnabled(bool enabled, bool gpuTiming) {
+    this->enabled = enabled;
+    this->gpuTiming = enabled && gpuTiming;
+
+    openSections.clear();
+    for (auto &frame : pendingFrames) {
+      frame.pending = false;
+    }
+
+    if (enabled) {
+      history.clear();
+      frameNumber = 0;
+      currentFrame = 0;
+      startFrame();
+    }
+  }
+
+  bool Profiler::isEnabled() const {
+    return enabled;
+  }
+
+  void Profiler::setHistorySize(unsigned long historySize) {
+    this->historySize = historySize;
+    while (history.size() > historySize) {
+      history.pop_front();
+    }
+  }
+
+  unsigned int Profiler::getSection(int parent, const string &name) {
+    if (parent >= 0) {
+      for (unsigned int child : sections[parent].children) {
+        if (sections[child].name == name) return child;
+      }
+    }
+    else {
+      for (unsigned int idx = 0; idx < sections.size(); ++idx) {
+        if (sections[idx].parent < 0 && sections[idx].name == name) return idx;
+      }
+    }
+
+    Section section;
+    section.name = name;
+    section.parent = parent;
+    section.depth = parent >= 0 ? sections[parent].depth + 1 : 0;
+    section.path = parent >= 0 ? sections[parent].path + "/" + name : name;
+    sections.push_back(section);
+
+    unsigned int idx = static_cast<unsigned int>(sections.size() - 1);
+    if (parent >= 0) {
+      sections[parent].children.push_back(idx);
+    }
+    sectionPositions.push_back(-1);
+    return idx;
+  }
+
+  unsigned int Profiler::recordTimestamp() {
+    if (!gpuTiming) return 0;
+
+    PendingFrame &frame = pendingFrames[currentFrame];
+    if (frame.usedQueries == frame.queries.size()) {
+      size_t oldSize = frame.queries.size();
+      frame.queries.resize(oldSize == 0 ? 64 : 2 * oldSize);
+      glGenQueries(static_cast<GLsizei>(frame.queries.size() - oldSize), &frame.queries[oldSize]);
+    }
+    glQueryCounter(frame.queries[frame.usedQueries], GL_TIMESTAMP);
+    return frame.usedQueries++;
+  }
+
+  void Profiler::startFrame() {
+    PendingFrame &frame = pendingFrames[currentFrame];
+    frame.number = frameNumber;
+    frame.pending = false;
+    frame.usedQueries = 0;
+    frame.timings.clear();
+    frameStart = chrono::steady_clock::now();
+
+    // Reserve the first two queries for the start and end of the frame
+    recordTimestamp();
+    if (gpuTiming) ++frame.usedQueries;
+  }
+
+  bool Profiler::begin(const string &name) {
+    if (!enabled) return false;
+
+    vector<Timing> &timings = pendingFrames[currentFrame].timings;
+
+    // The timing is added when the section is entered, so that sections are listed
+    // before the ones nested in them.
+    Timing timing;
+    timing.section = getSection(openSections.empty() ? -1 :
+                                static_cast<int>(timings[openSections.back().timing].section), name);
+    timing.beginQuery = recordTimestamp();
+    timing.endQuery = 0;
+    timing.cpuMilliseconds = 0.0;
+    timings.push_back(timing);
+
+    OpenSection openSection;
+    openSection.timing = timings.size() - 1;
+    openSection.cpuStart = chrono::steady_clock::now();
+    openSections.push_back(openSection);
+    return true;
+  }
+
+  void Profiler::end() {
+    if (!enabled) return;
+
+    if (openSections.empty()) {
+      throw Exception("No profiler section has been entered.");
+    }
+
+    const OpenSection &openSection = openSections.back();
+
+    Timing &timing = pendingFrames[currentFrame].timings[openSection.timing];
+    timing.cpuMilliseconds = millisecondsSince(openSection.cpuStart);
+    timing.endQuery = recordTimestamp();
+
+    openSections.pop_back();
+  }
+
+  void Profiler::endFrame() {
+    if (!enabled) return;
+
+    // Sections that have not been left are closed, so that the frame can be completed,
+    // but this is reported after the frame has ended.
+    string unclosedPath;
+    if (!openSections.empty()) {
+      unclosedPath = sections[pendingFrames[currentFrame].timings[openSections.back().timing].section].path;
+      while (!openSections.empty()) {
+        end();
+      }
+    }
+
+    PendingFrame &frame = pendingFrames[currentFrame];
+    if (gpuTiming) {
+      glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+    }
+    frame.cpuMilliseconds = millisecondsSince(frameStart);
+    frame.pending = true;
+
+    ++frameNumber;
+    currentFrame = (currentFrame + 1) % pendingFrames.size();
+
+    // The frame that was in this slot ended FRAME_LATENCY frames ago, so its queries
+    // should have their results by now.
+    if (pendingFrames[currentFrame].pending) {
+      readBack(pendingFrames[currentFrame]);
+    }
+
+    startFrame();
+
+    if (!unclosedPath.empty()) {
+      throw Exception("Profiler section " + unclosedPath + " has not been left before the end of the frame.");
+    }
+  }
+
+  void Profiler::readBack(PendingFrame &frame) {
+    ProfilerFrame result;
+    result.number = frame.number;
+    result.cpuMilliseconds = frame.cpuMilliseconds;
+    result.gpuMilliseconds = 0.0;
+    result.gpuTimed = gpuTiming;
+
+    if (gpuTiming) {
+      timestamps.resize(frame.usedQueries);
+      for (unsigned int idx = 0; idx < frame.usedQueries; ++idx) {
+        glGetQueryObjectui64v(frame.queries[idx], GL_QUERY_RESULT, &timestamps[idx]);
+      }
+      result.gpuMilliseconds = (timestamps[1] - timestamps[0]) / 1000000.0;
+    }
+
+    for (const Timing &timing : frame.timings) {
+      int &position = sectionPositions[timing.section];
+      if (position < 0) {
+        ProfilerSection section;
+        section.path = sections[timing.section].path;
+        section.depth = sections[timing.section].depth;
+        section.calls = 0;
+        section.cpuMilliseconds = 0.0;
+        section.gpuMilliseconds = 0.0;
+        position = static_cast<int>(result.sections.size());
+        result.sections.push_back(section);
+      }
+      ProfilerSection &section = result.sections[position];
+      ++section.calls;
+      section.cpuMilliseconds += timing.cpuMilliseconds;
+      if (gpuTiming) {
+        section.gpuMilliseconds += (timestamps[timing.endQuery] - timestamps[timing.beginQuery]) / 1000000.0;
+      }
+    }
+
+    for (const Timing &timing : frame.timings) {
+      sectionPositions[timing.section] = -1;
+    }
+
+    frame.pending = false;
+
+    history.push_back(std::move(result));
+    while (history.size() > historySize) {
+      history.pop_front();
+    }
+  }
+
+  const deque<ProfilerFrame>& Profiler::getFrames() const {
+    return history;
+  }
+
+  ProfilerFrame Profiler::getAverage() const {
+    ProfilerFrame average;
+    average.number = history.size();
+    average.cpuMilliseconds = 0.0;
+    average.gpuMilliseconds = 0.0;
+    average.gpuTimed = !history.empty() && history.back().gpuTimed;
+
+    if (history.empty()) return average;
+
+    for (const ProfilerFrame &frame : history) {
+      average.cpuMilliseconds += frame.cpuMilliseconds;
+      average.gpuMilliseconds += frame.gpuMilliseconds;
+      for (const ProfilerSection &section : frame.sections) {
+        auto averageSection = find_if(average.sections.begin(), average.sections.end(),
+                                      [&section](const ProfilerSection &s) { return s.path == section.path; });
+        if (averageSection == average.sections.end()) {
+          average.sections.push_back(section);
+        }
+        else {
+          averageSection->calls += section.calls;
+          averageSection->cpuMilliseconds += section.cpuMilliseconds;
+          averageSection->gpuMilliseconds += section.gpuMilliseconds;
+        }
+      }
+    }
+
+    double numFrames = static_cast<double>(history.size());
+    average.cpuMilliseconds /= numFrames;
+    average.gpuMilliseconds /= numFrames;
+    for (ProfilerSection &section : average.sections) {
+      section.calls = static_cast<unsigned long>(section.calls / numFrames + 0.5);
+      section.cpuMilliseconds /= numFrames;
+      section.gpuMilliseconds /= numFrames;
+    }
+
+    return average;
+  }
+
+  void Profiler::exportCsv(const string &path) const {
+    ofstream file(path);
+    if (!file) {
+      throw Exception("Could not open file " + path + " for writing");
+    }
+
+    file << fixed << setprecision(4);
+    file << "frame,section,depth,calls,cpu_ms,gpu_ms\n";
+    for (const ProfilerFrame &frame : history) {
+      file << frame.number << ",\"frame\",-1,1," << frame.cpuMilliseconds << ","
+           << frame.gpuMilliseconds << "\n";
+      for (const ProfilerSection &section : frame.sections) {
+        file << frame.number << "," << quoteCsv(section.path) << "," << section.depth << ","
+             << section.calls << "," << section.cpuMilliseconds << "," << section.gpuMilliseconds << "\n";
+      }
+    }
+
+    if (!file) {
+      throw Exception("Could not write file " + path);
+    }
+  }
+
+  void Profiler::exportJson(const string &path) const {
+    ofstream file(path);
+    if (!file) {
+      throw Exception("Could not open file " + path + " for writing");
+    }
+
+    file << fixed << setprecision(4);
+    file << "[";
+    for (auto frame = history.begin(); frame != history.end(); ++frame) {
+      file << (frame == history.begin() ? "\n" : ",\n");
+      file << "  {\"frame\": " << frame->number << ", \"cpuMs\": " << frame->cpuMilliseconds
+           << ", \"gpuMs\": " << frame->gpuMilliseconds << ", \"gpuTimed\": "
+           << (frame->gpuTimed ? "true" : "false") << ", \"sections\": [";
+      for (auto section = frame->sections.begin(); section != frame->sections.end(); ++section) {
+        file << (section == frame->sections.begin() ? "\n" : ",\n");
+        file << "    {\"path\": \"" << escapeJson(section->path) << "\", \"depth\": " << section->depth
+             << ", \"calls\": " << section->calls << ", \"cpuMs\": " << section->cpuMilliseconds
+             << ", \"gpuMs\": " << section->gpuMilliseconds << "}";
+      }
+      file << (frame->sections.empty() ? "]}" : "\n  ]}");
+    }
+    file << (history.empty() ? "]\n" : "\n]\n");
+
+    if (!file) {
+      throw Exception("Could not write file " + path);
+    }
+  }
+
+  void Profiler::deleteQueries() {
+    enabled = false;
+    gpuTiming = false;
+    openSections.clear();
+    for (auto &frame : pendingFrames) {
+      if (!frame.queries.empty()) {
+        glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), &frame.queries[0]);
+        frame.queries.clear();
+      }
+      frame.pending = false;
+      frame.usedQueries = 0;
+    }
+  }
+
+  ProfilerScope::ProfilerScope(Profiler &profiler, const string &name) : profiler(profiler) {
+    entered = profiler.begin(name);
+  }
+
+  ProfilerScope::~ProfilerScope() {
+    if (!entered) return;
+    try {
+      profiler.end();
+    }
+    catch (Exception &e) {
+      LOGERROR(string(e.what()));
+    }
+  }
+
+}
@@ -8,9 +8,19 @@
 
 #include "Renderer.hpp"
 #include "Exception.hpp"
+#include "EmbeddedShaders.hpp"
 #include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <cstdint>
 #include "MathFunctions.hpp"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+
+#ifdef SMALL3D_HEADLESS
+#include <EGL/eglext.h>
+#endif
 
 using namespace std;
 
@@ -25,15 +35,114 @@ namespace small3d {
   
   string openglErrorToString(GLenum error);
 
+  /**
+   * Draw command, as read by glMultiDrawElementsIndirect from the indirect buffer
+   */
+  class DrawElementsIndirectCommand {
+  public:
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  // Floats per object in the multi-draw objects buffer (two 4x4 matrices and a colour)
+  static const size_t MULTI_DRAW_OBJECT_FLOATS = 36;
+
+  // Binding point of the uniform buffer holding the camera and lighting
+  static const GLuint FRAME_DATA_BINDING = 0;
+
+  // Size of the FrameData block (std140) and offset of its part that can change during rendering
+  // (after the perspective matrix)
+  static const GLsizeiptr FRAME_DATA_SIZE = 160;
+  static const GLintptr FRAME_DATA_CAMERA_OFFSET = 64;
+
+  /**
+   * Queue messages reported by OpenGL through GL_KHR_debug. This can be called on any
+   * of the driver's threads, so the messages are only logged later (see OpenGLDebugMessages).
+   */
+  static void GLAPIENTRY debugMessageCallback(GLenum /*source*/, GLenum type, GLuint /*id*/, GLenum severity,
+                                              GLsizei /*length*/, const GLchar *message,
+                                              const void *userParam) {
+    OpenGLDebugMessages *debugMessages = static_cast<OpenGLDebugMessages*>(const_cast<void*>(userParam));
+    if (type == GL_DEBUG_TYPE_ERROR || severity == GL_DEBUG_SEVERITY_HIGH) {
+      debugMessages->add(true, string(message));
+    }
+    else if (severity != GL_DEBUG_SEVERITY_NOTIFICATION) {
+      debugMessages->add(false, string(message));
+    }
+  }
+
+  void OpenGLDebugMessages::add(bool error, const string &message) {
+    lock_guard<std::mutex> lock(mutex);
+    messages.push_back(make_pair(error, message));
+  }
+
+  void OpenGLDebugMessages::log() {
+    vector<pair<bool, string> > loggedMessages;
+    {
+      lock_guard<std::mutex> lock(mutex);
+      loggedMessages.swap(messages);
+    }
+    for (const pair<bool, string> &message : loggedMessages) {
+      if (message.first) {
+        LOGERROR("OpenGL: " + message.second);
+      }
+      else {
+        LOGINFO("OpenGL: " + message.second);
+      }
+    }
+  }
+
+  // Size at which glyphs are rasterised when rendering text from signed distance fields
+  static const int SIGNED_DISTANCE_FIELD_FONT_SIZE = 32;
+
   Renderer::Renderer(string windowTitle, int width, int height,
                      float frustumScale , float zNear,
                      float zFar, float zOffsetFromCamera,
-                     string shadersPath, string basePath) {
+                     string shadersPath, string basePath, string programCachePath) :
+    glyphAtlas(stateCache), geometryArena(stateCache) {
     isOpenGL33Supported = false;
+    isOpenGL43Supported = false;
+    multiDrawProgram = 0;
+    multiDrawObjectBufferObjectId = 0;
+    multiDrawIndirectBufferObjectId = 0;
+    multiDrawObjectIndexBufferObjectId = 0;
+    multiDrawObjectIndexCapacity = 0;
+    frameDataBufferObjectId = 0;
+    frameDataUpToDate = false;
+    frameDataLightIntensity = 0.0f;
+    profilerOverlay = false;
+#ifdef SMALL3D_HEADLESS
+    eglDisplay = EGL_NO_DISPLAY;
+    eglContext = EGL_NO_CONTEXT;
+    eglSurface = EGL_NO_SURFACE;
+    headlessFramebufferId = 0;
+    headlessColourRenderbufferId = 0;
+    headlessDepthRenderbufferId = 0;
+#else
     window = 0;
+#endif
     perspectiveProgram = 0;
     orthographicProgram = 0;
+    textProgram = 0;
+    signedDistanceFieldTextProgram = 0;
+    signedDistanceFieldText = false;
+    textVaoId = 0;
+    textVertexBufferObjectId = 0;
+    textIndexBufferObjectId = 0;
+    textIndexBufferCapacity = 0;
+    boundingBoxVaoId = 0;
+    boundingBoxVertexBufferObjectId = 0;
+    boundingBoxIndexBufferObjectId = 0;
+    boundingBoxVertexBufferSize = 0;
+    boundingBoxIndexBufferSize = 0;
+    retainedTextMemory = 0;
+    retainedTextMemoryLimit = 4 * 1024 * 1024;
+    nextTextHandle = 1;
     textures = new unordered_map<string, GLuint>();
+    errorChecking = errorcheckingpercall;
     noShaders = false;
     lightDirection = glm::vec3(0.0f, 0.9f, 0.2f);
     cameraPosition = glm::vec3(0, 0, 0);
@@ -41,13 +150,16 @@ namespace small3d {
     lightIntensity = 1.0f;
 
     if (basePath.empty()) {
-#ifndef SMALL3D_GLFW
+#if !defined(SMALL3D_GLFW) && !defined(SMALL3D_HEADLESS)
     this->basePath = string(SDL_GetBasePath());
 #endif
     }
     else {
       this->basePath = basePath;
     }
+
+    this->programCachePath = programCachePath;
+    useProgramCache = false;
     
     init(width, height, windowTitle, frustumScale, zNear, zFar, zOffsetFromCamera, shadersPath);
 
@@ -61,33 +173,121 @@ namespace small3d {
 
   Renderer::~Renderer() {
     LOGINFO("Renderer destructor running");
+
+    if (frameCapture) {
+      try {
+        frameCapture->finish();
+      }
+      catch (Exception &e) {
+        LOGERROR(string(e.what()));
+      }
+      frameCapture.reset();
+    }
+
     for (unordered_map<string, GLuint>::iterator it = textures->begin();
          it != textures->end(); ++it) {
       LOGINFO("Deleting texture for " + it->first);
-      glDeleteTextures(1, &it->second);
+      stateCache.deleteTextures(1, &it->second);
     }
     delete textures;
 
+    for (auto &handleTextPair : retainedTexts) {
+      releaseRetainedText(handleTextPair.second);
+    }
+
+    glyphAtlas.deleteTexture();
+
+    geometryArena.deleteBuffers();
+
+    profiler.deleteQueries();
+
+    if (multiDrawObjectBufferObjectId != 0) {
+      stateCache.deleteBuffers(1, &multiDrawObjectBufferObjectId);
+      stateCache.deleteBuffers(1, &multiDrawIndirectBufferObjectId);
+      stateCache.deleteBuffers(1, &multiDrawObjectIndexBufferObjectId);
+    }
+
+    if (textVertexBufferObjectId != 0) {
+      stateCache.deleteBuffers(1, &textVertexBufferObjectId);
+    }
+
+    if (textIndexBufferObjectId != 0) {
+      stateCache.deleteBuffers(1, &textIndexBufferObjectId);
+    }
+
+    if (textVaoId != 0) {
+      stateCache.deleteVertexArrays(1, &textVaoId);
+    }
+
+    if (boundingBoxVertexBufferObjectId != 0) {
+      stateCache.deleteBuffers(1, &boundingBoxVertexBufferObjectId);
+      stateCache.deleteBuffers(1, &boundingBoxIndexBufferObjectId);
+    }
+
+    if (boundingBoxVaoId != 0) {
+      stateCache.deleteVertexArrays(1, &boundingBoxVaoId);
+    }
+
     for(auto idFacePair : fontFaces) {
       FT_Done_Face(idFacePair.second);
     }
 
     FT_Done_FreeType(library);
 
+    if (errorChecking == errorcheckingcallback) {
+      glDebugMessageCallback(nullptr, nullptr);
+      glDisable(GL_DEBUG_OUTPUT);
+    }
+    debugMessages.log();
+
     if (!noShaders) {
-      glUseProgram(0);
+      stateCache.useProgram(0);
     }
 
     if (orthographicProgram != 0) {
       glDeleteProgram(orthographicProgram);
     }
 
+    if (textProgram != 0) {
+      glDeleteProgram(textProgram);
+    }
+
+    if (signedDistanceFieldTextProgram != 0) {
+      glDeleteProgram(signedDistanceFieldTextProgram);
+    }
+
     if (perspectiveProgram != 0) {
       glDeleteProgram(perspectiveProgram);
     }
 
+    if (multiDrawProgram != 0) {
+      glDeleteProgram(multiDrawProgram);
+    }
+
+    if (frameDataBufferObjectId != 0) {
+      stateCache.deleteBuffers(1, &frameDataBufferObjectId);
+    }
+
 #ifdef SMALL3D_GLFW
     glfwTerminate();
+#elif defined(SMALL3D_HEADLESS)
+    if (headlessFramebufferId != 0) {
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glDeleteFramebuffers(1, &headlessFramebufferId);
+      glDeleteRenderbuffers(1, &headlessColourRenderbufferId);
+      glDeleteRenderbuffers(1, &headlessDepthRenderbufferId);
+    }
+
+    if (eglDisplay != EGL_NO_DISPLAY) {
+      eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+      if (eglSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(eglDisplay, eglSurface);
+      }
+      if (eglContext != EGL_NO_CONTEXT) {
+        eglDestroyContext(eglDisplay, eglContext);
+      }
+      eglTerminate(eglDisplay);
+    }
 #else
     if (window != 0) {
       SDL_DestroyWindow(window);
@@ -100,7 +300,7 @@ namespace small3d {
   GLFWwindow* Renderer::getWindow() {
     return window;
   }
-#else
+#elif !defined(SMALL3D_HEADLESS)
   SDL_Window* Renderer::getWindow() {
     return window;
   }
@@ -108,15 +308,30 @@ namespace small3d {
 
   string Renderer::loadShaderFromFile(const string &fileLocation) {
     initLogger();
-    string shaderSource = "";
-    ifstream file((basePath + fileLocation).c_str());
-    string line;
+    ostringstream shaderSource;
+    ifstream file((basePath + fileLocation).c_str(), ios::binary);
     if (file.is_open()) {
-      while (getline(file, line)) {
-        shaderSource += line + "\n";
+      shaderSource << file.rdbuf();
+    }
+    return shaderSource.str();
+  }
+
+  string Renderer::loadShader(const string &shaderPath) {
+    if (!shadersPath.empty()) {
+      string shaderSource = loadShaderFromFile(shadersPath + shaderPath);
+      if (!shaderSource.empty()) {
+        return shaderSource;
       }
     }
-    return shaderSource;
+
+#ifdef SMALL3D_EMBEDDED_SHADERS
+    const char *embeddedShaderSource = getEmbeddedShader(shaderPath);
+    if (embeddedShaderSource != nullptr) {
+      return string(embeddedShaderSource);
+    }
+#endif
+
+    return "";
   }
 
   string Renderer::getProgramInfoLog(const GLuint linkedProgram) const {
@@ -167,16 +382,10 @@ namespace small3d {
 
   }
 
-  GLuint Renderer::compileShader(const string &shaderSourceFile, const GLenum shaderType) {
+  GLuint Renderer::compileShader(const string &shaderSource, const GLenum shaderType, const string &shaderName) {
 
     GLuint shader = glCreateShader(shaderType);
 
-    string shaderSource = this->loadShaderFromFile(shaderSourceFile);
-
-    if (shaderSource.length() == 0) {
-      throw Exception("Shader source file '" + shaderSourceFile + "' is empty or not found.");
-    }
-
     const char *shaderSourceChars = shaderSource.c_str();
     glShaderSource(shader, 1, &shaderSourceChars, NULL);
 
@@ -191,18 +400,26 @@ namespace small3d {
 		      + this->getShaderInfoLog(shader));
     }
     else {
-      LOGINFO("Shader " + shaderSourceFile + " compiled successfully.");
+      LOGINFO("Shader " + shaderName + " compiled successfully.");
     }
 
     return shader;
   }
 
   void Renderer::detectOpenGLVersion() {
-#ifdef __APPLE__
+#if defined(__APPLE__) || defined(SMALL3D_HEADLESS)
     glewExperimental = GL_TRUE;
 #endif
     GLenum initResult = glewInit();
 
+#if defined(SMALL3D_HEADLESS) && defined(GLEW_ERROR_NO_GLX_DISPLAY)
+    // GLEW also tries to initialise GLX, which fails without a display. The OpenGL
+    // functions have already been loaded by then, so this is not a problem.
+    if (initResult == GLEW_ERROR_NO_GLX_DISPLAY) {
+      initResult = GLEW_OK;
+    }
+#endif
+
     if (initResult != GLEW_OK) {
       throw Exception("Error initialising GLEW");
     }
@@ -220,6 +437,11 @@ namespace small3d {
     if (glewIsSupported("GL_VERSION_3_3")) {
       LOGINFO("Ready for OpenGL 3.3");
       isOpenGL33Supported = true;
+
+      if (glewIsSupported("GL_VERSION_4_3")) {
+        LOGINFO("OpenGL 4.3 is also available. Multi-draw indirect rendering enabled.");
+        isOpenGL43Supported = true;
+      }
     }
     else if (glewIsSupported("GL_VERSION_2_1")) {
       LOGINFO("Ready for OpenGL 2.1");
@@ -247,6 +469,36 @@ namespace small3d {
     }
   }
 
+  void Renderer::checkForRenderingErrors(const string &when) {
+    if (errorChecking == errorcheckingpercall) {
+      checkForOpenGLErrors(when, true);
+    }
+  }
+
+  void Renderer::setOpenGLErrorChecking(OpenGLErrorChecking errorChecking) {
+
+    if (errorChecking == errorcheckingcallback && !GLEW_KHR_debug) {
+      LOGINFO("GL_KHR_debug is not available. Checking for OpenGL errors once per frame instead.");
+      errorChecking = errorcheckingperframe;
+    }
+
+    // Report (without throwing) errors that have not been checked for so far, so that
+    // they are not attributed to whatever is rendered next.
+    checkForOpenGLErrors("rendering", false);
+
+    if (this->errorChecking == errorcheckingcallback && errorChecking != errorcheckingcallback) {
+      glDebugMessageCallback(nullptr, nullptr);
+      glDisable(GL_DEBUG_OUTPUT);
+    }
+
+    if (errorChecking == errorcheckingcallback && this->errorChecking != errorcheckingcallback) {
+      glDebugMessageCallback(debugMessageCallback, &debugMessages);
+      glEnable(GL_DEBUG_OUTPUT);
+    }
+
+    this->errorChecking = errorChecking;
+  }
+
   void Renderer::initWindow(int &width, int &height, const string &windowTitle) {
 
 #ifdef SMALL3D_GLFW
@@ -291,6 +543,85 @@ namespace small3d {
 
     glfwMakeContextCurrent(window);
 
+#elif defined(SMALL3D_HEADLESS)
+
+    if (width == 0 || height == 0) {
+      throw Exception("Both the width and the height of the frame have to be set when rendering headless.");
+    }
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    // Prefer Mesa's surfaceless platform, which needs neither a display server nor a GPU
+    // (it falls back to the software rasteriser).
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+    if (clientExtensions != nullptr && string(clientExtensions).find("EGL_MESA_platform_surfaceless") != string::npos &&
+        getPlatformDisplay != nullptr) {
+      eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+#endif
+
+    if (eglDisplay == EGL_NO_DISPLAY) {
+      eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint eglMajorVersion, eglMinorVersion;
+
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &eglMajorVersion, &eglMinorVersion)) {
+      eglDisplay = EGL_NO_DISPLAY;
+      throw Exception("Unable to initialise EGL");
+    }
+
+    LOGINFO("Rendering headless, using EGL " + intToStr(eglMajorVersion) + "." + intToStr(eglMinorVersion));
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+      throw Exception("EGL does not support OpenGL");
+    }
+
+    EGLint configAttributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                 EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                 EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+                                 EGL_NONE};
+    EGLConfig config;
+    EGLint numConfigs = 0;
+
+    if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+      throw Exception("No suitable EGL configuration found");
+    }
+
+    // Ask for an OpenGL 4.3 core context, so that multi-draw indirect rendering can be used,
+    // then for 3.3 core and finally for whatever the driver provides by default.
+    EGLint contextVersions[][2] = {{4, 3}, {3, 3}};
+
+    for (auto &version : contextVersions) {
+      EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION_KHR, version[0],
+                                    EGL_CONTEXT_MINOR_VERSION_KHR, version[1],
+                                    EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                                    EGL_NONE};
+      eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+      if (eglContext != EGL_NO_CONTEXT) break;
+    }
+
+    if (eglContext == EGL_NO_CONTEXT) {
+      eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, nullptr);
+    }
+
+    if (eglContext == EGL_NO_CONTEXT) {
+      throw Exception("Unable to create GL context");
+    }
+
+    // Rendering is done to a framebuffer object (see createHeadlessFramebuffer), so no surface
+    // is needed, unless EGL does not support surfaceless contexts, in which case a minimal
+    // pbuffer is created, only for making the context current.
+    if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+      EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+      eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttributes);
+      if (eglSurface == EGL_NO_SURFACE || !eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext)) {
+        throw Exception("Unable to make the GL context current");
+      }
+    }
+
 #else
 
     // initialize SDL video
@@ -345,6 +676,33 @@ namespace small3d {
 #endif
   }
 
+#ifdef SMALL3D_HEADLESS
+  void Renderer::createHeadlessFramebuffer(int width, int height) {
+    glGenRenderbuffers(1, &headlessColourRenderbufferId);
+    glBindRenderbuffer(GL_RENDERBUFFER, headlessColourRenderbufferId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &headlessDepthRenderbufferId);
+    glBindRenderbuffer(GL_RENDERBUFFER, headlessDepthRenderbufferId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &headlessFramebufferId);
+    glBindFramebuffer(GL_FRAMEBUFFER, headlessFramebufferId);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headlessColourRenderbufferId);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headlessDepthRenderbufferId);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      throw Exception("Unable to create the framebuffer for headless rendering");
+    }
+
+    checkForOpenGLErrors("creating the framebuffer for headless rendering", true);
+
+    LOGINFO("Rendering to a " + intToStr(width) + "x" + intToStr(height) + " offscreen framebuffer");
+  }
+#endif
+
   void Renderer::init(int width, int height, string windowTitle,
                       float frustumScale, float zNear,
                       float zFar, float zOffsetFromCamera,
@@ -360,116 +718,273 @@ namespace small3d {
     this->zFar = zFar;
     this->zOffsetFromCamera = zOffsetFromCamera;
 
+#ifdef SMALL3D_EMBEDDED_SHADERS
+    this->shadersPath = shadersPath;
+#else
+    this->shadersPath = shadersPath.empty() ? "resources/shaders/" : shadersPath;
+#endif
+
     this->detectOpenGLVersion();
 
+    // Vertex array objects are part of OpenGL 3.0
+    stateCache.setVertexArraysSupported(isOpenGL33Supported);
+    stateCache.activeTexture(GL_TEXTURE0);
+
+    if (!programCachePath.empty()) {
+      GLint numBinaryFormats = 0;
+      if (glewIsSupported("GL_VERSION_4_1") || GLEW_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numBinaryFormats);
+      }
+      useProgramCache = numBinaryFormats > 0;
+      if (!useProgramCache) {
+        LOGINFO("Program binaries are not supported. Shader programs will not be cached.");
+      }
+    }
+
+#ifdef SMALL3D_HEADLESS
+    this->createHeadlessFramebuffer(screenWidth, screenHeight);
+#endif
+
     string vertexShaderPath;
     string fragmentShaderPath;
     string simpleVertexShaderPath;
     string simpleFragmentShaderPath;
+    string textVertexShaderPath;
+    string textFragmentShaderPath;
+    string signedDistanceFieldTextFragmentShaderPath;
 
     if (isOpenGL33Supported) {
-      vertexShaderPath = shadersPath + "OpenGL33/perspectiveMatrixLightedShader.vert";
-      fragmentShaderPath = shadersPath + "OpenGL33/textureShader.frag";
-      simpleVertexShaderPath =
-	shadersPath + "OpenGL33/simpleShader.vert";
-      simpleFragmentShaderPath = shadersPath + "OpenGL33/simpleShader.frag";
+      vertexShaderPath = "OpenGL33/perspectiveMatrixLightedShader.vert";
+      fragmentShaderPath = "OpenGL33/textureShader.frag";
+      simpleVertexShaderPath = "OpenGL33/simpleShader.vert";
+      simpleFragmentShaderPath = "OpenGL33/simpleShader.frag";
+      textVertexShaderPath = "OpenGL33/textShader.vert";
+      textFragmentShaderPath = "OpenGL33/textShader.frag";
+      signedDistanceFieldTextFragmentShaderPath = "OpenGL33/signedDistanceFieldTextShader.frag";
 
     }
     else {
-      vertexShaderPath =
-	shadersPath + "OpenGL21/perspectiveMatrixLightedShader.vert";
-      fragmentShaderPath = shadersPath + "OpenGL21/textureShader.frag";
-      simpleVertexShaderPath =
-	shadersPath + "OpenGL21/simpleShader.vert";
-      simpleFragmentShaderPath = shadersPath + "OpenGL21/simpleShader.frag";
+      vertexShaderPath = "OpenGL21/perspectiveMatrixLightedShader.vert";
+      fragmentShaderPath = "OpenGL21/textureShader.frag";
+      simpleVertexShaderPath = "OpenGL21/simpleShader.vert";
+      simpleFragmentShaderPath = "OpenGL21/simpleShader.frag";
+      textVertexShaderPath = "OpenGL21/textShader.vert";
+      textFragmentShaderPath = "OpenGL21/textShader.frag";
+      signedDistanceFieldTextFragmentShaderPath = "OpenGL21/signedDistanceFieldTextShader.frag";
     }
 
     glViewport(0, 0, static_cast<GLsizei>(screenWidth), static_cast<GLsizei>(screenHeight));
 
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LEQUAL);
+    stateCache.enable(GL_DEPTH_TEST);
+    stateCache.depthMask(GL_TRUE);
+    stateCache.depthFunc(GL_LEQUAL);
     glDepthRange(0.0f, 10.0f);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    stateCache.enable(GL_BLEND);
+    stateCache.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    GLuint vertexShader = compileShader(vertexShaderPath,
-                                        GL_VERTEX_SHADER);
-    GLuint fragmentShader = compileShader(fragmentShaderPath,
-                                          GL_FRAGMENT_SHADER);
+    perspectiveProgram = createProgram(vertexShaderPath, fragmentShaderPath);
 
-    perspectiveProgram = glCreateProgram();
-    glAttachShader(perspectiveProgram, vertexShader);
-    glAttachShader(perspectiveProgram, fragmentShader);
+    LOGINFO("Linked main rendering program successfully");
 
-    glLinkProgram(perspectiveProgram);
+    stateCache.useProgram(perspectiveProgram);
 
-    GLint status;
-    glGetProgramiv(perspectiveProgram, GL_LINK_STATUS, &status);
-    if (status == GL_FALSE) {
-      throw Exception("Failed to link program:\n" + this->getProgramInfoLog(perspectiveProgram));
+    // Perspective
+
+    GLint perspectiveMatrixUniform = glGetUniformLocation(perspectiveProgram,
+                                                          "perspectiveMatrix");
+
+    float perspectiveMatrix[16];
+    memset(perspectiveMatrix, 0, sizeof(float) * 16);
+    perspectiveMatrix[0] = frustumScale;
+    perspectiveMatrix[5] = frustumScale * ROUND_2_DECIMAL(screenWidth / screenHeight);
+    perspectiveMatrix[10] = (zNear + zFar) / (zNear - zFar);
+    perspectiveMatrix[14] = 2.0f * zNear * zFar / (zNear - zFar);
+    perspectiveMatrix[11] = zOffsetFromCamera;
+
+    if (isOpenGL33Supported) {
+      bindFrameData(perspectiveProgram, perspectiveMatrix);
     }
     else {
-      LOGINFO("Linked main rendering program successfully");
+      glUniformMatrix4fv(perspectiveMatrixUniform, 1, GL_FALSE,
+                         perspectiveMatrix);
+    }
 
-      glUseProgram(perspectiveProgram);
+    stateCache.useProgram(0);
 
-      // Perspective
+    // Program (with shaders) for rendering objects in the geometry arena with
+    // multi-draw indirect calls
 
-      GLint perspectiveMatrixUniform = glGetUniformLocation(perspectiveProgram,
-                                                            "perspectiveMatrix");
+    if (isOpenGL43Supported) {
+      multiDrawProgram = createProgram("OpenGL43/perspectiveMatrixLightedShader.vert",
+                                       "OpenGL43/textureShader.frag");
 
-      float perspectiveMatrix[16];
-      memset(perspectiveMatrix, 0, sizeof(float) * 16);
-      perspectiveMatrix[0] = frustumScale;
-      perspectiveMatrix[5] = frustumScale * ROUND_2_DECIMAL(screenWidth / screenHeight);
-      perspectiveMatrix[10] = (zNear + zFar) / (zNear - zFar);
-      perspectiveMatrix[14] = 2.0f * zNear * zFar / (zNear - zFar);
-      perspectiveMatrix[11] = zOffsetFromCamera;
+      LOGINFO("Linked multi-draw rendering program successfully");
 
-      glUniformMatrix4fv(perspectiveMatrixUniform, 1, GL_FALSE,
-                         perspectiveMatrix);
+      bindFrameData(multiDrawProgram, perspectiveMatrix);
+    }
+
+    stateCache.enable(GL_CULL_FACE);
+    stateCache.cullFace(GL_BACK);
+    stateCache.frontFace(GL_CCW);
+
+    stateCache.clearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClearDepth(1.0f);
+
+    // Program (with shaders) for orthographic rendering of images
+
+    orthographicProgram = createProgram(simpleVertexShaderPath, simpleFragmentShaderPath);
+
+    LOGINFO("Linked orthographic rendering program successfully");
+
+    // Program (with shaders) for rendering text from the glyph atlas
+
+    textProgram = createProgram(textVertexShaderPath, textFragmentShaderPath);
+
+    LOGINFO("Linked text rendering program successfully");
+
+    // Program (with shaders) for rendering text from signed distance fields
+
+    signedDistanceFieldTextProgram = createProgram(textVertexShaderPath, signedDistanceFieldTextFragmentShaderPath);
+
+    LOGINFO("Linked signed distance field text rendering program successfully");
 
-      glUseProgram(0);
+    stateCache.useProgram(0);
+  }
+
+  GLuint Renderer::createProgram(const string &vertexShaderPath, const string &fragmentShaderPath) {
+
+    string vertexShaderSource = loadShader(vertexShaderPath);
+    if (vertexShaderSource.length() == 0) {
+      throw Exception("Shader '" + vertexShaderPath + "' is empty or not found.");
+    }
+
+    string fragmentShaderSource = loadShader(fragmentShaderPath);
+    if (fragmentShaderSource.length() == 0) {
+      throw Exception("Shader '" + fragmentShaderPath + "' is empty or not found.");
+    }
+
+    string cacheFile;
+
+    if (useProgramCache) {
+      cacheFile = getProgramCacheFile(vertexShaderSource, fragmentShaderSource);
+      GLuint program = loadProgramBinary(cacheFile);
+      if (program != 0) {
+        LOGINFO("Program for shaders " + vertexShaderPath + " and " + fragmentShaderPath + " loaded from " + cacheFile);
+        return program;
+      }
+    }
+
+    GLuint vertexShader = compileShader(vertexShaderSource, GL_VERTEX_SHADER, vertexShaderPath);
+    GLuint fragmentShader = compileShader(fragmentShaderSource, GL_FRAGMENT_SHADER, fragmentShaderPath);
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+
+    if (useProgramCache) {
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    glLinkProgram(program);
+
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+      throw Exception("Failed to link program:\n" + this->getProgramInfoLog(program));
     }
-    glDetachShader(perspectiveProgram, vertexShader);
-    glDetachShader(perspectiveProgram, fragmentShader);
+
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glFrontFace(GL_CCW);
+    if (useProgramCache) {
+      saveProgramBinary(program, cacheFile);
+    }
+
+    return program;
+  }
+
+  string Renderer::getProgramCacheFile(const string &vertexShaderSource,
+                                       const string &fragmentShaderSource) const {
+    string key = vertexShaderSource + '\0' + fragmentShaderSource + '\0';
 
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClearDepth(1.0f);
+    GLenum driverStrings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    for (GLenum name : driverStrings) {
+      const GLubyte *value = glGetString(name);
+      if (value != nullptr) {
+        key += reinterpret_cast<const char *>(value);
+      }
+      key += '\0';
+    }
+
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : key) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ULL;
+    }
+
+    ostringstream fileName;
+    fileName << basePath << programCachePath << hex << setfill('0') << setw(16) << hash << ".bin";
+    return fileName.str();
+  }
+
+  GLuint Renderer::loadProgramBinary(const string &cacheFile) {
+    ifstream file(cacheFile.c_str(), ios::binary);
+    if (!file.is_open()) {
+      return 0;
+    }
 
-    // Program (with shaders) for orthographic rendering for text
+    GLenum binaryFormat = 0;
+    vector<char> binary;
 
-    GLuint simpleVertexShader = compileShader(simpleVertexShaderPath,
-                                              GL_VERTEX_SHADER);
-    GLuint simpleFragmentShader = compileShader(simpleFragmentShaderPath,
-                                                GL_FRAGMENT_SHADER);
+    if (file.read(reinterpret_cast<char *>(&binaryFormat), sizeof(binaryFormat))) {
+      binary.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
 
-    orthographicProgram = glCreateProgram();
-    glAttachShader(orthographicProgram, simpleVertexShader);
-    glAttachShader(orthographicProgram, simpleFragmentShader);
+    if (binary.empty()) {
+      LOGINFO("Ignoring unreadable program cache file " + cacheFile);
+      return 0;
+    }
 
-    glLinkProgram(orthographicProgram);
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, binaryFormat, &binary[0], static_cast<GLsizei>(binary.size()));
 
-    glGetProgramiv(orthographicProgram, GL_LINK_STATUS, &status);
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
     if (status == GL_FALSE) {
-      throw Exception("Failed to link program:\n" + this->getProgramInfoLog(orthographicProgram));
+      // The driver can reject binaries even if nothing that is part of the cache key
+      // has changed. The program will then be compiled and cached again.
+      glDeleteProgram(program);
+      while (glGetError() != GL_NO_ERROR);
+      LOGINFO("Cached program " + cacheFile + " is no longer valid");
+      return 0;
     }
-    else {
-      LOGINFO("Linked orthographic rendering program successfully");
+
+    return program;
+  }
+
+  void Renderer::saveProgramBinary(GLuint program, const string &cacheFile) {
+    GLint binaryLength = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    if (binaryLength <= 0) {
+      return;
+    }
+
+    vector<char> binary(binaryLength);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, binaryLength, nullptr, &binaryFormat, &binary[0]);
+
+    ofstream file(cacheFile.c_str(), ios::binary | ios::trunc);
+    file.write(reinterpret_cast<const char *>(&binaryFormat), sizeof(binaryFormat));
+    file.write(&binary[0], binary.size());
+
+    if (!file) {
+      // Not being able to cache programs is not a reason to stop
+      LOGERROR("Could not write program cache file " + cacheFile);
     }
-    glDetachShader(orthographicProgram, simpleVertexShader);
-    glDetachShader(orthographicProgram, simpleFragmentShader);
-    glDeleteShader(simpleVertexShader);
-    glDeleteShader(simpleFragmentShader);
-    glUseProgram(0);
   }
 
   GLuint Renderer::generateTexture(string name, const float* texture, unsigned long width, unsigned long height) {
@@ -478,7 +993,7 @@ namespace small3d {
 
     glGenTextures(1, &textureHandle);
 
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
+    stateCache.bindTexture(GL_TEXTURE_2D, textureHandle);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
 
@@ -496,7 +1011,7 @@ namespace small3d {
     unordered_map<string, GLuint>::iterator nameTexturePair = textures->find(name);
 
     if (nameTexturePair != textures->end()) {
-      glDeleteTextures(1, &(nameTexturePair->second));
+      stateCache.deleteTextures(1, &(nameTexturePair->second));
       textures->erase(name);
     }
   }
@@ -540,14 +1055,14 @@ namespace small3d {
   }
 
 
-  void Renderer::positionCamera() {
+  void Renderer::positionCamera(GLuint program) {
     // Camera rotation
 
-    GLint xCameraRotationMatrixUniform = glGetUniformLocation(perspectiveProgram,
+    GLint xCameraRotationMatrixUniform = glGetUniformLocation(program,
 							      "xCameraRotationMatrix");
-    GLint yCameraRotationMatrixUniform = glGetUniformLocation(perspectiveProgram,
+    GLint yCameraRotationMatrixUniform = glGetUniformLocation(program,
 							      "yCameraRotationMatrix");
-    GLint zCameraRotationMatrixUniform = glGetUniformLocation(perspectiveProgram,
+    GLint zCameraRotationMatrixUniform = glGetUniformLocation(program,
 							      "zCameraRotationMatrix");
 
 
@@ -557,14 +1072,73 @@ namespace small3d {
 
     // Camera position
 
-    GLint cameraPositionUniform = glGetUniformLocation(perspectiveProgram, "cameraPosition");
+    GLint cameraPositionUniform = glGetUniformLocation(program, "cameraPosition");
     glUniform3fv(cameraPositionUniform, 1, glm::value_ptr(cameraPosition));
   }
 
 
+  void Renderer::setFrameUniforms(GLuint program) {
+    if (!isOpenGL33Supported) {
+      positionCamera(program);
+
+      GLint lightDirectionUniform = glGetUniformLocation(program, "lightDirection");
+      glUniform3fv(lightDirectionUniform, 1, glm::value_ptr(lightDirection));
+
+      GLint lightIntensityUniform = glGetUniformLocation(program, "lightIntensity");
+      glUniform1f(lightIntensityUniform, lightIntensity);
+      return;
+    }
+
+    if (frameDataUpToDate && cameraPosition == frameDataCameraPosition &&
+        cameraRotation == frameDataCameraRotation && lightDirection == frameDataLightDirection &&
+        lightIntensity == frameDataLightIntensity) {
+      return;
+    }
+
+    // The part of the FrameData block after the perspective matrix
+    float frameData[24];
+
+    glm::mat4x4 cameraRotationMatrix = rotateZ(-cameraRotation.z) * rotateX(-cameraRotation.x) *
+      rotateY(-cameraRotation.y);
+    memcpy(&frameData[0], glm::value_ptr(cameraRotationMatrix), 16 * sizeof(float));
+    memcpy(&frameData[16], glm::value_ptr(cameraPosition), 3 * sizeof(float));
+    frameData[19] = 0.0f;
+    memcpy(&frameData[20], glm::value_ptr(lightDirection), 3 * sizeof(float));
+    frameData[23] = lightIntensity;
+
+    stateCache.bindBuffer(GL_UNIFORM_BUFFER, frameDataBufferObjectId);
+    glBufferSubData(GL_UNIFORM_BUFFER, FRAME_DATA_CAMERA_OFFSET, sizeof(frameData), frameData);
+    stateCache.bindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    frameDataCameraPosition = cameraPosition;
+    frameDataCameraRotation = cameraRotation;
+    frameDataLightDirection = lightDirection;
+    frameDataLightIntensity = lightIntensity;
+    frameDataUpToDate = true;
+  }
+
+  void Renderer::bindFrameData(GLuint program, const float *perspectiveMatrix) {
+    if (frameDataBufferObjectId == 0) {
+      glGenBuffers(1, &frameDataBufferObjectId);
+      stateCache.bindBuffer(GL_UNIFORM_BUFFER, frameDataBufferObjectId);
+      glBufferData(GL_UNIFORM_BUFFER, FRAME_DATA_SIZE, nullptr, GL_DYNAMIC_DRAW);
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, 16 * sizeof(float), perspectiveMatrix);
+      stateCache.bindBuffer(GL_UNIFORM_BUFFER, 0);
+      stateCache.bindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameDataBufferObjectId);
+    }
+
+    GLuint blockIndex = glGetUniformBlockIndex(program, "FrameData");
+    if (blockIndex == GL_INVALID_INDEX) {
+      throw Exception("The FrameData uniform block has not been found in the shaders.");
+    }
+    glUniformBlockBinding(program, blockIndex, FRAME_DATA_BINDING);
+  }
+
   void Renderer::renderTexture(string name, const glm::vec3 &bottomLeft, const glm::vec3 &topRight, 
                         bool perspective) {
 
+    ProfilerScope profilerScope(profiler, "surfaces");
+
     float vertices[16] = {
       bottomLeft.x, bottomLeft.y, bottomLeft.z, 1.0f,
       topRight.x, bottomLeft.y, bottomLeft.z, 1.0f,
@@ -572,27 +1146,27 @@ namespace small3d {
       bottomLeft.x, topRight.y, topRight.z, 1.0f
     };
 
-    glUseProgram(perspective ? perspectiveProgram : orthographicProgram);
+    stateCache.useProgram(perspective ? perspectiveProgram : orthographicProgram);
 
     GLuint vao = 0;
     if (isOpenGL33Supported) {
       // Generate VAO
       glGenVertexArrays(1, &vao);
-      glBindVertexArray(vao);
+      stateCache.bindVertexArray(vao);
     }
 
-    glEnableVertexAttribArray(0);
+    stateCache.enableVertexAttribArray(0);
 
     GLuint boxBuffer = 0;
     glGenBuffers(1, &boxBuffer);
 
-    glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, boxBuffer);
     glBufferData(GL_ARRAY_BUFFER,
                  sizeof(float) * 16,
                  &vertices[0],
                  GL_STATIC_DRAW);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, 0);
 
     unsigned int vertexIndexes[6] =
       {
@@ -603,7 +1177,7 @@ namespace small3d {
     GLuint indexBufferObject = 0;
 
     glGenBuffers(1, &indexBufferObject);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
+    stateCache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                  sizeof(unsigned int) * 6, vertexIndexes, GL_STATIC_DRAW);
 
@@ -613,7 +1187,7 @@ namespace small3d {
       throw Exception("Texture " + name + "has not been generated");
     }
 
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
+    stateCache.bindTexture(GL_TEXTURE_2D, textureHandle);
 
     float textureCoords[8] =
       {
@@ -626,12 +1200,12 @@ namespace small3d {
     GLuint coordBuffer = 0;
 
     glGenBuffers(1, &coordBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, coordBuffer);
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, coordBuffer);
     glBufferData(GL_ARRAY_BUFFER,
                  sizeof(float) * 8,
                  textureCoords,
                  GL_STATIC_DRAW);
-    glEnableVertexAttribArray(perspective ? 2 : 1);
+    stateCache.enableVertexAttribArray(perspective ? 2 : 1);
     glVertexAttribPointer(perspective ? 2 : 1, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
     if (perspective) {
@@ -641,40 +1215,35 @@ namespace small3d {
       // "Disable" colour since there is a texture
       glUniform4fv(colourUniform, 1, glm::value_ptr(glm::vec4(0.0f, 0.0f, 0.0f, 0.0f)));
 
-      // Lighting
-      GLint lightDirectionUniform = glGetUniformLocation(perspectiveProgram,
-							 "lightDirection");
-      glUniform3fv(lightDirectionUniform, 1,
-                   glm::value_ptr(lightDirection));
-
-      GLint lightIntensityUniform = glGetUniformLocation(perspectiveProgram, "lightIntensity");
-      glUniform1f(lightIntensityUniform, lightIntensity);
-
       positionNextObject(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::mat4x4());
-      positionCamera();
+
+      // Camera and lighting
+      setFrameUniforms(perspectiveProgram);
     }
 
     glDrawElements(GL_TRIANGLES,
                    6, GL_UNSIGNED_INT, 0);
 
-    glDeleteBuffers(1, &indexBufferObject);
-    glDeleteBuffers(1, &boxBuffer);
-    glDeleteBuffers(1, &coordBuffer);
-
-
-    glDisableVertexAttribArray(perspective ? 2 : 1);
-    glDisableVertexAttribArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    stateCache.deleteBuffers(1, &indexBufferObject);
+    stateCache.deleteBuffers(1, &boxBuffer);
+    stateCache.deleteBuffers(1, &coordBuffer);
 
+    // Deleting the vertex array object also unbinds it, and the textures, program
+    // and the rest of the state are left as they are for the next rendering call.
     if (isOpenGL33Supported) {
-      glDeleteVertexArrays(1, &vao);
-      glBindVertexArray(0);
+      stateCache.deleteVertexArrays(1, &vao);
+    }
+    else {
+      stateCache.disableVertexAttribArray(perspective ? 2 : 1);
+      stateCache.disableVertexAttribArray(0);
     }
 
-    checkForOpenGLErrors("rendering image", true);
+    checkForRenderingErrors("rendering image");
   }
 
   void Renderer::renderSurface(glm::vec3 colour, const glm::vec3 &bottomLeft, const glm::vec3 &topRight) {
+     ProfilerScope profilerScope(profiler, "surfaces");
+
      float vertices[16] = {
       bottomLeft.x, bottomLeft.y, bottomLeft.z, 1.0f,
       topRight.x, bottomLeft.y, bottomLeft.z, 1.0f,
@@ -682,27 +1251,27 @@ namespace small3d {
       bottomLeft.x, topRight.y, topRight.z, 1.0f
     };
 
-    glUseProgram(perspectiveProgram);
+    stateCache.useProgram(perspectiveProgram);
 
     GLuint vao = 0;
     if (isOpenGL33Supported) {
       // Generate VAO
       glGenVertexArrays(1, &vao);
-      glBindVertexArray(vao);
+      stateCache.bindVertexArray(vao);
     }
 
-    glEnableVertexAttribArray(0);
+    stateCache.enableVertexAttribArray(0);
 
     GLuint boxBuffer = 0;
     glGenBuffers(1, &boxBuffer);
 
-    glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, boxBuffer);
     glBufferData(GL_ARRAY_BUFFER,
                  sizeof(float) * 16,
                  &vertices[0],
                  GL_STATIC_DRAW);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, 0);
 
     unsigned int vertexIndexes[6] =
       {
@@ -713,7 +1282,7 @@ namespace small3d {
     GLuint indexBufferObject = 0;
 
     glGenBuffers(1, &indexBufferObject);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
+    stateCache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                  sizeof(unsigned int) * 6, vertexIndexes, GL_STATIC_DRAW);
 
@@ -723,214 +1292,244 @@ namespace small3d {
     // Set the colour
     glUniform4fv(colourUniform, 1, glm::value_ptr(glm::vec4(colour, 1.0f)));
 
-    // Lighting
-    GLint lightDirectionUniform = glGetUniformLocation(perspectiveProgram,
-							 "lightDirection");
-    glUniform3fv(lightDirectionUniform, 1,
-                   glm::value_ptr(lightDirection));
-
-    GLint lightIntensityUniform = glGetUniformLocation(perspectiveProgram, "lightIntensity");
-    glUniform1f(lightIntensityUniform, lightIntensity);
-
     positionNextObject(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::mat4x4());
-    positionCamera();
+
+    // Camera and lighting
+    setFrameUniforms(perspectiveProgram);
 
     glDrawElements(GL_TRIANGLES,
                    6, GL_UNSIGNED_INT, 0);
 
-    glDeleteBuffers(1, &indexBufferObject);
-    glDeleteBuffers(1, &boxBuffer);
-
-    glDisableVertexAttribArray(0);
+    stateCache.deleteBuffers(1, &indexBufferObject);
+    stateCache.deleteBuffers(1, &boxBuffer);
 
     if (isOpenGL33Supported) {
-      glDeleteVertexArrays(1, &vao);
-      glBindVertexArray(0);
+      stateCache.deleteVertexArrays(1, &vao);
+    }
+    else {
+      stateCache.disableVertexAttribArray(0);
     }
 
-    checkForOpenGLErrors("rendering surface", true);
+    checkForRenderingErrors("rendering surface");
     
   }
 
   void Renderer::render(const BoundingBoxSet &boundingBoxSet, const glm::vec3 &offset,
 			const glm::vec3 &rotation, const glm::mat4x4 &rotationAdjustment) {
-    glUseProgram(perspectiveProgram);
-    int numBoxes = boundingBoxSet.getNumBoxes();
 
-    for (int idx = 0; idx < numBoxes; ++idx) {
+    // The boxes of all objects are transformed to world space and collected here,
+    // to be drawn together by renderBoundingBoxes.
 
-      GLuint vao = 0;
-      if (isOpenGL33Supported) {
-        // Generate VAO
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-      }
+    glm::mat4 transformation = rotateY(rotation.y) * rotateX(rotation.x) * rotateZ(rotation.z) * rotationAdjustment;
 
-      // Copy vertices to simple structure
+    unsigned int firstVertex = static_cast<unsigned int>(boundingBoxVertices.size() / 4);
 
-      float vertices[24];
+    for (size_t idx = 0; idx + 2 < boundingBoxSet.vertexData.size(); idx += 3) {
+      glm::vec4 vertex = transformation * glm::vec4(boundingBoxSet.vertexData[idx], boundingBoxSet.vertexData[idx + 1],
+                                                    boundingBoxSet.vertexData[idx + 2], 1.0f);
+      float worldVertex[4] = {vertex.x + offset.x, vertex.y + offset.y, vertex.z + offset.z, 1.0f};
+      boundingBoxVertices.insert(boundingBoxVertices.end(), worldVertex, worldVertex + 4);
+    }
 
-      for (unsigned long vIdx = 0; vIdx < 8; ++vIdx) {
-        memcpy(&vertices[vIdx * 3], boundingBoxSet.vertices[idx * 8 + vIdx].data(), 3 * sizeof(float));
-      }
+    for (unsigned int index : boundingBoxSet.indexData) {
+      boundingBoxIndexes.push_back(firstVertex + index);
+    }
+  }
 
-      // Vertices to GPU
+  void Renderer::renderBoundingBoxes() {
 
-      GLuint positionBufferObject = 0;
+    if (boundingBoxIndexes.empty()) {
+      return;
+    }
 
-      glGenBuffers(1, &positionBufferObject);
+    ProfilerScope profilerScope(profiler, "bounding boxes");
 
-      int dataSize = 24 * sizeof(float);
-      glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
+    stateCache.useProgram(perspectiveProgram);
 
-      glBufferData(GL_ARRAY_BUFFER,
-                   dataSize,
-                   &vertices[0],
-                   GL_STATIC_DRAW);
+    if (isOpenGL33Supported) {
+      if (boundingBoxVaoId == 0) {
+        glGenVertexArrays(1, &boundingBoxVaoId);
+      }
+      stateCache.bindVertexArray(boundingBoxVaoId);
+    }
 
-      glEnableVertexAttribArray(0);
-      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    if (boundingBoxVertexBufferObjectId == 0) {
+      glGenBuffers(1, &boundingBoxVertexBufferObjectId);
+      glGenBuffers(1, &boundingBoxIndexBufferObjectId);
+    }
 
-      checkForOpenGLErrors("rendering bounding boxes", true);
+    // The buffers are only reallocated when they need to grow.
 
-      // Copy vertex indexes to simple structure
+    unsigned long verticesSize = static_cast<unsigned long>(boundingBoxVertices.size() * sizeof(float));
+    unsigned long indexesSize = static_cast<unsigned long>(boundingBoxIndexes.size() * sizeof(unsigned int));
 
-      unsigned int vertexIndexes[24];
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, boundingBoxVertexBufferObjectId);
+    if (verticesSize > boundingBoxVertexBufferSize) {
+      glBufferData(GL_ARRAY_BUFFER, verticesSize, boundingBoxVertices.data(), GL_DYNAMIC_DRAW);
+      boundingBoxVertexBufferSize = verticesSize;
+    }
+    else {
+      glBufferSubData(GL_ARRAY_BUFFER, 0, verticesSize, boundingBoxVertices.data());
+    }
 
-      for (unsigned long vIdx = 0; vIdx < 6; ++vIdx) {
-        memcpy(&vertexIndexes[vIdx * 4],
-	       boundingBoxSet.facesVertexIndexes[idx * 6 + vIdx].data(),
-	       4 * sizeof(unsigned int));
-      }
+    stateCache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, boundingBoxIndexBufferObjectId);
+    if (indexesSize > boundingBoxIndexBufferSize) {
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexesSize, boundingBoxIndexes.data(), GL_DYNAMIC_DRAW);
+      boundingBoxIndexBufferSize = indexesSize;
+    }
+    else {
+      glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexesSize, boundingBoxIndexes.data());
+    }
 
-      // Vertex indexes to GPU
+    stateCache.enableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
 
-      GLuint indexBufferObject;
+    // Standard slightly transparent blue colour
 
-      glGenBuffers(1, &indexBufferObject);
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferObject);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                   24 * sizeof(unsigned int),
-                   vertexIndexes,
-                   GL_STATIC_DRAW);
+    GLint colourUniform = glGetUniformLocation(perspectiveProgram, "colour");
+    glUniform4fv(colourUniform, 1, glm::value_ptr(glm::vec4(0.0f, 0.0f, 1.0f, 0.4f)));
 
-      // Standard slightly transparent blue colour
-
-      GLint colourUniform = glGetUniformLocation(perspectiveProgram, "colour");
-      glUniform4fv(colourUniform, 1, glm::value_ptr(glm::vec4(0.0f, 0.0f, 1.0f, 0.4f)));
-
-      //positionNextObject(offset, rotation, rotationAdjustment);
-
-      positionCamera();
+    // The vertices are already in world space
+    positionNextObject(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::mat4x4());
 
-      // Throw an exception if there was an error in OpenGL, during
-      // any of the above.
-      checkForOpenGLErrors("rendering bounding boxes", true);
+    setFrameUniforms(perspectiveProgram);
 
-      // Draw
-      // With triangle fan the boxes look more complete (they are not triangulated, keeping collision
-      // detection simple, so this makes up for it, while rendering.
-      glDrawElements(GL_TRIANGLE_FAN,
-                     24,
-                     GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(boundingBoxIndexes.size()), GL_UNSIGNED_INT, 0);
 
-      // cleanup
+    if (!isOpenGL33Supported) {
+      stateCache.disableVertexAttribArray(0);
+    }
 
-      if (positionBufferObject != 0) {
-        glDeleteBuffers(1, &positionBufferObject);
-      }
+    boundingBoxVertices.clear();
+    boundingBoxIndexes.clear();
 
-      if (indexBufferObject != 0) {
-        glDeleteBuffers(1, &indexBufferObject);
-      }
+    // Throw an exception if there was an error in OpenGL, during
+    // any of the above.
+    checkForRenderingErrors("rendering bounding boxes");
+  }
 
-      glDisableVertexAttribArray(0);
+  void Renderer::render(SceneObject &sceneObject, bool showBoundingBoxes) {
 
-      if (isOpenGL33Supported) {
-        glDeleteVertexArrays(1, &vao);
-        glBindVertexArray(0);
-      }
+    ProfilerScope profilerScope(profiler, "scene");
 
-    }
-    glUseProgram(0);
+    stateCache.useProgram(perspectiveProgram);
 
-  }
+    Model &model = sceneObject.getModel();
 
-  void Renderer::render(SceneObject &sceneObject, bool showBoundingBoxes) {
+    // Interleaved models are rendered from a single buffer, which is
+    // the one otherwise used for the positions.
+    bool interleaved = model.interleavedStride > 0;
 
-    glUseProgram(perspectiveProgram);
+    // Objects in the geometry arena share its buffers and vertex array object.
+    bool inArena = sceneObject.geometryArenaHandle != 0;
 
-    bool alreadyInGPU = true;
     bool copyData = false;
     GLuint drawType = GL_STATIC_DRAW;
 
-    if (sceneObject.positionBufferObjectId == 0) {
-      alreadyInGPU = false;
-      copyData = true;
-    }
-
-    if (sceneObject.isAnimated()) {
-      copyData = true;
-      drawType = GL_DYNAMIC_DRAW;
+    if (inArena) {
+      geometryArena.bind();
     }
+    else {
+      bool alreadyInGPU = true;
 
-    // Either GPU data gets corrupted between frames on some older chipsets, or I am doing
-    // something wrong for OpenGL 2.1 and I have not figured out what it
-    // is. But re-copying data to the buffers, even for non-animated objects
-    // resolves the issue.
-    if (!isOpenGL33Supported) copyData = true;
+      if (sceneObject.positionBufferObjectId == 0) {
+        alreadyInGPU = false;
+        copyData = true;
+      }
 
-    if (!alreadyInGPU) {
-      if (isOpenGL33Supported) {
-        glGenVertexArrays(1, &sceneObject.vaoId);
+      if (sceneObject.isAnimated()) {
+        copyData = true;
+        drawType = GL_DYNAMIC_DRAW;
       }
-      glGenBuffers(1, &sceneObject.indexBufferObjectId);
-      glGenBuffers(1, &sceneObject.positionBufferObjectId);
-      glGenBuffers(1, &sceneObject.normalsBufferObjectId);
-      glGenBuffers(1, &sceneObject.uvBufferObjectId);
-    }
 
-    if (isOpenGL33Supported) {
-      glBindVertexArray(sceneObject.vaoId);
-    }
+      // Either GPU data gets corrupted between frames on some older chipsets, or I am doing
+      // something wrong for OpenGL 2.1 and I have not figured out what it
+      // is. But re-copying data to the buffers, even for non-animated objects
+      // resolves the issue.
+      if (!isOpenGL33Supported) copyData = true;
+
+      if (!alreadyInGPU) {
+        if (isOpenGL33Supported) {
+          glGenVertexArrays(1, &sceneObject.vaoId);
+        }
+        glGenBuffers(1, &sceneObject.indexBufferObjectId);
+        glGenBuffers(1, &sceneObject.positionBufferObjectId);
+        if (!interleaved) {
+          glGenBuffers(1, &sceneObject.normalsBufferObjectId);
+          glGenBuffers(1, &sceneObject.uvBufferObjectId);
+        }
+      }
 
+      if (isOpenGL33Supported) {
+        stateCache.bindVertexArray(sceneObject.vaoId);
+      }
 
-    if (copyData) {
+      if (copyData && interleaved) {
 
-      // Vertices
-      glBindBuffer(GL_ARRAY_BUFFER, sceneObject.positionBufferObjectId);
-      glBufferData(GL_ARRAY_BUFFER,
-                   sceneObject.getModel().vertexDataSize,
-                   sceneObject.getModel().vertexData.data(),
-                   drawType);
+        // Positions, normals and texture coordinates
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, sceneObject.positionBufferObjectId);
+        glBufferData(GL_ARRAY_BUFFER,
+                     model.interleavedDataSize,
+                     model.interleavedData.data(),
+                     drawType);
 
-      // Vertex indexes
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sceneObject.indexBufferObjectId);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                   sceneObject.getModel().indexDataSize,
-                   sceneObject.getModel().indexData.data(),
-                   drawType);
+        // Vertex indexes
+        stateCache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, sceneObject.indexBufferObjectId);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     model.indexDataSize,
+                     model.indexData.data(),
+                     drawType);
+      }
+      else if (copyData) {
 
-      // Normals
-      glBindBuffer(GL_ARRAY_BUFFER, sceneObject.normalsBufferObjectId);
-      if (copyData) {
+        // Vertices
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, sceneObject.positionBufferObjectId);
         glBufferData(GL_ARRAY_BUFFER,
-                     sceneObject.getModel().normalsDataSize,
-                     sceneObject.getModel().normalsData.data(),
+                     sceneObject.getModel().vertexDataSize,
+                     sceneObject.getModel().vertexData.data(),
                      drawType);
+
+        // Vertex indexes
+        stateCache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, sceneObject.indexBufferObjectId);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     sceneObject.getModel().indexDataSize,
+                     sceneObject.getModel().indexData.data(),
+                     drawType);
+
+        // Normals
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, sceneObject.normalsBufferObjectId);
+        if (copyData) {
+          glBufferData(GL_ARRAY_BUFFER,
+                       sceneObject.getModel().normalsDataSize,
+                       sceneObject.getModel().normalsData.data(),
+                       drawType);
+        }
       }
-    }
 
-    // Attribute - vertex
-    glBindBuffer(GL_ARRAY_BUFFER, sceneObject.positionBufferObjectId);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+      if (interleaved) {
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, sceneObject.positionBufferObjectId);
 
-    // Attribute - normals
-    glBindBuffer(GL_ARRAY_BUFFER, sceneObject.normalsBufferObjectId);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void *) 0);
+        // Attribute - vertex
+        stateCache.enableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, model.interleavedStride, 0);
 
+        // Attribute - normals
+        stateCache.enableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, model.interleavedStride,
+                              (void *) Model::INTERLEAVED_NORMAL_OFFSET);
+      }
+      else {
+        // Attribute - vertex
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, sceneObject.positionBufferObjectId);
+        stateCache.enableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+        // Attribute - normals
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, sceneObject.normalsBufferObjectId);
+        stateCache.enableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void *) 0);
+      }
+    }
 
     // Find the colour uniform
     GLint colourUniform = glGetUniformLocation(perspectiveProgram, "colour");
@@ -949,59 +1548,75 @@ namespace small3d {
 						sceneObject.getTexture().getHeight());
       }
 
-      glBindTexture(GL_TEXTURE_2D, sceneObject.textureId);
+      stateCache.bindTexture(GL_TEXTURE_2D, sceneObject.textureId);
 
       // UV Coordinates
 
-      glBindBuffer(GL_ARRAY_BUFFER, sceneObject.uvBufferObjectId);
-
-      if (copyData) {
-        glBufferData(GL_ARRAY_BUFFER,
-                     sceneObject.getModel().textureCoordsDataSize,
-                     sceneObject.getModel().textureCoordsData.data(),
-                     drawType);
+      if (inArena) {
+        // Already set up in the arena's vertex array object
+      }
+      else if (interleaved) {
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, sceneObject.positionBufferObjectId);
+        stateCache.enableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, model.interleavedStride,
+                              (void *) Model::INTERLEAVED_UV_OFFSET);
+      }
+      else {
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, sceneObject.uvBufferObjectId);
+
+        if (copyData) {
+          glBufferData(GL_ARRAY_BUFFER,
+                       sceneObject.getModel().textureCoordsDataSize,
+                       sceneObject.getModel().textureCoordsData.data(),
+                       drawType);
+        }
+
+        stateCache.enableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
       }
-
-      glEnableVertexAttribArray(2);
-      glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
     }
     else {
       // If there is no texture, use the colour of the object
       glUniform4fv(colourUniform, 1, glm::value_ptr(sceneObject.colour));
-    }
 
-    // Lighting
-    GLint lightDirectionUniform = glGetUniformLocation(perspectiveProgram,
-						       "lightDirection");
-    glUniform3fv(lightDirectionUniform, 1,
-                 glm::value_ptr(lightDirection));
-
-    GLint lightIntensityUniform = glGetUniformLocation(perspectiveProgram, "lightIntensity");
-    glUniform1f(lightIntensityUniform, lightIntensity);
+      if (!inArena) {
+        stateCache.disableVertexAttribArray(2);
+      }
+    }
 
     positionNextObject(sceneObject.offset, sceneObject.rotation, sceneObject.getRotationAdjustment());
 
-    positionCamera();
+    // Camera and lighting
+    setFrameUniforms(perspectiveProgram);
 
     // Throw an exception if there was an error in OpenGL, during
     // any of the above.
-    checkForOpenGLErrors("rendering scene", true);
+    checkForRenderingErrors("rendering scene");
 
     // Draw
-    glDrawElements(GL_TRIANGLES,
-                   static_cast<GLsizei>(sceneObject.getModel().indexData.size()),
-                   GL_UNSIGNED_INT, 0);
-
-    // Clear stuff
-    if (sceneObject.getTexture().size() > 0) {
-      glDisableVertexAttribArray(2);
+    if (inArena) {
+      const GeometryArenaAllocation &allocation = geometryArena.getAllocation(sceneObject.geometryArenaHandle);
+      glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(allocation.numIndices), GL_UNSIGNED_INT,
+                               (void *) (allocation.firstIndex * sizeof(unsigned int)),
+                               static_cast<GLint>(allocation.firstVertex));
     }
+    else {
+      glDrawElements(GL_TRIANGLES,
+                     static_cast<GLsizei>(sceneObject.getModel().indexData.size()),
+                     GL_UNSIGNED_INT, 0);
 
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(0);
+      // Clear stuff (with OpenGL 3.3 the vertex attributes are kept in the
+      // object's vertex array object)
+      if (!isOpenGL33Supported) {
+        if (sceneObject.getTexture().size() > 0) {
+          stateCache.disableVertexAttribArray(2);
+        }
 
-    glUseProgram(0);
+        stateCache.disableVertexAttribArray(1);
+        stateCache.disableVertexAttribArray(0);
+      }
+    }
 
     if(showBoundingBoxes && sceneObject.boundingBoxSet.getNumBoxes() > 0) {
       render(sceneObject.boundingBoxSet, sceneObject.offset, sceneObject.rotation, sceneObject.getRotationAdjustment());
@@ -1009,132 +1624,593 @@ namespace small3d {
 
   }
 
-  void Renderer::write(string text, glm::vec3 colour, glm::vec2 bottomLeft, glm::vec2 topRight,
-		       int fontSize, string fontPath)
-  {
+  void Renderer::render(const vector<SceneObject*> &sceneObjects, bool showBoundingBoxes) {
 
-    string faceId = intToStr(fontSize) + fontPath;
-    
-    unordered_map<string, FT_Face>::iterator idFacePair = fontFaces.find(faceId);
+    vector<SceneObject*> batchedObjects;
 
-    FT_Face face;
+    for (SceneObject *sceneObject : sceneObjects) {
+      if (isOpenGL43Supported && sceneObject->geometryArenaHandle != 0) {
+        batchedObjects.push_back(sceneObject);
+      }
+      else {
+        render(*sceneObject, showBoundingBoxes);
+      }
+    }
+
+    if (batchedObjects.empty()) {
+      return;
+    }
+
+    ProfilerScope profilerScope(profiler, "multi-draw");
+
+    for (SceneObject *sceneObject : batchedObjects) {
+      if (sceneObject->getTexture().size() != 0) {
+        sceneObject->textureId = this->getTextureHandle(sceneObject->getName());
+
+        if (sceneObject->textureId == 0) {
+          sceneObject->textureId = generateTexture(sceneObject->getName(), sceneObject->getTexture().getData(),
+                                                   sceneObject->getTexture().getWidth(),
+                                                   sceneObject->getTexture().getHeight());
+        }
+      }
+    }
+
+    // Objects using the same texture are drawn with the same call
+    stable_sort(batchedObjects.begin(), batchedObjects.end(), [](const SceneObject *a, const SceneObject *b) {
+        return (a->getTexture().size() != 0 ? a->textureId : 0) < (b->getTexture().size() != 0 ? b->textureId : 0);
+      });
+
+    stateCache.useProgram(multiDrawProgram);
+
+    // Binding the arena may defragment it, so this is done before reading the
+    // positions of the objects' geometry.
+    geometryArena.bind();
 
-    FT_Error error;
+    vector<float> objectData;
+    objectData.reserve(batchedObjects.size() * MULTI_DRAW_OBJECT_FLOATS);
+    vector<DrawElementsIndirectCommand> commands;
+    commands.reserve(batchedObjects.size());
 
-    if (idFacePair == fontFaces.end()) {
+    for (SceneObject *sceneObject : batchedObjects) {
+      glm::mat4 rotation = rotateY(sceneObject->rotation.y) * rotateX(sceneObject->rotation.x) *
+        rotateZ(sceneObject->rotation.z);
+      glm::mat4 transformation = sceneObject->getTransformation();
 
-      string faceFullPath = basePath + fontPath;
-      LOGINFO("Loading font from " + faceFullPath);
+      glm::vec4 colour = sceneObject->getTexture().size() != 0 ? glm::vec4(0.0f, 0.0f, 0.0f, 0.0f) :
+        sceneObject->colour;
 
-      error = FT_New_Face(library, faceFullPath.c_str(), 0, &face);
+      objectData.insert(objectData.end(), glm::value_ptr(transformation), glm::value_ptr(transformation) + 16);
+      objectData.insert(objectData.end(), glm::value_ptr(rotation), glm::value_ptr(rotation) + 16);
+      objectData.insert(objectData.end(), glm::value_ptr(colour), glm::value_ptr(colour) + 4);
 
-      if (error != 0) {
-	throw Exception("Failed to load font from " + faceFullPath);
+      const GeometryArenaAllocation &allocation = geometryArena.getAllocation(sceneObject->geometryArenaHandle);
+
+      DrawElementsIndirectCommand command;
+      command.count = static_cast<GLuint>(allocation.numIndices);
+      command.instanceCount = 1;
+      command.firstIndex = static_cast<GLuint>(allocation.firstIndex);
+      command.baseVertex = static_cast<GLint>(allocation.firstVertex);
+      // Used to read the object's index (see multiDrawObjectIndexBufferObjectId)
+      command.baseInstance = static_cast<GLuint>(commands.size());
+      commands.push_back(command);
+    }
+
+    if (multiDrawObjectBufferObjectId == 0) {
+      glGenBuffers(1, &multiDrawObjectBufferObjectId);
+      glGenBuffers(1, &multiDrawIndirectBufferObjectId);
+      glGenBuffers(1, &multiDrawObjectIndexBufferObjectId);
+    }
+
+    stateCache.bindBuffer(GL_SHADER_STORAGE_BUFFER, multiDrawObjectBufferObjectId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objectData.size() * sizeof(float), objectData.data(), GL_STREAM_DRAW);
+    stateCache.bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, multiDrawObjectBufferObjectId);
+
+    stateCache.bindBuffer(GL_DRAW_INDIRECT_BUFFER, multiDrawIndirectBufferObjectId);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(),
+                 GL_STREAM_DRAW);
+
+    // Object indexes 0, 1, 2... read once per instance, so that each draw command gets the
+    // index equal to its base instance.
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, multiDrawObjectIndexBufferObjectId);
+    if (commands.size() > multiDrawObjectIndexCapacity) {
+      unsigned long capacity = multiDrawObjectIndexCapacity == 0 ? 256 : multiDrawObjectIndexCapacity;
+      while (capacity < commands.size()) capacity *= 2;
+
+      vector<GLuint> objectIndexes(capacity);
+      for (unsigned long idx = 0; idx < capacity; ++idx) {
+        objectIndexes[idx] = static_cast<GLuint>(idx);
       }
-      else{
-	LOGINFO("Font loaded successfully");
-	fontFaces.insert(make_pair(faceId, face));
+      glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GLuint), objectIndexes.data(), GL_STATIC_DRAW);
+      multiDrawObjectIndexCapacity = capacity;
+    }
+    stateCache.enableVertexAttribArray(3);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, 0);
+    glVertexAttribDivisor(3, 1);
+
+    // Camera and lighting
+
+    setFrameUniforms(multiDrawProgram);
+
+    // Draw
+
+    size_t first = 0;
+    while (first < batchedObjects.size()) {
+      GLuint textureId = batchedObjects[first]->getTexture().size() != 0 ? batchedObjects[first]->textureId : 0;
+      size_t last = first + 1;
+      while (last < batchedObjects.size() &&
+             (batchedObjects[last]->getTexture().size() != 0 ? batchedObjects[last]->textureId : 0) == textureId) {
+        ++last;
       }
-    } else {
-      face = idFacePair->second;
+
+      stateCache.bindTexture(GL_TEXTURE_2D, textureId);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                  (void *) (first * sizeof(DrawElementsIndirectCommand)),
+                                  static_cast<GLsizei>(last - first), 0);
+      first = last;
     }
 
+    // The object indexes are not used when objects in the arena are rendered one by one
+    stateCache.disableVertexAttribArray(3);
+
+    checkForRenderingErrors("rendering scene with multi-draw indirect");
+
+    if (showBoundingBoxes) {
+      for (SceneObject *sceneObject : batchedObjects) {
+        if (sceneObject->boundingBoxSet.getNumBoxes() > 0) {
+          render(sceneObject->boundingBoxSet, sceneObject->offset, sceneObject->rotation,
+                 sceneObject->getRotationAdjustment());
+        }
+      }
+    }
+  }
+
+  FT_Face Renderer::getFontFace(int fontSize, const string &fontPath) {
+
+    string faceId = intToStr(fontSize) + fontPath;
+    
+    unordered_map<string, FT_Face>::iterator idFacePair = fontFaces.find(faceId);
+
+    if (idFacePair != fontFaces.end()) {
+      return idFacePair->second;
+    }
+
+    FT_Face face;
+
+    string faceFullPath = basePath + fontPath;
+    LOGINFO("Loading font from " + faceFullPath);
+
+    FT_Error error = FT_New_Face(library, faceFullPath.c_str(), 0, &face);
+
+    if (error != 0) {
+      throw Exception("Failed to load font from " + faceFullPath);
+    }
+
+    LOGINFO("Font loaded successfully");
+
+    // Each face is only used for a single size, so the size only needs to be set once.
     // Multiplying by 64 to convert to 26.6 fractional points. Using 100dpi.
     error = FT_Set_Char_Size(face, 64 * fontSize, 0, 100, 0);
 
     if (error != 0) {
+      FT_Done_Face(face);
       throw Exception("Failed to set font size.");
     }
 
-    unsigned long width = 0, height =0;
+    fontFaces.insert(make_pair(faceId, face));
 
-    // Figure out bitmap dimensions
-    for(char &c: text) {
-      
-      error = FT_Load_Char(face, (FT_ULong) c, FT_LOAD_RENDER);
+    return face;
+  }
+
+  unsigned long Renderer::layoutText(const string &text, int fontSize, const string &fontPath,
+                                     bool signedDistanceField, vector<float> &vertices) {
 
-      if (error != 0) {
-	throw Exception("Failed to load character glyph.");
+    // Signed distance fields scale well, so a single size serves all text
+    if (signedDistanceField) {
+      fontSize = SIGNED_DISTANCE_FIELD_FONT_SIZE;
+    }
+
+    FT_Face face = getFontFace(fontSize, fontPath);
+
+    vector<AtlasGlyph> glyphs;
+    glyphs.reserve(text.size());
+
+    long width = 0, ascent = 0, descent = 0;
+    unsigned long generation;
+    int attempts = 0;
+
+    // If the atlas fills up and gets reset while the glyphs are being collected,
+    // the ones collected before that point are no longer valid, so start over. If it
+    // is reset again, the glyphs of the text cannot fit in it at the same time.
+    do {
+      if (attempts++ == 2) {
+        throw Exception("The text \"" + text + "\" does not fit in the glyph atlas.");
       }
+      generation = glyphAtlas.getGeneration();
+      glyphs.clear();
+      width = 0;
+      ascent = 0;
+      descent = 0;
 
-      FT_GlyphSlot slot = face->glyph;
+      for (const char &c: text) {
+        AtlasGlyph glyph = glyphAtlas.getGlyph(face, fontSize, static_cast<unsigned char>(c), signedDistanceField);
 
-      width += slot->advance.x / 64;
+        width += glyph.advance;
 
-      if (height < static_cast<unsigned long>(slot->bitmap.rows))
-	height = slot->bitmap.rows;
+        // The padding around distance fields is not part of the glyph's extent
+        long top = glyph.top - static_cast<long>(glyph.padding);
+        long rows = static_cast<long>(glyph.rows) - 2 * static_cast<long>(glyph.padding);
+
+        if (rows > 0) {
+          if (ascent < top) ascent = top;
+          if (descent < rows - top) descent = rows - top;
+        }
+
+        glyphs.push_back(glyph);
+      }
     }
+    while (generation != glyphAtlas.getGeneration());
 
-    textMemory.resize(4 * width * height * sizeof(float));
-    
-    memset(&textMemory[0], 0, 4 * width * height * sizeof(float));
+    vertices.clear();
 
-    unsigned long totalAdvance = 0;
+    long height = ascent + descent;
 
-    for(char &c: text) {
-      error = FT_Load_Char(face, (FT_ULong) c, FT_LOAD_RENDER);
-      if (error != 0) {
-	throw Exception("Failed to load character glyph.");
+    if (width <= 0 || height <= 0) {
+      return 0;
+    }
+
+    unsigned long numGlyphs = 0;
+    long penX = 0;
+
+    for (const AtlasGlyph &glyph : glyphs) {
+
+      if (glyph.width * glyph.rows > 0) {
+        // Positions within the text rectangle, with y pointing up, so that
+        // the baseline lies at the height of the lowest descender.
+        float left = static_cast<float>(penX + glyph.left) / width;
+        float right = static_cast<float>(penX + glyph.left + static_cast<long>(glyph.width)) / width;
+        float top = static_cast<float>(descent + glyph.top) / height;
+        float bottom = static_cast<float>(descent + glyph.top - static_cast<long>(glyph.rows)) / height;
+
+        float u0 = static_cast<float>(glyph.x);
+        float u1 = static_cast<float>(glyph.x + glyph.width);
+        float v0 = static_cast<float>(glyph.y);
+        float v1 = static_cast<float>(glyph.y + glyph.rows);
+
+        float quad[16] = {
+          left, bottom, u0, v1,
+          right, bottom, u1, v1,
+          right, top, u1, v0,
+          left, top, u0, v0
+        };
+
+        vertices.insert(vertices.end(), quad, quad + 16);
+        ++numGlyphs;
       }
 
-      FT_GlyphSlot slot = face->glyph;
-
-      if (slot->bitmap.width * slot->bitmap.rows > 0) {
-	for (int row = 0; row < static_cast<int>(slot->bitmap.rows); ++row){
-	  for (int col = 0; col < static_cast<int>(slot->bitmap.width); ++col) {
-	    glm::vec4 colourAlpha = glm::vec4(colour, 0.0f);
-	    colourAlpha.a = floorf(100.0f *
-		     (static_cast<float>(slot->bitmap.buffer[row * slot->bitmap.width + col]) / 255.0f) + 0.5f) / 100.0f;
-	    memcpy(
-		   &textMemory[4 * width * (height - static_cast<unsigned long>(slot->bitmap_top)
-				     + static_cast<unsigned long>(row)) // row position
-			    + totalAdvance + 4 * (static_cast<unsigned long>(col)
-						  + static_cast<unsigned long>(slot->bitmap_left)) // column position
-			    ],
-		   glm::value_ptr(colourAlpha),
-		   4 * sizeof(float));
-	  }
-	}	  
+      penX += glyph.advance;
+    }
+
+    return numGlyphs;
+  }
+
+  void Renderer::bindTextIndexBuffer(unsigned long numGlyphs) {
+
+    if (textIndexBufferObjectId == 0) {
+      glGenBuffers(1, &textIndexBufferObjectId);
+    }
+
+    stateCache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, textIndexBufferObjectId);
+
+    if (numGlyphs > textIndexBufferCapacity) {
+      unsigned long capacity = textIndexBufferCapacity == 0 ? 64 : textIndexBufferCapacity;
+      while (capacity < numGlyphs) capacity *= 2;
+
+      vector<unsigned int> indexes;
+      indexes.reserve(6 * capacity);
+
+      for (unsigned int idx = 0; idx < capacity; ++idx) {
+        unsigned int quadIndexes[6] = {
+          4 * idx, 4 * idx + 1, 4 * idx + 2,
+          4 * idx + 2, 4 * idx + 3, 4 * idx
+        };
+        indexes.insert(indexes.end(), quadIndexes, quadIndexes + 6);
       }
-      totalAdvance += 4 * static_cast<unsigned long>(slot->advance.x / 64);
 
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexes.size() * sizeof(unsigned int), indexes.data(), GL_STATIC_DRAW);
+      textIndexBufferCapacity = capacity;
     }
+  }
 
-    string textureName = intToStr(fontSize) + "text_" + text;
+  void Renderer::setTextVertexAttributes() {
+    stateCache.enableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
+    stateCache.enableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *) (2 * sizeof(float)));
+  }
 
-    generateTexture(textureName, &textMemory[0], width, height);
+  void Renderer::drawText(GLuint program, unsigned long numGlyphs, const glm::vec3 &colour,
+                          const glm::vec2 &bottomLeft, const glm::vec2 &topRight) {
 
-    renderTexture(textureName, glm::vec3(bottomLeft.x, bottomLeft.y, -0.5f),
-           glm::vec3(topRight.x, topRight.y, -0.5f));
-    
-    deleteTexture(textureName);
-    
+    glyphAtlas.bind(isOpenGL33Supported);
+
+    GLint colourUniform = glGetUniformLocation(program, "colour");
+    glUniform3fv(colourUniform, 1, glm::value_ptr(colour));
+
+    GLint textRectangleUniform = glGetUniformLocation(program, "textRectangle");
+    glUniform4f(textRectangleUniform, bottomLeft.x, bottomLeft.y, topRight.x, topRight.y);
+
+    GLint atlasSizeUniform = glGetUniformLocation(program, "atlasSize");
+    glUniform2f(atlasSizeUniform, static_cast<float>(glyphAtlas.getWidth()),
+                static_cast<float>(glyphAtlas.getHeight()));
+
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(6 * numGlyphs), GL_UNSIGNED_INT, 0);
+  }
+
+  void Renderer::write(string text, glm::vec3 colour, glm::vec2 bottomLeft, glm::vec2 topRight,
+		       int fontSize, string fontPath)
+  {
+
+    ProfilerScope profilerScope(profiler, "text");
+
+    unsigned long numGlyphs = layoutText(text, fontSize, fontPath, signedDistanceFieldText, textMemory);
+
+    if (numGlyphs == 0) {
+      return;
+    }
+
+    GLuint program = signedDistanceFieldText ? signedDistanceFieldTextProgram : textProgram;
+
+    stateCache.useProgram(program);
+
+    if (isOpenGL33Supported) {
+      if (textVaoId == 0) {
+        glGenVertexArrays(1, &textVaoId);
+      }
+      stateCache.bindVertexArray(textVaoId);
+    }
+
+    if (textVertexBufferObjectId == 0) {
+      glGenBuffers(1, &textVertexBufferObjectId);
+    }
+
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, textVertexBufferObjectId);
+    glBufferData(GL_ARRAY_BUFFER, textMemory.size() * sizeof(float), textMemory.data(), GL_STREAM_DRAW);
+
+    setTextVertexAttributes();
+
+    bindTextIndexBuffer(numGlyphs);
+
+    drawText(program, numGlyphs, colour, bottomLeft, topRight);
+
+    if (!isOpenGL33Supported) {
+      stateCache.disableVertexAttribArray(1);
+      stateCache.disableVertexAttribArray(0);
+    }
+
+    checkForRenderingErrors("rendering text");
+  }
+
+  unsigned int Renderer::createText(string text, glm::vec3 colour, int fontSize, string fontPath) {
+    unsigned int handle = nextTextHandle++;
+
+    RetainedText &retainedText = retainedTexts[handle];
+    retainedText.text = text;
+    retainedText.colour = colour;
+    retainedText.fontSize = fontSize;
+    retainedText.fontPath = fontPath;
+
+    return handle;
+  }
+
+  RetainedText& Renderer::getRetainedText(unsigned int handle) {
+    unordered_map<unsigned int, RetainedText>::iterator handleTextPair = retainedTexts.find(handle);
+
+    if (handleTextPair == retainedTexts.end()) {
+      throw Exception("Text " + intToStr(static_cast<int>(handle)) + " has not been created");
+    }
+
+    return handleTextPair->second;
+  }
+
+  void Renderer::updateText(unsigned int handle, string text, glm::vec3 colour, int fontSize, string fontPath) {
+    RetainedText &retainedText = getRetainedText(handle);
+
+    // The colour is passed to the shader when rendering, so it never requires a rebuild.
+    retainedText.colour = colour;
+
+    if (retainedText.text != text || retainedText.fontSize != fontSize || retainedText.fontPath != fontPath) {
+      retainedText.text = text;
+      retainedText.fontSize = fontSize;
+      retainedText.fontPath = fontPath;
+      retainedText.changed = true;
+    }
+  }
+
+  void Renderer::buildRetainedText(unsigned int handle, RetainedText &retainedText) {
+
+    retainedText.signedDistanceField = signedDistanceFieldText;
+    retainedText.numGlyphs = layoutText(retainedText.text, retainedText.fontSize, retainedText.fontPath,
+                                        retainedText.signedDistanceField, textMemory);
+    retainedText.atlasGeneration = glyphAtlas.getGeneration();
+    retainedText.changed = false;
+
+    if (retainedText.vertexBufferObjectId == 0) {
+      glGenBuffers(1, &retainedText.vertexBufferObjectId);
+      retainedTextUsage.push_front(handle);
+      retainedText.usage = retainedTextUsage.begin();
+    }
+    else {
+      // Most recently used, so that it is not released to make room for itself
+      retainedTextUsage.splice(retainedTextUsage.begin(), retainedTextUsage, retainedText.usage);
+    }
+
+    stateCache.bindBuffer(GL_ARRAY_BUFFER, retainedText.vertexBufferObjectId);
+    glBufferData(GL_ARRAY_BUFFER, textMemory.size() * sizeof(float), textMemory.data(), GL_STATIC_DRAW);
+
+    if (isOpenGL33Supported) {
+      if (retainedText.vaoId == 0) {
+        glGenVertexArrays(1, &retainedText.vaoId);
+      }
+      stateCache.bindVertexArray(retainedText.vaoId);
+      setTextVertexAttributes();
+    }
+
+    retainedTextMemory -= retainedText.memorySize;
+    retainedText.memorySize = static_cast<unsigned long>(textMemory.size() * sizeof(float));
+    retainedTextMemory += retainedText.memorySize;
+
+    enforceRetainedTextMemoryLimit(handle);
+  }
+
+  void Renderer::releaseRetainedText(RetainedText &retainedText) {
+    if (retainedText.vertexBufferObjectId != 0) {
+      stateCache.deleteBuffers(1, &retainedText.vertexBufferObjectId);
+      retainedText.vertexBufferObjectId = 0;
+      retainedTextUsage.erase(retainedText.usage);
+    }
+
+    if (retainedText.vaoId != 0) {
+      stateCache.deleteVertexArrays(1, &retainedText.vaoId);
+      retainedText.vaoId = 0;
+    }
+
+    retainedTextMemory -= retainedText.memorySize;
+    retainedText.memorySize = 0;
+    retainedText.numGlyphs = 0;
+    retainedText.changed = true;
+  }
+
+  void Renderer::enforceRetainedTextMemoryLimit(unsigned int keepHandle) {
+    while (retainedTextMemory > retainedTextMemoryLimit && !retainedTextUsage.empty() &&
+           retainedTextUsage.back() != keepHandle) {
+      releaseRetainedText(retainedTexts[retainedTextUsage.back()]);
+    }
+  }
+
+  void Renderer::renderText(unsigned int handle, glm::vec2 bottomLeft, glm::vec2 topRight) {
+    ProfilerScope profilerScope(profiler, "text");
+
+    RetainedText &retainedText = getRetainedText(handle);
+
+    GLuint program = signedDistanceFieldText ? signedDistanceFieldTextProgram : textProgram;
+
+    stateCache.useProgram(program);
+
+    if (retainedText.changed || retainedText.vertexBufferObjectId == 0 ||
+        retainedText.atlasGeneration != glyphAtlas.getGeneration() ||
+        retainedText.signedDistanceField != signedDistanceFieldText) {
+      buildRetainedText(handle, retainedText);
+    }
+    else {
+      // Most recently used
+      retainedTextUsage.splice(retainedTextUsage.begin(), retainedTextUsage, retainedText.usage);
+    }
+
+    if (retainedText.numGlyphs > 0) {
+      if (isOpenGL33Supported) {
+        stateCache.bindVertexArray(retainedText.vaoId);
+      }
+      else {
+        stateCache.bindBuffer(GL_ARRAY_BUFFER, retainedText.vertexBufferObjectId);
+        setTextVertexAttributes();
+      }
+
+      bindTextIndexBuffer(retainedText.numGlyphs);
+
+      drawText(program, retainedText.numGlyphs, retainedText.colour, bottomLeft, topRight);
+
+      if (!isOpenGL33Supported) {
+        stateCache.disableVertexAttribArray(1);
+        stateCache.disableVertexAttribArray(0);
+      }
+    }
+
+    checkForRenderingErrors("rendering retained text");
+  }
+
+  void Renderer::deleteText(unsigned int handle) {
+    unordered_map<unsigned int, RetainedText>::iterator handleTextPair = retainedTexts.find(handle);
+
+    if (handleTextPair != retainedTexts.end()) {
+      releaseRetainedText(handleTextPair->second);
+      retainedTexts.erase(handleTextPair);
+    }
+  }
+
+  void Renderer::setSignedDistanceFieldText(bool signedDistanceFieldText) {
+    this->signedDistanceFieldText = signedDistanceFieldText;
+  }
+
+  const GLStateStatistics& Renderer::getStateStatistics() const {
+    return stateCache.getStatistics();
+  }
+
+  void Renderer::resetStateStatistics() {
+    stateCache.resetStatistics();
+  }
+
+  void Renderer::invalidateStateCache() {
+    stateCache.invalidate();
+    stateCache.activeTexture(GL_TEXTURE0);
+  }
+
+  void Renderer::setRetainedTextMemoryLimit(unsigned long bytes) {
+    retainedTextMemoryLimit = bytes;
+    enforceRetainedTextMemoryLimit(0);
+  }
+
+  unsigned long Renderer::getRetainedTextMemory() const {
+    return retainedTextMemory;
+  }
+
+  bool Renderer::addToGeometryArena(SceneObject &sceneObject) {
+
+    if (!isOpenGL33Supported) {
+      return false;
+    }
+
+    if (sceneObject.isAnimated()) {
+      throw Exception("Animated objects cannot be added to the geometry arena.");
+    }
+
+    if (sceneObject.geometryArenaHandle == 0) {
+      clearBuffers(sceneObject);
+      sceneObject.geometryArenaHandle = geometryArena.add(sceneObject.getModel());
+      checkForRenderingErrors("adding geometry to the arena");
+    }
+
+    return true;
   }
 
   void Renderer::clearBuffers(SceneObject &sceneObject) {
 
+    if (sceneObject.geometryArenaHandle != 0) {
+      geometryArena.remove(sceneObject.geometryArenaHandle);
+      sceneObject.geometryArenaHandle = 0;
+    }
+
     if (sceneObject.positionBufferObjectId != 0) {
-      glDeleteBuffers(1, &sceneObject.positionBufferObjectId);
+      stateCache.deleteBuffers(1, &sceneObject.positionBufferObjectId);
       sceneObject.positionBufferObjectId = 0;
     }
 
     if (sceneObject.indexBufferObjectId != 0) {
-      glDeleteBuffers(1, &sceneObject.indexBufferObjectId);
+      stateCache.deleteBuffers(1, &sceneObject.indexBufferObjectId);
       sceneObject.indexBufferObjectId = 0;
     }
     if (sceneObject.normalsBufferObjectId != 0) {
-      glDeleteBuffers(1, &sceneObject.normalsBufferObjectId);
+      stateCache.deleteBuffers(1, &sceneObject.normalsBufferObjectId);
       sceneObject.normalsBufferObjectId = 0;
     }
 
     if (sceneObject.uvBufferObjectId != 0) {
-      glDeleteBuffers(1, &sceneObject.uvBufferObjectId);
+      stateCache.deleteBuffers(1, &sceneObject.uvBufferObjectId);
       sceneObject.uvBufferObjectId = 0;
     }
 
     if (isOpenGL33Supported) {
       if (sceneObject.vaoId != 0) {
-      	glDeleteVertexArrays(1, &sceneObject.vaoId);
+      	stateCache.deleteVertexArrays(1, &sceneObject.vaoId);
       	sceneObject.vaoId = 0;
       }
     }
@@ -1151,17 +2227,144 @@ namespace small3d {
 
   void Renderer::clearScreen(glm::vec4 colour) {
 
-    glClearColor(colour.r, colour.g, colour.b, colour.a);
+    stateCache.clearColor(colour.r, colour.g, colour.b, colour.a);
     
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   }
 
   void Renderer::swapBuffers() {
+    renderBoundingBoxes();
+
+    if (profilerOverlay && profiler.isEnabled()) {
+      renderProfilerOverlay();
+    }
+
+    if (frameCapture) {
+      ProfilerScope profilerScope(profiler, "frame capture");
+      frameCapture->capture();
+    }
+
+    if (errorChecking == errorcheckingperframe) {
+      checkForOpenGLErrors("rendering frame", true);
+    }
+
+    debugMessages.log();
+
+    {
+      ProfilerScope profilerScope(profiler, "swap");
 #ifdef SMALL3D_GLFW
-    glfwSwapBuffers(window);
+      glfwSwapBuffers(window);
+#elif defined(SMALL3D_HEADLESS)
+      glFinish();
 #else
-    SDL_GL_SwapWindow(window);
+      SDL_GL_SwapWindow(window);
 #endif
+    }
+
+    profiler.endFrame();
+  }
+
+  void Renderer::setProfiling(bool enabled) {
+    // Timer queries are part of OpenGL 3.3
+    profiler.setEnabled(enabled, isOpenGL33Supported || GLEW_ARB_timer_query);
+  }
+
+  Profiler& Renderer::getProfiler() {
+    return profiler;
+  }
+
+  void Renderer::setProfilerOverlay(bool profilerOverlay) {
+    this->profilerOverlay = profilerOverlay;
+  }
+
+  void Renderer::renderProfilerOverlay() {
+    const deque<ProfilerFrame> &frames = profiler.getFrames();
+    if (frames.empty()) return;
+
+    ProfilerScope profilerScope(profiler, "profiler overlay");
+
+    const ProfilerFrame &frame = frames.back();
+
+    vector<string> lines;
+    ostringstream line;
+    line << fixed << setprecision(2) << "frame " << frame.cpuMilliseconds << " ms";
+    if (frame.gpuTimed) {
+      line << ", GPU " << frame.gpuMilliseconds << " ms";
+    }
+    lines.push_back(line.str());
+
+    for (const ProfilerSection &section : frame.sections) {
+      line.str("");
+      line << string(2 * (section.depth + 1), ' ') << section.path.substr(section.path.rfind('/') + 1)
+           << " x" << section.calls << " " << section.cpuMilliseconds << " ms";
+      if (frame.gpuTimed) {
+        line << ", GPU " << section.gpuMilliseconds << " ms";
+      }
+      lines.push_back(line.str());
+    }
+
+    const float lineHeight = 0.06f;
+    const float characterWidth = 0.018f;
+    float top = 0.98f;
+
+    for (const string &text : lines) {
+      if (top - lineHeight < -1.0f) break;
+      write(text, glm::vec3(1.0f, 1.0f, 0.0f), glm::vec2(-0.98f, top - lineHeight),
+            glm::vec2(-0.98f + characterWidth * text.size(), top), 24);
+      top -= lineHeight;
+    }
+  }
+
+  void Renderer::startFrameCapture(const string &path, FrameCaptureFormat format, int frameRate) {
+    if (frameCapture) {
+      throw Exception("Frames are already being captured.");
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    // Fence sync objects are available from OpenGL 3.2
+    frameCapture.reset(new FrameCapture(stateCache, basePath + path, format, viewport[2], viewport[3],
+                                        frameRate, isOpenGL33Supported));
+
+    checkForOpenGLErrors("starting frame capture", true);
+
+    LOGINFO("Capturing " + intToStr(viewport[2]) + "x" + intToStr(viewport[3]) + " frames to " + basePath + path);
+  }
+
+  void Renderer::stopFrameCapture() {
+    if (!frameCapture) return;
+
+    unique_ptr<FrameCapture> capture(std::move(frameCapture));
+
+    capture->finish();
+
+    LOGINFO("Captured " + intToStr(static_cast<int>(capture->getFrameCount())) + " frames");
+  }
+
+  void Renderer::readFrame(vector<unsigned char> &pixels, int &width, int &height) {
+    renderBoundingBoxes();
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    width = viewport[2];
+    height = viewport[3];
+
+    unsigned long rowSize = 4 * static_cast<unsigned long>(width);
+    pixels.resize(rowSize * height);
+
+    if (pixels.empty()) return;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(viewport[0], viewport[1], width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+
+    checkForRenderingErrors("reading the frame");
+
+    // OpenGL returns the bottom row first
+    for (int row = 0; row < height / 2; ++row) {
+      swap_ranges(pixels.begin() + row * rowSize, pixels.begin() + (row + 1) * rowSize,
+                  pixels.begin() + (height - 1 - row) * rowSize);
+    }
   }
 
   /**
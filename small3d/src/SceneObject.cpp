@@ -19,7 +19,7 @@ using namespace std;
 namespace small3d {
 
   SceneObject::SceneObject(string name, string modelPath, int numFrames, string texturePath,
-                           string boundingBoxSetPath, string basePath) : texture(texturePath),
+                           string boundingBoxSetPath, string basePath, int interleavedStride) : texture(texturePath),
 									colour(0,0,0,0), offset(0,0,0),
 									rotation(0,0,0),
 									boundingBoxSet(basePath) {
@@ -44,12 +44,18 @@ namespace small3d {
         string frameNum = ss.str();
         Model model1;
         loader.load(modelPath + "_" + frameNum + ".obj", model1);
+        if (interleavedStride > 0) {
+          model1.interleave(interleavedStride);
+        }
         model.push_back(model1);
       }
     }
     else {
       Model model1;
       loader.load(modelPath, model1);
+      if (interleavedStride > 0) {
+        model1.interleave(interleavedStride);
+      }
       model.push_back(model1);
     }
 
@@ -81,6 +87,16 @@ namespace small3d {
     return rotationAdjustment;
   }
 
+  glm::mat4x4 SceneObject::getTransformation() const {
+    glm::mat4x4 transformation = rotateY(rotation.y) * rotateX(rotation.x) * rotateZ(rotation.z) * rotationAdjustment;
+    transformation[3] = glm::vec4(offset, 1.0f);
+    return transformation;
+  }
+
+  Placement SceneObject::getPlacement() const {
+    return Placement(offset, rotation);
+  }
+
   void SceneObject::startAnimating() {
     animating = true;
   }
@@ -110,18 +126,23 @@ namespace small3d {
     }
   }
 
-  bool SceneObject::collidesWith(glm::vec3 point) {
+  bool SceneObject::collidesWith(glm::vec3 point) const {
     if (boundingBoxSet.vertices.size() == 0) {
       throw Exception("No bounding boxes have been provided for " + name + ", so collision detection is not enabled.");
     }
 
-    boundingBoxSet.offset = this->offset;
-    boundingBoxSet.rotation = this->rotation;
+    return boundingBoxSet.collidesWith(getPlacement(), point);
+  }
 
-    return boundingBoxSet.collidesWith(point);
+  void SceneObject::collidesWith(const vector<glm::vec3> &points, vector<uint32_t> &collisions) const {
+    if (boundingBoxSet.vertices.size() == 0) {
+      throw Exception("No bounding boxes have been provided for " + name + ", so collision detection is not enabled.");
+    }
+
+    boundingBoxSet.collidesWith(getPlacement(), points, collisions);
   }
 
-  bool SceneObject::collidesWith(SceneObject &otherObject) {
+  bool SceneObject::collidesWith(const SceneObject &otherObject, CollisionMode mode) const {
     if (boundingBoxSet.vertices.size() == 0) {
       throw Exception("No bounding boxes have been provided for " + name + ", so collision detection is not enabled.");
     }
@@ -131,15 +152,73 @@ namespace small3d {
           "No bounding boxes have been provided for " + otherObject.name + ", so collision detection is not enabled.");
     }
 
-    boundingBoxSet.offset = offset;
-    boundingBoxSet.rotation = rotation;
+    Placement placement = getPlacement();
+    Placement otherPlacement = otherObject.getPlacement();
 
-    otherObject.boundingBoxSet.offset = otherObject.offset;
-    otherObject.boundingBoxSet.rotation = otherObject.rotation;
+    if (mode == collisionorientedboxes) {
+      return boundingBoxSet.collidesWith(placement, otherObject.boundingBoxSet, otherPlacement, collisionorientedboxes);
+    }
 
     // Checking whether the boxes of this object are within the boxes of the other object or vice versa
-    return boundingBoxSet.collidesWith(otherObject.boundingBoxSet) ||
-        otherObject.boundingBoxSet.collidesWith(boundingBoxSet);
+    return boundingBoxSet.collidesWith(placement, otherObject.boundingBoxSet, otherPlacement) ||
+        otherObject.boundingBoxSet.collidesWith(otherPlacement, boundingBoxSet, placement);
+  }
+
+  bool SceneObject::collidesWith(const SceneObject &otherObject, CollisionCache &cache, CollisionMode mode) const {
+    if (boundingBoxSet.vertices.size() == 0) {
+      throw Exception("No bounding boxes have been provided for " + name + ", so collision detection is not enabled.");
+    }
+
+    if (otherObject.boundingBoxSet.vertices.size() == 0) {
+      throw Exception(
+          "No bounding boxes have been provided for " + otherObject.name + ", so collision detection is not enabled.");
+    }
+
+    Placement placement = getPlacement();
+    Placement otherPlacement = otherObject.getPlacement();
+
+    if (boundingBoxSet.collidesWith(placement, otherObject.boundingBoxSet, otherPlacement, mode, cache)) {
+      return true;
+    }
+
+    // Sets separated along an axis do not collide either way round
+    if (mode == collisionorientedboxes || cache.isSeparated()) {
+      return false;
+    }
+
+    return otherObject.boundingBoxSet.collidesWith(otherPlacement, boundingBoxSet, placement);
+  }
+
+  bool SceneObject::sweptCollidesWith(const glm::vec3 &previousOffset, const SceneObject &otherObject,
+                                      float &timeOfImpact) const {
+    if (boundingBoxSet.vertices.size() == 0) {
+      throw Exception("No bounding boxes have been provided for " + name + ", so collision detection is not enabled.");
+    }
+
+    if (otherObject.boundingBoxSet.vertices.size() == 0) {
+      throw Exception(
+          "No bounding boxes have been provided for " + otherObject.name + ", so collision detection is not enabled.");
+    }
+
+    return boundingBoxSet.sweptCollidesWith(getPlacement(), previousOffset, otherObject.boundingBoxSet,
+                                            otherObject.getPlacement(), timeOfImpact);
+  }
+
+  bool SceneObject::castRay(const glm::vec3 &origin, const glm::vec3 &direction, RayHit &hit,
+                            float maxDistance) const {
+    if (boundingBoxSet.vertices.size() == 0) {
+      throw Exception("No bounding boxes have been provided for " + name + ", so collision detection is not enabled.");
+    }
+
+    return boundingBoxSet.castRay(getPlacement(), origin, direction, hit, maxDistance);
+  }
+
+  bool SceneObject::intersectsSegment(const glm::vec3 &start, const glm::vec3 &end, RayHit &hit) const {
+    if (boundingBoxSet.vertices.size() == 0) {
+      throw Exception("No bounding boxes have been provided for " + name + ", so collision detection is not enabled.");
+    }
+
+    return boundingBoxSet.intersectsSegment(getPlacement(), start, end, hit);
   }
 
   bool SceneObject::isAnimated() {
@@ -67,7 +67,7 @@ namespace small3d {
     noOutputDevice = false;
 
     if (basePath.empty()) {
-#ifndef SMALL3D_GLFW
+#if !defined(SMALL3D_GLFW) && !defined(SMALL3D_HEADLESS)
     this->basePath = string(SDL_GetBasePath());
 #endif
     }
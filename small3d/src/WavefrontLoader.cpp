@@ -180,7 +180,7 @@ namespace small3d {
     clear();
     
     if (basePath.empty()) {
-#ifndef SMALL3D_GLFW
+#if !defined(SMALL3D_GLFW) && !defined(SMALL3D_HEADLESS)
     this->basePath = string(SDL_GetBasePath());
 #endif
     }
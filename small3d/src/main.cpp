@@ -14,6 +14,7 @@
 #endif
 
 #include <gtest/gtest.h>
+#include <fstream>
 
 #include "Renderer.hpp"
 #include "Logger.hpp"
@@ -22,8 +23,12 @@
 #include "BoundingBoxSet.hpp"
 #include "WavefrontLoader.hpp"
 #include "SceneObject.hpp"
+#include "CollisionWorld.hpp"
+#include "MeshBVH.hpp"
+#include "GlyphAtlas.hpp"
 
 #include "GetTokens.hpp"
+#include "Exception.hpp"
 
 /* MinGW produces the following linking error, if the unit tests
  * are linked to the renderer:
@@ -125,6 +130,30 @@ TEST(ModelTest, LoadModel) {
 
 }
 
+TEST(ModelTest, InterleaveModel) {
+
+  WavefrontLoader loader;
+
+  Model model;
+
+  loader.load("resources/models/Cube/Cube.obj", model);
+
+  model.interleave(48);
+
+  EXPECT_EQ(48, model.interleavedStride);
+  EXPECT_EQ(model.vertexData.size() / 4 * 12, model.interleavedData.size());
+
+  unsigned long lastVertex = model.vertexData.size() / 4 - 1;
+
+  EXPECT_EQ(model.vertexData[lastVertex * 4 + 2], model.interleavedData[lastVertex * 12 + 2]);
+  EXPECT_EQ(model.normalsData[lastVertex * 3 + 1], model.interleavedData[lastVertex * 12 + 5]);
+  EXPECT_EQ(model.textureCoordsData[lastVertex * 2 + 1], model.interleavedData[lastVertex * 12 + 8]);
+  EXPECT_EQ(0.0f, model.interleavedData[lastVertex * 12 + 11]);
+
+  EXPECT_THROW(model.interleave(30), small3d::Exception);
+
+}
+
 TEST(BoundingBoxesTest, LoadBoundingBoxes) {
 
   unique_ptr<BoundingBoxSet> bboxes(new BoundingBoxSet());
@@ -133,6 +162,9 @@ TEST(BoundingBoxesTest, LoadBoundingBoxes) {
 
   EXPECT_EQ(16, bboxes->vertices.size());
   EXPECT_EQ(12, bboxes->facesVertexIndexes.size());
+  EXPECT_EQ(48, bboxes->vertexData.size());
+  EXPECT_EQ(72, bboxes->indexData.size());
+  EXPECT_EQ(bboxes->facesVertexIndexes[6][0] + 8, bboxes->indexData[36]);
 
   cout << "Bounding boxes vertices: " << endl;
   for (unsigned long idx = 0; idx < 16; idx++) {
@@ -158,6 +190,335 @@ TEST(BoundingBoxesTest, LoadBoundingBoxes) {
 
   EXPECT_FALSE(bboxes->collidesWith(glm::vec3(0.1f, 0.1f, 0.1f)));
 
+  glm::vec3 boxCentre(0.0f, 0.0f, 0.0f);
+  for (unsigned long idx = 0; idx < 8; idx++) {
+    boxCentre += glm::vec3(bboxes->vertices[idx][0], bboxes->vertices[idx][1], bboxes->vertices[idx][2]) / 8.0f;
+  }
+
+  EXPECT_TRUE(bboxes->collidesWith(boxCentre + bboxes->offset));
+
+  // Checking many points at once
+  vector<glm::vec3> points;
+  for (int idx = 0; idx < 37; ++idx) {
+    points.push_back(idx % 3 == 0 ? boxCentre + bboxes->offset : glm::vec3(0.1f, 0.1f, 0.1f));
+  }
+  vector<uint32_t> collisions;
+  bboxes->collidesWith(points, collisions);
+  ASSERT_EQ(2, collisions.size());
+  for (int idx = 0; idx < 37; ++idx) {
+    EXPECT_EQ(idx % 3 == 0, ((collisions[idx / 32] >> (idx % 32)) & 1) == 1);
+  }
+
+  // The extents of the boxes follow the rotation adjustment
+  glm::mat4x4 adjustment(1.0f);
+  adjustment[3] = glm::vec4(10.0f, 0.0f, 0.0f, 1.0f);
+  bboxes->setRotationAdjustment(adjustment);
+  EXPECT_FALSE(bboxes->collidesWith(boxCentre + bboxes->offset));
+  EXPECT_TRUE(bboxes->collidesWith(boxCentre + bboxes->offset + glm::vec3(10.0f, 0.0f, 0.0f)));
+
+}
+
+TEST(BoundingBoxesTest, OrientedBoxes) {
+
+  BoundingBoxSet bboxes, otherBboxes;
+
+  bboxes.loadFromFile("resources/models/GoatBB/GoatBB.obj");
+  otherBboxes.loadFromFile("resources/models/GoatBB/GoatBB.obj");
+
+  bboxes.offset = glm::vec3(0.0f, 0.0f, 0.0f);
+  bboxes.rotation = glm::vec3(0.0f, 0.0f, 0.0f);
+  otherBboxes.offset = glm::vec3(0.0f, 0.0f, 0.0f);
+  otherBboxes.rotation = glm::vec3(0.0f, 1.5708f, 0.0f);
+
+  // Rotated around the same point, the boxes cross each other
+  EXPECT_TRUE(bboxes.collidesWith(otherBboxes, collisionorientedboxes));
+  EXPECT_TRUE(otherBboxes.collidesWith(bboxes, collisionorientedboxes));
+
+  otherBboxes.offset = glm::vec3(10.0f, 0.0f, 0.0f);
+  EXPECT_FALSE(bboxes.collidesWith(otherBboxes, collisionorientedboxes));
+  EXPECT_FALSE(otherBboxes.collidesWith(bboxes, collisionorientedboxes));
+
+  // Moving through the other set within a single step is detected by the swept test
+  float timeOfImpact;
+  otherBboxes.offset = glm::vec3(-10.0f, 0.0f, 0.0f);
+  EXPECT_FALSE(otherBboxes.collidesWith(bboxes, collisionorientedboxes));
+  EXPECT_TRUE(otherBboxes.sweptCollidesWith(glm::vec3(10.0f, 0.0f, 0.0f), bboxes, timeOfImpact));
+  EXPECT_GT(timeOfImpact, 0.0f);
+  EXPECT_LT(timeOfImpact, 0.5f);
+
+  // Just after the time of impact, the sets overlap
+  otherBboxes.offset = glm::vec3(10.0f - 20.0f * (timeOfImpact + 0.01f), 0.0f, 0.0f);
+  EXPECT_TRUE(otherBboxes.collidesWith(bboxes, collisionorientedboxes));
+
+  otherBboxes.offset = glm::vec3(-10.0f, 10.0f, 0.0f);
+  EXPECT_FALSE(otherBboxes.sweptCollidesWith(glm::vec3(10.0f, 10.0f, 0.0f), bboxes, timeOfImpact));
+  EXPECT_EQ(1.0f, timeOfImpact);
+
+}
+
+TEST(BoundingBoxesTest, RayCasting) {
+
+  BoundingBoxSet bboxes;
+
+  bboxes.loadFromFile("resources/models/GoatBB/GoatBB.obj");
+  bboxes.offset = glm::vec3(1.0f, 0.0f, -2.0f);
+  bboxes.rotation = glm::vec3(0.0f, 0.7f, 0.0f);
+
+  glm::vec3 minCoords, maxCoords;
+  bboxes.getWorldExtents(minCoords, maxCoords);
+  glm::vec3 centre = (minCoords + maxCoords) * 0.5f;
+  glm::vec3 origin = centre + glm::vec3(0.0f, 0.0f, 50.0f);
+
+  RayHit hit;
+  EXPECT_TRUE(bboxes.castRay(origin, glm::vec3(0.0f, 0.0f, -1.0f), hit));
+  EXPECT_GE(hit.boxIndex, 0);
+  EXPECT_GE(hit.distance, 50.0f - (maxCoords.z - centre.z));
+  EXPECT_LE(hit.distance, 50.0f);
+  EXPECT_FALSE(bboxes.castRay(origin, glm::vec3(0.0f, 0.0f, 1.0f), hit));
+  EXPECT_FALSE(bboxes.castRay(origin, glm::vec3(0.0f, 0.0f, -1.0f), hit, 10.0f));
+
+  EXPECT_TRUE(bboxes.intersectsSegment(origin, centre, hit));
+  EXPECT_FALSE(bboxes.intersectsSegment(origin, origin + glm::vec3(10.0f, 0.0f, 0.0f), hit));
+
+  vector<glm::vec3> origins, directions;
+  for (int idx = 0; idx < 7; ++idx) {
+    origins.push_back(origin + glm::vec3(0.0f, 0.0f, idx));
+    directions.push_back(glm::vec3(0.0f, 0.0f, idx % 2 == 0 ? -1.0f : 1.0f));
+  }
+  vector<RayHit> hits;
+  bboxes.castRays(origins, directions, hits);
+  ASSERT_EQ(7, hits.size());
+  for (int idx = 0; idx < 7; ++idx) {
+    EXPECT_EQ(bboxes.castRay(origins[idx], directions[idx], hit), hits[idx].boxIndex >= 0);
+    EXPECT_EQ(hit.boxIndex, hits[idx].boxIndex);
+  }
+
+}
+
+// Writes boxes, given as pairs of minimum and maximum coordinates, to a Wavefront file
+static void writeBoxes(const string &fileName, const vector<glm::vec3> &minMaxCoords) {
+  ofstream file(fileName.c_str());
+  for (size_t idx = 0; idx < minMaxCoords.size() / 2; ++idx) {
+    const glm::vec3 &minCoords = minMaxCoords[2 * idx];
+    const glm::vec3 &maxCoords = minMaxCoords[2 * idx + 1];
+    for (int level = 0; level < 2; ++level) {
+      float y = level == 0 ? minCoords.y : maxCoords.y;
+      file << "v " << minCoords.x << " " << y << " " << maxCoords.z << endl;
+      file << "v " << minCoords.x << " " << y << " " << minCoords.z << endl;
+      file << "v " << maxCoords.x << " " << y << " " << minCoords.z << endl;
+      file << "v " << maxCoords.x << " " << y << " " << maxCoords.z << endl;
+    }
+    unsigned int faces[6][4] = {{5, 6, 2, 1}, {6, 7, 3, 2}, {7, 8, 4, 3},
+                                {8, 5, 1, 4}, {1, 2, 3, 4}, {8, 7, 6, 5}};
+    for (int face = 0; face < 6; ++face) {
+      file << "f";
+      for (int vertex = 0; vertex < 4; ++vertex) {
+        file << " " << faces[face][vertex] + 8 * idx;
+      }
+      file << endl;
+    }
+  }
+}
+
+static float randomBetween(float minValue, float maxValue) {
+  return minValue + (maxValue - minValue) * static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+}
+
+TEST(BoundingBoxesTest, BoxTree) {
+
+  // A 5 x 5 x 5 grid of boxes of different sizes, enough for several levels of the box tree,
+  // and the same boxes one per set, so that the queries can be compared to checking each box
+  vector<glm::vec3> minMaxCoords;
+  for (int x = 0; x < 5; ++x) {
+    for (int y = 0; y < 5; ++y) {
+      for (int z = 0; z < 5; ++z) {
+        glm::vec3 centre(x, y, z);
+        minMaxCoords.push_back(centre - glm::vec3(randomBetween(0.1f, 0.6f), randomBetween(0.1f, 0.6f),
+                                                  randomBetween(0.1f, 0.6f)));
+        minMaxCoords.push_back(centre + glm::vec3(randomBetween(0.1f, 0.6f), randomBetween(0.1f, 0.6f),
+                                                  randomBetween(0.1f, 0.6f)));
+      }
+    }
+  }
+
+  BoundingBoxSet bboxes;
+  writeBoxes("boxtreetest.obj", minMaxCoords);
+  bboxes.loadFromFile("boxtreetest.obj");
+  ASSERT_EQ(125, bboxes.getNumBoxes());
+
+  vector<unique_ptr<BoundingBoxSet> > singleBoxes;
+  for (size_t idx = 0; idx < minMaxCoords.size(); idx += 2) {
+    writeBoxes("boxtreetest.obj", vector<glm::vec3>(minMaxCoords.begin() + idx, minMaxCoords.begin() + idx + 2));
+    singleBoxes.push_back(unique_ptr<BoundingBoxSet>(new BoundingBoxSet()));
+    singleBoxes.back()->loadFromFile("boxtreetest.obj");
+  }
+  remove("boxtreetest.obj");
+
+  Placement placement(glm::vec3(1.0f, 2.0f, 3.0f), glm::vec3(0.3f, 0.5f, 0.2f));
+
+  vector<glm::vec3> points;
+  for (int idx = 0; idx < 300; ++idx) {
+    points.push_back(placement.offset + glm::vec3(randomBetween(-1.0f, 5.0f), randomBetween(-1.0f, 5.0f),
+                                                  randomBetween(-1.0f, 5.0f)));
+  }
+  vector<uint32_t> collisions;
+  bboxes.collidesWith(placement, points, collisions);
+  int numColliding = 0;
+  for (size_t idx = 0; idx < points.size(); ++idx) {
+    bool expected = false;
+    for (const unique_ptr<BoundingBoxSet> &singleBox : singleBoxes) {
+      expected = expected || singleBox->collidesWith(placement, points[idx]);
+    }
+    EXPECT_EQ(expected, bboxes.collidesWith(placement, points[idx]));
+    EXPECT_EQ(expected, ((collisions[idx / 32] >> (idx % 32)) & 1) == 1);
+    if (expected) ++numColliding;
+  }
+  // Both outcomes are covered
+  EXPECT_GT(numColliding, 0);
+  EXPECT_LT(numColliding, 300);
+
+  BoundingBoxSet otherBboxes;
+  otherBboxes.loadFromFile("resources/models/GoatBB/GoatBB.obj");
+
+  int numCollidingSets = 0;
+  for (int idx = 0; idx < 100; ++idx) {
+    Placement otherPlacement(placement.offset + glm::vec3(randomBetween(-2.0f, 6.0f), randomBetween(-2.0f, 6.0f),
+                                                          randomBetween(-2.0f, 6.0f)),
+                             glm::vec3(randomBetween(0.0f, 6.3f), randomBetween(0.0f, 6.3f),
+                                       randomBetween(0.0f, 6.3f)));
+    bool expectedVertices = false, expectedOtherVertices = false, expectedOrientedBoxes = false;
+    for (const unique_ptr<BoundingBoxSet> &singleBox : singleBoxes) {
+      expectedVertices = expectedVertices ||
+                         singleBox->collidesWith(placement, otherBboxes, otherPlacement, collisionvertices);
+      expectedOtherVertices = expectedOtherVertices ||
+                              otherBboxes.collidesWith(otherPlacement, *singleBox, placement, collisionvertices);
+      expectedOrientedBoxes = expectedOrientedBoxes ||
+                              singleBox->collidesWith(placement, otherBboxes, otherPlacement,
+                                                      collisionorientedboxes);
+    }
+    EXPECT_EQ(expectedVertices, bboxes.collidesWith(placement, otherBboxes, otherPlacement, collisionvertices));
+    EXPECT_EQ(expectedOtherVertices,
+              otherBboxes.collidesWith(otherPlacement, bboxes, placement, collisionvertices));
+    EXPECT_EQ(expectedOrientedBoxes,
+              bboxes.collidesWith(placement, otherBboxes, otherPlacement, collisionorientedboxes));
+    EXPECT_EQ(expectedOrientedBoxes,
+              otherBboxes.collidesWith(otherPlacement, bboxes, placement, collisionorientedboxes));
+    if (expectedOrientedBoxes) ++numCollidingSets;
+  }
+  EXPECT_GT(numCollidingSets, 0);
+  EXPECT_LT(numCollidingSets, 100);
+
+}
+
+TEST(BoundingBoxesTest, CollisionWorld) {
+
+  SceneObject goat1("goat1", "resources/models/Cube/Cube.obj", 1, "", "resources/models/GoatBB/GoatBB.obj");
+  SceneObject goat2("goat2", "resources/models/Cube/Cube.obj", 1, "", "resources/models/GoatBB/GoatBB.obj");
+  SceneObject goat3("goat3", "resources/models/Cube/Cube.obj", 1, "", "resources/models/GoatBB/GoatBB.obj");
+
+  goat1.offset = glm::vec3(0.0f, 0.0f, 0.0f);
+  goat2.offset = glm::vec3(0.1f, 0.0f, 0.0f);
+  goat3.offset = glm::vec3(20.0f, 0.0f, 0.0f);
+
+  CollisionWorld world;
+  world.add(goat1);
+  world.add(goat2);
+  world.add(goat3);
+  EXPECT_EQ(3, world.getNumObjects());
+
+  const vector<CollisionPair> &pairs = world.detectCollisions();
+  ASSERT_EQ(1, pairs.size());
+  EXPECT_TRUE(pairs[0].colliding);
+  EXPECT_TRUE((pairs[0].first == &goat1 && pairs[0].second == &goat2) ||
+              (pairs[0].first == &goat2 && pairs[0].second == &goat1));
+
+  goat3.offset = glm::vec3(0.0f, 0.0f, 0.05f);
+  world.remove(goat1);
+  EXPECT_EQ(1, world.detectCollisions().size());
+
+  // Pairs that stay apart are not checked in full again
+  CollisionCache cache;
+  goat3.offset = glm::vec3(20.0f, 0.0f, 0.0f);
+  EXPECT_FALSE(goat2.collidesWith(goat3, cache, collisionorientedboxes));
+  EXPECT_TRUE(cache.isSeparated());
+  goat3.offset = glm::vec3(19.9f, 0.0f, 0.0f);
+  EXPECT_FALSE(goat2.collidesWith(goat3, cache, collisionorientedboxes));
+  EXPECT_EQ(1, cache.fullChecks);
+  goat3.offset = goat2.offset;
+  EXPECT_TRUE(goat2.collidesWith(goat3, cache, collisionorientedboxes));
+  EXPECT_FALSE(cache.isSeparated());
+  goat3.offset = glm::vec3(0.0f, 0.0f, 0.05f);
+
+  // Enough pairs to be shared between the worker threads
+  CollisionWorld threadedWorld(collisionorientedboxes, 4);
+  EXPECT_EQ(4, threadedWorld.getNumThreads());
+  SceneObject *goats[] = {&goat1, &goat2, &goat3};
+  vector<CollisionPair> manyPairs(200);
+  for (size_t idx = 0; idx < manyPairs.size(); ++idx) {
+    manyPairs[idx].first = goats[idx % 3];
+    manyPairs[idx].second = goats[(idx / 3) % 3];
+    manyPairs[idx].colliding = false;
+  }
+  threadedWorld.checkPairs(manyPairs);
+  for (const CollisionPair &pair : manyPairs) {
+    EXPECT_EQ(pair.first->collidesWith(*pair.second, collisionorientedboxes), pair.colliding);
+  }
+
+}
+
+TEST(MeshBVHTest, Queries) {
+
+  // A slope, rising along z, made up of 200 triangles
+  Model model;
+  for (int z = 0; z <= 10; ++z) {
+    for (int x = 0; x <= 10; ++x) {
+      float vertex[4] = {static_cast<float>(x), 0.5f * z, static_cast<float>(z), 1.0f};
+      model.vertexData.insert(model.vertexData.end(), vertex, vertex + 4);
+    }
+  }
+  for (unsigned int z = 0; z < 10; ++z) {
+    for (unsigned int x = 0; x < 10; ++x) {
+      unsigned int corner = z * 11 + x;
+      unsigned int triangles[6] = {corner, corner + 11, corner + 1, corner + 1, corner + 11, corner + 12};
+      model.indexData.insert(model.indexData.end(), triangles, triangles + 6);
+    }
+  }
+
+  MeshBVH bvh(model);
+  EXPECT_EQ(200, bvh.getNumTriangles());
+  EXPECT_GT(bvh.getNumNodes(), 1);
+
+  MeshRayHit hit;
+  EXPECT_TRUE(bvh.castRay(glm::vec3(2.5f, 10.0f, 4.0f), glm::vec3(0.0f, -1.0f, 0.0f), hit));
+  EXPECT_NEAR(8.0f, hit.distance, 0.0001f);
+  EXPECT_GT(hit.normal.y, 0.8f);
+  EXPECT_LT(hit.normal.z, -0.4f);
+  EXPECT_FALSE(bvh.castRay(glm::vec3(2.5f, 10.0f, 4.0f), glm::vec3(0.0f, 1.0f, 0.0f), hit));
+  EXPECT_FALSE(bvh.castRay(glm::vec3(2.5f, 10.0f, 4.0f), glm::vec3(0.0f, -1.0f, 0.0f), hit, 7.0f));
+
+  EXPECT_TRUE(bvh.intersectsSphere(glm::vec3(5.0f, 3.0f, 5.0f), 1.0f));
+  EXPECT_FALSE(bvh.intersectsSphere(glm::vec3(5.0f, 4.0f, 5.0f), 1.0f));
+  EXPECT_TRUE(bvh.intersectsBox(glm::vec3(4.0f, 2.0f, 4.0f), glm::vec3(5.0f, 2.5f, 5.0f)));
+  EXPECT_FALSE(bvh.intersectsBox(glm::vec3(4.0f, 3.0f, 4.0f), glm::vec3(5.0f, 3.5f, 5.0f)));
+
+  // The model moved up by 10
+  glm::mat4x4 transformation(1.0f);
+  transformation[3] = glm::vec4(0.0f, 10.0f, 0.0f, 1.0f);
+  EXPECT_FALSE(bvh.intersectsSphere(glm::vec3(5.0f, 3.0f, 5.0f), 1.0f, transformation));
+  EXPECT_TRUE(bvh.intersectsSphere(glm::vec3(5.0f, 13.0f, 5.0f), 1.0f, transformation));
+
+  // Saving and loading
+  bvh.save("meshbvhtest.bin");
+  MeshBVH loadedBvh;
+  EXPECT_TRUE(loadedBvh.load("meshbvhtest.bin", model));
+  EXPECT_EQ(bvh.getNumNodes(), loadedBvh.getNumNodes());
+  EXPECT_TRUE(loadedBvh.castRay(glm::vec3(2.5f, 10.0f, 4.0f), glm::vec3(0.0f, -1.0f, 0.0f), hit));
+  EXPECT_NEAR(8.0f, hit.distance, 0.0001f);
+
+  model.vertexData[1] = 1.0f;
+  EXPECT_FALSE(loadedBvh.load("meshbvhtest.bin", model));
+  remove("meshbvhtest.bin");
+
 }
 
 
@@ -174,6 +535,209 @@ TEST(RendererTest, StartAndUse) {
   Renderer renderer("test", 640, 480);
   renderer.render(object);
 
+  std::vector<unsigned char> frame;
+  int frameWidth = 0, frameHeight = 0;
+  renderer.readFrame(frame, frameWidth, frameHeight);
+  EXPECT_EQ(640, frameWidth);
+  EXPECT_EQ(480, frameHeight);
+  EXPECT_EQ(640 * 480 * 4, frame.size());
+
+}
+
+TEST(RendererTest, MultiDraw) {
+
+  vector<unique_ptr<SceneObject> > objects;
+  vector<SceneObject*> objectPointers;
+  for (int idx = 0; idx < 12; ++idx) {
+    if (idx % 3 == 0) {
+      objects.push_back(unique_ptr<SceneObject>(new SceneObject("cube", "resources/models/Cube/Cube.obj", 1,
+                                                                "resources/models/Cube/CubeTexture.png")));
+    }
+    else {
+      objects.push_back(unique_ptr<SceneObject>(new SceneObject("plaincube",
+                                                                "resources/models/Cube/CubeNoTexture.obj")));
+      objects.back()->colour = glm::vec4(idx / 12.0f, 0.5f, 1.0f - idx / 12.0f, 1.0f);
+    }
+    objects.back()->offset = glm::vec3(-3.0f + (idx % 4) * 2.0f, -2.0f + (idx / 4) * 2.0f, -8.0f);
+    objects.back()->rotation = glm::vec3(0.1f * idx, 0.2f * idx, 0.05f * idx);
+    objectPointers.push_back(objects.back().get());
+  }
+
+  Renderer renderer("test", 640, 480);
+  renderer.setProfiling(true);
+
+  for (const unique_ptr<SceneObject> &object : objects) {
+    EXPECT_TRUE(renderer.addToGeometryArena(*object));
+  }
+
+  // Rendering the objects together looks the same as rendering them one by one
+  vector<unsigned char> separatePixels, multiDrawPixels;
+  int width, height;
+  renderer.clearScreen(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+  for (SceneObject *object : objectPointers) {
+    renderer.render(*object);
+  }
+  renderer.readFrame(separatePixels, width, height);
+
+  for (int frame = 0; frame <= Profiler::FRAME_LATENCY; ++frame) {
+    renderer.clearScreen(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    renderer.render(objectPointers);
+    if (frame == 0) {
+      renderer.readFrame(multiDrawPixels, width, height);
+    }
+    renderer.swapBuffers();
+  }
+
+  ASSERT_EQ(separatePixels.size(), multiDrawPixels.size());
+  int numDrawn = 0, numDifferent = 0;
+  for (size_t idx = 0; idx < separatePixels.size(); idx += 4) {
+    if (separatePixels[idx] != 0 || separatePixels[idx + 1] != 0 || separatePixels[idx + 2] != 0) ++numDrawn;
+    for (size_t component = idx; component < idx + 3; ++component) {
+      if (abs(separatePixels[component] - multiDrawPixels[component]) > 2) {
+        ++numDifferent;
+        break;
+      }
+    }
+  }
+  EXPECT_GT(numDrawn, 0);
+  EXPECT_EQ(0, numDifferent);
+
+  // With OpenGL 4.3, the objects are drawn with multi-draw indirect
+  bool multiDrawn = false;
+  for (const ProfilerSection &section : renderer.getProfiler().getFrames().back().sections) {
+    multiDrawn = multiDrawn || section.path == "multi-draw";
+  }
+  EXPECT_EQ(glewIsSupported("GL_VERSION_4_3") == GL_TRUE, multiDrawn);
+
+}
+
+TEST(RendererTest, Profile) {
+
+  SceneObject object("animal",
+		     "resources/models/UnspecifiedAnimal/UnspecifiedAnimalWithTexture.obj",
+		     1,
+		     "resources/models/UnspecifiedAnimal/UnspecifiedAnimalWithTextureRedBlackNumbers.png");
+
+  Renderer renderer("test", 640, 480);
+  renderer.setProfiling(true);
+
+  for (int frame = 0; frame < 6; ++frame) {
+    {
+      ProfilerScope pass(renderer.getProfiler(), "pass");
+      renderer.render(object);
+      renderer.render(object);
+    }
+    renderer.write("profiled", glm::vec3(1.0f, 1.0f, 1.0f), glm::vec2(-0.5f, -0.5f), glm::vec2(0.5f, 0.0f));
+    renderer.swapBuffers();
+  }
+
+  const std::deque<ProfilerFrame> &frames = renderer.getProfiler().getFrames();
+  EXPECT_EQ(6 - Profiler::FRAME_LATENCY, frames.size());
+  EXPECT_EQ(0, frames.front().number);
+
+  const ProfilerFrame &profiledFrame = frames.back();
+  ASSERT_EQ(4, profiledFrame.sections.size());
+  EXPECT_EQ("pass", profiledFrame.sections[0].path);
+  EXPECT_EQ("pass/scene", profiledFrame.sections[1].path);
+  EXPECT_EQ(1, profiledFrame.sections[1].depth);
+  EXPECT_EQ(2, profiledFrame.sections[1].calls);
+  EXPECT_EQ("text", profiledFrame.sections[2].path);
+  EXPECT_EQ("swap", profiledFrame.sections[3].path);
+  EXPECT_GE(profiledFrame.sections[0].cpuMilliseconds, profiledFrame.sections[1].cpuMilliseconds);
+
+}
+
+TEST(RendererTest, SkipRedundantState) {
+
+  SceneObject object("animal",
+		     "resources/models/UnspecifiedAnimal/UnspecifiedAnimalWithTexture.obj",
+		     1,
+		     "resources/models/UnspecifiedAnimal/UnspecifiedAnimalWithTextureRedBlackNumbers.png");
+
+  Renderer renderer("test", 640, 480);
+
+  renderer.render(object);
+  renderer.resetStateStatistics();
+
+  // Nothing has to change between rendering the same object twice
+  renderer.render(object);
+  renderer.render(object);
+  EXPECT_GT(renderer.getStateStatistics().getSkipped(), 0);
+  EXPECT_GT(renderer.getStateStatistics().skippedPrograms, 0);
+  EXPECT_GT(renderer.getStateStatistics().skippedTextures, 0);
+
+  renderer.invalidateStateCache();
+  renderer.resetStateStatistics();
+  renderer.render(object);
+  EXPECT_EQ(0, renderer.getStateStatistics().skippedPrograms);
+
+}
+
+TEST(RendererTest, TextTooLargeForAtlas) {
+
+  Renderer renderer("test", 640, 480);
+
+  // The glyphs of a single string, at this size, cannot all be in the atlas at once
+  EXPECT_THROW(renderer.write("abcdefghijklmnopqrstuvwxyz", glm::vec3(1.0f, 1.0f, 1.0f),
+                              glm::vec2(-1.0f, -1.0f), glm::vec2(1.0f, 1.0f), 600), Exception);
+
+}
+
+TEST(RendererTest, GlyphAtlasMaximumHeight) {
+
+  FT_Library library;
+  ASSERT_EQ(0, FT_Init_FreeType(&library));
+  FT_Face face;
+  ASSERT_EQ(0, FT_New_Face(library, "resources/fonts/CrusoeText/CrusoeText-Regular.ttf", 0, &face));
+  FT_Set_Pixel_Sizes(face, 0, 1000);
+
+  // The maximum height is not reached by doubling the initial height, so the atlas
+  // grows to 600 and then to 1000 rows to fit a glyph taller than 600 rows.
+  GLStateCache stateCache;
+  GlyphAtlas atlas(stateCache, 1024, 300, 1000);
+
+  AtlasGlyph glyph = atlas.getGlyph(face, 1000, 'M');
+  ASSERT_GT(glyph.rows, 600);
+  EXPECT_EQ(1000, atlas.getHeight());
+  EXPECT_LE(glyph.y + glyph.rows, atlas.getHeight());
+
+  // There is no room for another glyph as tall, so the atlas is reset
+  glyph = atlas.getGlyph(face, 1000, 'H');
+  EXPECT_EQ(1, atlas.getGeneration());
+  EXPECT_EQ(1000, atlas.getHeight());
+  EXPECT_LE(glyph.y + glyph.rows, atlas.getHeight());
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+
+}
+
+TEST(RendererTest, RetainedTextMemoryLimit) {
+
+  Renderer renderer("test", 640, 480);
+
+  unsigned int first = renderer.createText("first", glm::vec3(1.0f, 1.0f, 1.0f));
+  unsigned int second = renderer.createText("other", glm::vec3(1.0f, 1.0f, 1.0f));
+
+  renderer.renderText(first, glm::vec2(-0.5f, 0.0f), glm::vec2(0.5f, 0.5f));
+  unsigned long textMemory = renderer.getRetainedTextMemory();
+  EXPECT_GT(textMemory, 0);
+  renderer.renderText(second, glm::vec2(-0.5f, -0.5f), glm::vec2(0.5f, 0.0f));
+  EXPECT_EQ(2 * textMemory, renderer.getRetainedTextMemory());
+
+  // The first text is the least recently used, but rebuilding it makes it the most
+  // recently used, so the second one is released to stay within the limit.
+  unsigned long limit = 2 * textMemory;
+  renderer.setRetainedTextMemoryLimit(limit);
+  renderer.updateText(first, "first12", glm::vec3(1.0f, 1.0f, 1.0f));
+  renderer.renderText(first, glm::vec2(-0.5f, 0.0f), glm::vec2(0.5f, 0.5f));
+  EXPECT_LE(renderer.getRetainedTextMemory(), limit);
+  EXPECT_GT(renderer.getRetainedTextMemory(), textMemory);
+
+  // The released text is rebuilt when it is rendered again
+  renderer.renderText(second, glm::vec2(-0.5f, -0.5f), glm::vec2(0.5f, 0.0f));
+  EXPECT_LE(renderer.getRetainedTextMemory(), limit);
+
 }
 #endif
 